@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/program_options.hpp>
+#if defined __x86_64__ || defined __i386__
+#include <x86intrin.h>
+#endif
+
+#include "../hash_algo.hpp"
+#include "../sha256_prefix.hpp"
+
+
+/*
+ * Microbenchmark of the hash kernels. Hashes chains of single-block
+ * messages the way the hasher thread does (each digest is the preimage of
+ * the next hash, all chains of a thread advanced in lockstep), but without
+ * the bloom filter and DB, for every algorithm, backend, way of hashing
+ * and prefix bit length asked for. Reports hashes per second, time stamp
+ * counter ticks per hash and how that scales with the number of threads,
+ * as a table and optionally as CSV or JSON.
+ */
+
+namespace po = boost::program_options;
+
+typedef unsigned long long ull;
+
+
+struct BenchOptions {
+    std::vector<std::string> algos;
+    std::vector<std::string> backends;
+    std::vector<size_t> bitlens;
+    std::vector<size_t> threads;
+    size_t chains;
+    double seconds;
+};
+
+
+struct BenchResult {
+    std::string algo;
+    std::string backend;
+    std::string mode;
+    size_t bitlen;
+    size_t threads;
+    size_t chains;
+    ull hashes;
+    double seconds;
+    // TSC ticks for the whole run, 0 where there is no TSC
+    ull ticks;
+
+    double hashesPerSecond() const {
+        return static_cast<double>(hashes) / seconds;
+    }
+
+    // every thread is busy for the whole run
+    double ticksPerHash() const {
+        return static_cast<double>(ticks) * static_cast<double>(threads) / static_cast<double>(hashes);
+    }
+};
+
+
+static ull readTsc() {
+#if defined __x86_64__ || defined __i386__
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+/*
+ * The ways of hashing a batch of messages: the algorithm's batch function
+ * with a precomputed plan (what the walk uses), its one-block function
+ * called per message and, for SHA-256, the header-only prefix core.
+ */
+template <class Algo>
+struct MultiKernel {
+    typename Algo::Plan plan;
+
+    explicit MultiKernel(size_t bitlen) {
+        Algo::plan_init(&plan, bitlen);
+    }
+
+    void operator()(const void * const *data, unsigned char * const *digest, size_t count) const {
+        Algo::hash_multi(&plan, data, digest, count);
+    }
+};
+
+
+template <class Algo>
+struct OneblockKernel {
+    size_t bitlen;
+
+    explicit OneblockKernel(size_t len) : bitlen(len) {}
+
+    void operator()(const void * const *data, unsigned char * const *digest, size_t count) const {
+        for (size_t i = 0; i < count; i++)
+            Algo::hash_oneblock(data[i], bitlen, digest[i]);
+    }
+};
+
+
+template <size_t Bitlen>
+struct PrefixKernel {
+    explicit PrefixKernel(size_t) {}
+
+    void operator()(const void * const *data, unsigned char * const *digest, size_t count) const {
+        for (size_t i = 0; i < count; i++)
+            sha256Prefix<Bitlen, Bitlen>(static_cast<const unsigned char *>(data[i]), digest[i]);
+    }
+};
+
+
+/*
+ * Advances `chains` hash chains until told to stop. The digests of one
+ * step are the preimages of the next, so two buffers per chain are used
+ * alternately.
+ */
+template <class Algo, class Kernel>
+static void benchThread(size_t bitlen, size_t chains, const std::atomic<bool> *stop, ull *hashes) {
+    const Kernel kernel(bitlen);
+    std::vector<unsigned char> buf(2 * chains * Algo::digest_size);
+    std::vector<const void *> in_a(chains), in_b(chains);
+    std::vector<unsigned char *> out_a(chains), out_b(chains);
+
+    for (size_t i = 0; i < buf.size(); i++)
+        buf[i] = static_cast<unsigned char>(i * 131 + 7);
+    for (size_t i = 0; i < chains; i++) {
+        out_a[i] = &buf[2 * i * Algo::digest_size];
+        out_b[i] = out_a[i] + Algo::digest_size;
+        in_a[i] = out_a[i];
+        in_b[i] = out_b[i];
+    }
+
+    // check for the end only every few hundred steps
+    ull steps = 0;
+    while (!stop->load(std::memory_order_relaxed)) {
+        for (size_t i = 0; i < 128; i++) {
+            kernel(&in_a[0], &out_b[0], chains);
+            kernel(&in_b[0], &out_a[0], chains);
+        }
+        steps += 256;
+    }
+    *hashes = steps * chains;
+}
+
+
+template <class Algo, class Kernel>
+static BenchResult measure(const std::string &backend, const std::string &mode, size_t bitlen,
+                           size_t threads, size_t chains, double seconds) {
+    std::atomic<bool> stop(false);
+    std::vector<ull> hashes(threads);
+    boost::thread_group group;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const ull start_ticks = readTsc();
+    for (size_t i = 0; i < threads; i++)
+        group.create_thread([&stop, &hashes, i, bitlen, chains] {
+            benchThread<Algo, Kernel>(bitlen, chains, &stop, &hashes[i]);
+        });
+
+    boost::this_thread::sleep_for(boost::chrono::microseconds(static_cast<long>(seconds * 1e6)));
+    stop = true;
+    group.join_all();
+
+    const ull end_ticks = readTsc();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    BenchResult r;
+    r.algo = Algo::name();
+    r.backend = backend;
+    r.mode = mode;
+    r.bitlen = bitlen;
+    r.threads = threads;
+    r.chains = chains;
+    r.hashes = 0;
+    for (size_t i = 0; i < threads; i++)
+        r.hashes += hashes[i];
+    r.seconds = elapsed.count();
+    r.ticks = end_ticks - start_ticks;
+    return r;
+}
+
+
+static void printHeader() {
+    std::cout << std::left << std::setw(8) << "algo" << std::setw(10) << "backend" << std::setw(10) << "mode"
+              << std::right << std::setw(7) << "bitlen" << std::setw(8) << "threads" << std::setw(7) << "chains"
+              << std::setw(12) << "Mhash/s" << std::setw(12) << "ticks/hash" << std::endl;
+}
+
+
+static void printResult(const BenchResult &r) {
+    std::cout << std::left << std::setw(8) << r.algo << std::setw(10) << r.backend << std::setw(10) << r.mode
+              << std::right << std::setw(7) << r.bitlen << std::setw(8) << r.threads << std::setw(7) << r.chains
+              << std::fixed << std::setprecision(2) << std::setw(12) << r.hashesPerSecond() / 1e6
+              << std::setprecision(1) << std::setw(12) << r.ticksPerHash() << std::endl;
+}
+
+
+/*
+ * The prefix core only exists for SHA-256 and the bit lengths the hasher
+ * thread has a loop of its own for.
+ */
+template <class Algo>
+struct PrefixBench {
+    static bool run(size_t, size_t, size_t, double, BenchResult *) {
+        return false;
+    }
+};
+
+
+template <>
+struct PrefixBench<Sha256Algo> {
+    static bool run(size_t bitlen, size_t threads, size_t chains, double seconds, BenchResult *r) {
+        switch (bitlen) {
+            case 24:
+                *r = measure<Sha256Algo, PrefixKernel<24>>("inline", "prefix", bitlen, threads, chains, seconds);
+                return true;
+            case 32:
+                *r = measure<Sha256Algo, PrefixKernel<32>>("inline", "prefix", bitlen, threads, chains, seconds);
+                return true;
+            case 40:
+                *r = measure<Sha256Algo, PrefixKernel<40>>("inline", "prefix", bitlen, threads, chains, seconds);
+                return true;
+            case 48:
+                *r = measure<Sha256Algo, PrefixKernel<48>>("inline", "prefix", bitlen, threads, chains, seconds);
+                return true;
+            case 56:
+                *r = measure<Sha256Algo, PrefixKernel<56>>("inline", "prefix", bitlen, threads, chains, seconds);
+                return true;
+            case 64:
+                *r = measure<Sha256Algo, PrefixKernel<64>>("inline", "prefix", bitlen, threads, chains, seconds);
+                return true;
+            default:
+                return false;
+        }
+    }
+};
+
+
+template <class T>
+static bool contains(const std::vector<T> &v, const T &x) {
+    for (const T &y : v)
+        if (y == x)
+            return true;
+    return false;
+}
+
+
+template <class Algo>
+static void benchAlgo(const BenchOptions &opt, std::vector<BenchResult> *results) {
+    static const char * const backends[] = { "portable", "shani", "avx2", "avx512" };
+
+    if (!contains(opt.algos, std::string(Algo::name())))
+        return;
+
+    for (const char *backend : backends) {
+        const int id = Algo::backend_by_name(backend);
+        if (id < 0 || !contains(opt.backends, std::string(backend)))
+            continue;
+        Algo::set_backend(id);
+        const size_t chains = opt.chains ? opt.chains : Algo::lanes();
+
+        for (size_t bitlen : opt.bitlens) {
+            if (bitlen > 8 * Algo::digest_size)
+                continue;
+
+            for (size_t threads : opt.threads) {
+                results->push_back(measure<Algo, MultiKernel<Algo>>(backend, "multi", bitlen, threads, chains, opt.seconds));
+                printResult(results->back());
+                results->push_back(measure<Algo, OneblockKernel<Algo>>(backend, "oneblock", bitlen, threads, chains, opt.seconds));
+                printResult(results->back());
+            }
+        }
+    }
+
+    if (!contains(opt.backends, std::string("inline")))
+        return;
+
+    for (size_t bitlen : opt.bitlens) {
+        for (size_t threads : opt.threads) {
+            BenchResult r;
+            if (PrefixBench<Algo>::run(bitlen, threads, opt.chains ? opt.chains : 1, opt.seconds, &r)) {
+                results->push_back(r);
+                printResult(r);
+            }
+        }
+    }
+}
+
+
+static void writeCsv(const std::string &path, const std::vector<BenchResult> &results) {
+    std::ofstream out(path.c_str());
+    out << "algo,backend,mode,bitlen,threads,chains,hashes,seconds,hashes_per_second,ticks_per_hash" << std::endl;
+    for (const BenchResult &r : results)
+        out << r.algo << "," << r.backend << "," << r.mode << "," << r.bitlen << "," << r.threads << ","
+            << r.chains << "," << r.hashes << "," << r.seconds << "," << r.hashesPerSecond() << ","
+            << r.ticksPerHash() << std::endl;
+}
+
+
+static void writeJson(const std::string &path, const std::vector<BenchResult> &results) {
+    std::ofstream out(path.c_str());
+    out << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        out << "  {\"algo\": \"" << r.algo << "\", \"backend\": \"" << r.backend << "\", \"mode\": \"" << r.mode
+            << "\", \"bitlen\": " << r.bitlen << ", \"threads\": " << r.threads << ", \"chains\": " << r.chains
+            << ", \"hashes\": " << r.hashes << ", \"seconds\": " << r.seconds
+            << ", \"hashes_per_second\": " << r.hashesPerSecond() << ", \"ticks_per_hash\": " << r.ticksPerHash()
+            << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+
+static std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+
+static std::vector<size_t> splitSizes(const std::string &list) {
+    std::vector<size_t> sizes;
+    for (const std::string &item : splitList(list)) {
+        if (item.find_first_not_of("0123456789") != std::string::npos || !std::stoul(item))
+            throw std::invalid_argument("not a positive number: " + item);
+        sizes.push_back(std::stoul(item));
+    }
+    return sizes;
+}
+
+
+int main(int ac, char** av) {
+    const size_t cores = std::max(1u, boost::thread::hardware_concurrency());
+    const std::string default_threads = cores > 1 ? "1," + std::to_string(cores) : "1";
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("algo", po::value<std::string>()->default_value("sha1,sha224,sha256,sha384,sha512"),
+         "comma separated hash algorithms to benchmark")
+        ("backend", po::value<std::string>()->default_value("portable,shani,avx2,avx512,inline"),
+         "comma separated backends to benchmark, the unsupported ones are skipped "
+         "(inline = the SHA-256 prefix core compiled into the hasher)")
+        ("bitlen", po::value<std::string>()->default_value("24,32,40,48,64,128"),
+         "comma separated prefix bit lengths (lengths of the hashed messages)")
+        ("threads", po::value<std::string>()->default_value(default_threads),
+         "comma separated thread counts")
+        ("chains", po::value<size_t>()->default_value(0),
+         "hash chains per thread (0 = as many as the backend hashes at once)")
+        ("seconds", po::value<double>()->default_value(0.25),
+         "duration of each measurement")
+        ("csv", po::value<std::string>(), "also write the results as CSV to this file")
+        ("json", po::value<std::string>(), "also write the results as JSON to this file")
+    ;
+
+    BenchOptions opt;
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(ac, av, desc), vm);
+        po::notify(vm);
+
+        opt.algos = splitList(vm["algo"].as<std::string>());
+        opt.backends = splitList(vm["backend"].as<std::string>());
+        opt.bitlens = splitSizes(vm["bitlen"].as<std::string>());
+        opt.threads = splitSizes(vm["threads"].as<std::string>());
+        opt.chains = vm["chains"].as<size_t>();
+        opt.seconds = vm["seconds"].as<double>();
+    } catch (const std::exception &e) {
+        std::cout << "Bad arguments: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    if (opt.seconds <= 0.0) {
+        std::cout << "Measurements need to take >0 seconds." << std::endl;
+        return 1;
+    }
+
+    for (const std::string &algo : opt.algos) {
+        bool known = false;
+#define IS_ALGO(Algo)                   \
+        if (algo == Algo::name())       \
+            known = true;
+        SHABANG_FOR_EACH_ALGO(IS_ALGO)
+#undef IS_ALGO
+        if (!known) {
+            std::cout << "Unknown hash algorithm " << algo << "." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    printHeader();
+#define BENCH_ALGO(Algo)                \
+    benchAlgo<Algo>(opt, &results);
+    SHABANG_FOR_EACH_ALGO(BENCH_ALGO)
+#undef BENCH_ALGO
+
+    if (vm.count("csv"))
+        writeCsv(vm["csv"].as<std::string>(), results);
+    if (vm.count("json"))
+        writeJson(vm["json"].as<std::string>(), results);
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef SHABANG_CHAIN_INDEX_HPP_
+#define SHABANG_CHAIN_INDEX_HPP_
+
+#include <vector>
+#include "datatypes.hpp"
+#include "hash_algo.hpp"
+
+
+/*
+ * Where hashes are in the chains, kept in the memory store instead of
+ * their preimages (--store-index): the position of a hash is
+ * step * chains + chain, the order they are computed in.
+ */
+
+
+/*
+ * Bytes a position takes, for positions from 0 up to positions.
+ */
+inline size_t indexBytes(ull positions) {
+    size_t bytes = 1;
+    while (bytes < sizeof(ull) && positions >> (8 * bytes))
+        bytes++;
+    return bytes;
+}
+
+
+/*
+ * Position as a big endian number of index->size() bytes.
+ */
+inline void encodeIndex(ull pos, std::vector<uch> *index) {
+    for (size_t i = index->size(); i--; pos >>= 8)
+        (*index)[i] = static_cast<uch>(pos);
+}
+
+
+inline ull decodeIndex(const std::vector<uch> &index) {
+    ull pos = 0;
+    for (auto b : index)
+        pos = (pos << 8) | b;
+    return pos;
+}
+
+
+/*
+ * Preimage of the hash at position pos, recomputed from the last
+ * checkpoint of its chain (taken every interval steps) before it.
+ * checkpoints holds the preimages of all chains at steps 0, interval,
+ * 2 * interval and so on, chain by chain.
+ */
+template <class Algo>
+Hash<Algo> replayChain(const std::vector<Hash<Algo>> &checkpoints, size_t chains, size_t interval, ull pos, const typename Algo::Plan *plan, size_t bitlen) {
+    ull step = pos / chains;
+    ull from = step - step % interval;
+    Hash<Algo> preimage = checkpoints[from / interval * chains + pos % chains];
+    Hash<Algo> hash = Hash<Algo>();
+    const void *data = &preimage[0];
+    unsigned char *digest = &hash[0];
+
+    for (; from < step; from++) {
+        Algo::hash_multi(plan, &data, &digest, 1);
+        trimHash(&hash, bitlen);
+        preimage = hash;
+    }
+    return preimage;
+}
+
+#endif // SHABANG_CHAIN_INDEX_HPP_
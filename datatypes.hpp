@@ -2,10 +2,11 @@
 #define SHABANG_DATATYPES_HPP_
 
 #include <array>
+#include <atomic>
+#include <tuple>
 #include <vector>
 #include <boost/lockfree/spsc_queue.hpp>
 #include <boost/exception_ptr.hpp>
-#include "sha_digest/sha256.h"
 
 
 const uint8_t DBREQ_WRITE = 0;
@@ -14,20 +15,94 @@ const uint8_t DBREQ_READ = 1;
 typedef unsigned long long ull;
 typedef unsigned char uch;
 
-typedef std::array<uch, SHA256_HASH_SIZE> Hash;
-typedef std::pair<Hash, Hash>  HashPair;
+// the hash types depend on the walk's hash algorithm (see hash_algo.hpp)
+template <class Algo> using Hash = std::array<uch, Algo::digest_size>;
+template <class Algo> using HashPair = std::pair<Hash<Algo>, Hash<Algo>>;
 
-typedef std::pair<uch, HashPair> HashPairDbReq;
-typedef std::vector<HashPairDbReq> HashPairDbReqVect;
-typedef boost::lockfree::spsc_queue<HashPairDbReq> DbReqQueue;
+template <class Algo> using HashPairDbReq = std::pair<uch, HashPair<Algo>>;
+template <class Algo> using HashPairDbReqVect = std::vector<HashPairDbReq<Algo>>;
+template <class Algo> using DbReqQueue = boost::lockfree::spsc_queue<HashPairDbReq<Algo>>;
 
 typedef boost::lockfree::spsc_queue<ull> HasherResQueue;
 
-typedef std::tuple<Hash, Hash, Hash, ull> DbRes;
-typedef boost::lockfree::spsc_queue<DbRes> DbResQueue;
+template <class Algo> using DbRes = std::tuple<Hash<Algo>, Hash<Algo>, Hash<Algo>, ull>;
+template <class Algo> using DbResQueue = boost::lockfree::spsc_queue<DbRes<Algo>>;
 
 
-size_t trimHash(Hash *h, size_t bitlen);
-void printHash(Hash *h);
+/*
+ * Live counters of the search, updated by the hasher and DB threads and
+ * read by the main thread for progress reports. Every bloom filter hit
+ * becomes a DB read, those that don't find the hash were false positives.
+ */
+struct SearchStats {
+    std::atomic<ull> hashes;
+    std::atomic<ull> filter_hits;
+    std::atomic<ull> db_reads;
+    std::atomic<ull> confirmed;
+
+    SearchStats() : hashes(0), filter_hits(0), db_reads(0), confirmed(0) {}
+};
+
+
+size_t trimHash(uch *h, size_t size, size_t bitlen);
+void printHash(const uch *h, size_t size);
+
+
+template <size_t N>
+inline size_t trimHash(std::array<uch, N> *h, size_t bitlen) {
+    return trimHash(&(*h)[0], N, bitlen);
+}
+
+
+template <size_t N>
+inline void printHash(std::array<uch, N> *h) {
+    printHash(&(*h)[0], N);
+}
+
+
+/*
+ * Same as trimHash(), for a bit length known at compile time.
+ */
+template <size_t Bitlen, size_t N>
+inline size_t trimHash(std::array<uch, N> *h) {
+    static_assert(Bitlen > 0 && Bitlen <= 8 * N, "bit length out of range");
+    const size_t len = (Bitlen + 7) / 8;
+
+    if (Bitlen % 8)
+        (*h)[len-1] = (*h)[len-1] & static_cast<uch>(0xFF << (8 - (Bitlen % 8)));
+
+    for (size_t i = len; i < N; i++)
+        (*h)[i] = 0x00;
+
+    return len;
+}
+
+
+/*
+ * Bloom filter probe seeds of a trimmed hash of len bytes. The prefix bits
+ * are already uniformly distributed, so rather than hashing them again
+ * they're just folded into a 64 bit word and run through the splitmix64
+ * finalizer. Only the first len bytes are read, so equal prefixes always
+ * give the same seeds.
+ */
+inline uint64_t bloomMix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+
+template <size_t N>
+inline void bloomSeeds(const std::array<uch, N> &h, size_t len, uint64_t *h1, uint64_t *h2) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; i += 8) {
+        uint64_t w = 0;
+        for (size_t j = i; j < i + 8 && j < len; j++)
+            w = (w << 8) | h[j];
+        v = bloomMix(v ^ w);
+    }
+    *h1 = v;
+    *h2 = bloomMix(v + 0x9e3779b97f4a7c15ULL);
+}
 
 #endif // SHABANG_DATATYPES_HPP_
@@ -0,0 +1,211 @@
+#ifndef SHABANG_HASH_ALGO_HPP_
+#define SHABANG_HASH_ALGO_HPP_
+
+#include <string>
+#include "sha_digest/sha1.h"
+#include "sha_digest/sha224.h"
+#include "sha_digest/sha256.h"
+#include "sha_digest/sha384.h"
+#include "sha_digest/sha512.h"
+
+
+/*
+ * The implementations a hash function can be computed with. Those without
+ * any accelerated code only have the portable one.
+ */
+struct PortableBackend {
+    static int by_name(const std::string &name) {
+        return name == "auto" || name == "portable" ? 0 : -1;
+    }
+
+    static void select(int) {
+    }
+
+    static const char *name() {
+        return "portable";
+    }
+
+    static size_t lanes() {
+        return 1;
+    }
+};
+
+
+/*
+ * Backends selected at run time through the functions of a sha_digest
+ * module. by_name() gives -1 for unknown names and backends the CPU
+ * doesn't support, select() must be called before any hashing is done.
+ */
+template <int Count, const char *(*Name)(int), int (*Available)(int),
+          int (*Set)(int), int (*Get)(), size_t (*Lanes)()>
+struct SelectableBackend {
+    static int by_name(const std::string &name) {
+        for (int backend = 0; backend < Count; backend++) {
+            if (name == Name(backend)) {
+                return Available(backend) ? backend : -1;
+            }
+        }
+        return -1;
+    }
+
+    static void select(int backend) {
+        Set(backend);
+    }
+
+    static const char *name() {
+        return Name(Get());
+    }
+
+    static size_t lanes() {
+        return Lanes();
+    }
+};
+
+typedef SelectableBackend<SHA1_BACKEND_COUNT, sha1_backend_name, sha1_backend_available,
+                          sha1_set_backend, sha1_get_backend, sha1_lanes> Sha1Backend;
+typedef SelectableBackend<SHA256_BACKEND_COUNT, sha256_backend_name, sha256_backend_available,
+                          sha256_set_backend, sha256_get_backend, sha256_lanes> Sha256Backend;
+// SHA-384 uses the backends of SHA-512
+typedef SelectableBackend<SHA512_BACKEND_COUNT, sha512_backend_name, sha512_backend_available,
+                          sha512_set_backend, sha512_get_backend, sha512_lanes> Sha512Backend;
+
+
+/*
+ * Compile-time descriptions of the hash functions the walk can use. Each
+ * one gives the digest and block sizes, its backends, what gets
+ * precomputed for hashing messages of a fixed bit length (the Plan), how
+ * to hash a batch of such messages (each fitting into a single block) and
+ * how to hash the seed. Everything handling hashes is instantiated per
+ * algorithm, so there's no dispatching on the algorithm while walking.
+ */
+template <typename Context, size_t DigestSize, size_t BlockSize, size_t MaxBits,
+          int (*Init)(Context *), int (*Add)(Context *, const void *, size_t),
+          int (*Calc)(Context *, unsigned char *), int (*Oneblock)(const void *, size_t, unsigned char *),
+          class Backend = PortableBackend>
+struct OneblockAlgo {
+    static_assert(8 * DigestSize <= MaxBits, "a whole digest has to fit into a single block");
+
+    static constexpr size_t digest_size = DigestSize;
+    static constexpr size_t block_size = BlockSize;
+
+    // nothing to precompute, just the bit length
+    typedef size_t Plan;
+
+    static int backend_by_name(const std::string &name) {
+        return Backend::by_name(name);
+    }
+
+    static void set_backend(int backend) {
+        Backend::select(backend);
+    }
+
+    static const char *backend_name() {
+        return Backend::name();
+    }
+
+    static size_t lanes() {
+        return Backend::lanes();
+    }
+
+    static void plan_init(Plan *plan, size_t bitlen) {
+        *plan = bitlen;
+    }
+
+    static void hash_multi(const Plan *plan, const void * const *data, unsigned char * const *digest, size_t count) {
+        for (size_t i = 0; i < count; i++)
+            Oneblock(data[i], *plan, digest[i]);
+    }
+
+    // a single message, without any plan
+    static void hash_oneblock(const void *data, size_t bitlen, unsigned char *digest) {
+        Oneblock(data, bitlen, digest);
+    }
+
+    static void hash_string(const std::string &s, unsigned char *digest) {
+        Context ctx;
+        Init(&ctx);
+        Add(&ctx, s.c_str(), s.length());
+        Calc(&ctx, digest);
+    }
+};
+
+
+struct Sha1Algo : OneblockAlgo<SHA1_Context, SHA1_HASH_SIZE, 64, SHA1_ONEBLOCK_MAX_BITS,
+                               sha1_initialize, sha1_add_bytes, sha1_calculate, sha1_oneblock,
+                               Sha1Backend> {
+    static const char *name() {
+        return "sha1";
+    }
+
+    static void hash_multi(const Plan *plan, const void * const *data, unsigned char * const *digest, size_t count) {
+        sha1_oneblock_multi(data, *plan, digest, count);
+    }
+};
+
+
+struct Sha224Algo : OneblockAlgo<SHA224_Context, SHA224_HASH_SIZE, 64, SHA224_ONEBLOCK_MAX_BITS,
+                                 sha224_initialize, sha224_add_bytes, sha224_calculate, sha224_oneblock> {
+    static const char *name() {
+        return "sha224";
+    }
+};
+
+
+struct Sha384Algo : OneblockAlgo<SHA384_Context, SHA384_HASH_SIZE, 128, SHA384_ONEBLOCK_MAX_BITS,
+                                 sha384_initialize, sha384_add_bytes, sha384_calculate, sha384_oneblock,
+                                 Sha512Backend> {
+    static const char *name() {
+        return "sha384";
+    }
+
+    static void hash_multi(const Plan *plan, const void * const *data, unsigned char * const *digest, size_t count) {
+        sha384_oneblock_multi(data, *plan, digest, count);
+    }
+};
+
+
+struct Sha512Algo : OneblockAlgo<SHA512_Context, SHA512_HASH_SIZE, 128, SHA512_ONEBLOCK_MAX_BITS,
+                                 sha512_initialize, sha512_add_bytes, sha512_calculate, sha512_oneblock,
+                                 Sha512Backend> {
+    static const char *name() {
+        return "sha512";
+    }
+
+    static void hash_multi(const Plan *plan, const void * const *data, unsigned char * const *digest, size_t count) {
+        sha512_oneblock_multi(data, *plan, digest, count);
+    }
+};
+
+
+/*
+ * SHA-256 additionally has precomputed plans.
+ */
+struct Sha256Algo : OneblockAlgo<SHA256_Context, SHA256_HASH_SIZE, 64, SHA256_ONEBLOCK_MAX_BITS,
+                                 sha256_initialize, sha256_add_bytes, sha256_calculate, sha256_oneblock,
+                                 Sha256Backend> {
+    typedef SHA256_Plan Plan;
+
+    static const char *name() {
+        return "sha256";
+    }
+
+    static void plan_init(Plan *plan, size_t bitlen) {
+        // of the result only the first bitlen bits are used
+        sha256_plan_init(plan, bitlen, bitlen);
+    }
+
+    static void hash_multi(const Plan *plan, const void * const *data, unsigned char * const *digest, size_t count) {
+        sha256_plan_hash_multi(plan, data, digest, count);
+    }
+};
+
+
+// calls X(Algo) for each of the algorithms above
+#define SHABANG_FOR_EACH_ALGO(X) \
+    X(Sha1Algo)                  \
+    X(Sha224Algo)                \
+    X(Sha256Algo)                \
+    X(Sha384Algo)                \
+    X(Sha512Algo)
+
+#endif // SHABANG_HASH_ALGO_HPP_
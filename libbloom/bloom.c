@@ -9,6 +9,9 @@
  * Refer to bloom.h for documentation on the public interfaces.
  */
 
+#define _POSIX_C_SOURCE 200112L
+#define _DEFAULT_SOURCE
+
 #include <assert.h>
 #include <fcntl.h>
 #include <math.h>
@@ -17,79 +20,1009 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#include "bloom.h"
-#include "murmurhash2.h"
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "bloom.h"
+#include "murmurhash2.h"
+
+#define MAKESTRING(n) STRING(n)
+#define STRING(n) #n
+
+// Size of the blocks of a blocked filter, one cache line
+#define BLOCK_BYTES 64
+#define BLOCK_BITS (BLOCK_BYTES * 8)
+#define BLOCK_WORDS (BLOCK_BYTES / 8)
+
+// Elements (and bit positions of a regular filter) prefetched at once by
+// bloom_check_add_batch()
+#define BATCH_ELEMENTS 32
+#define BATCH_POSITIONS 256
+
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
+
+// Each filter added to a scalable one is for this many times the elements
+// of the previous one, at this times its collision probability
+#define SCALABLE_GROWTH 2
+#define SCALABLE_TIGHTENING 0.5
+
+// Cuckoo filters: fingerprints per bucket, the share of slots filled at
+// 'entries' elements, and how many fingerprints an insertion may move
+// about before giving up
+#define CUCKOO_SLOTS 4
+#define CUCKOO_LOAD 0.95
+#define CUCKOO_KICKS 500
+
+// Saved filters: each (of a scalable one) is a header padded to
+// FILE_ALIGN bytes, followed by its bit field padded the same way, so
+// that bit fields can be mapped from the file
+#define FILE_MAGIC "libbloom"
+#define FILE_VERSION 2
+#define FILE_BYTE_ORDER 0x01020304
+#define FILE_ALIGN ((size_t)4096)
+
+// How bit positions are derived from h1 and h2, bump when changing
+// reduce(), blocked_mask() or the murmurhash2 seeds
+#define HASH_SCHEME 1
+
+// The flags saved with a filter, the others are up to the loader
+#define SAVED_FLAGS \
+  (BLOOM_BLOCKED | BLOOM_POW2 | BLOOM_SCALABLE | BLOOM_CUCKOO)
+
+// Where the bit field lives, see bloom_memory()
+#define MEMORY_HEAP    0
+#define MEMORY_MMAP    1
+#define MEMORY_THP     2
+#define MEMORY_HUGETLB 3
+#define MEMORY_FILE    4
+
+// Mappings are aligned to and sized in multiples of (default) huge pages
+#define HUGE_PAGE ((size_t)2 * 1024 * 1024)
+
+// From <numaif.h>, which is only there with libnuma installed
+#define BLOOM_MPOL_INTERLEAVE 3
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOOM_AVX2
+#include <immintrin.h>
+#endif
+
+
+inline static int test_bit_set_bit(unsigned char * buf,
+                                   uint64_t x, int set_bit)
+{
+  size_t byte = x >> 3;
+  unsigned char c = buf[byte];        // expensive memory access
+  unsigned int mask = 1 << (x % 8);
+
+  if (c & mask) {
+    return 1;
+  } else {
+    if (set_bit) {
+      buf[byte] = c | mask;
+    }
+    return 0;
+  }
+}
+
+
+#ifdef __ATOMIC_RELAXED
+/*
+ * Same as test_bit_set_bit() for filters shared by several threads, with
+ * atomic accesses to the 64 bit word holding the bit. Relaxed ordering is
+ * enough, all that matters is that no bit set by another thread gets lost.
+ * The bit is only read first, so elements already in the filter don't
+ * need an atomic read-modify-write (and exclusive access to the cache line).
+ */
+inline static int test_bit_set_bit_atomic(unsigned char * buf,
+                                          uint64_t x, int set_bit)
+{
+  uint64_t * word = (uint64_t *)buf + (x >> 6);
+  uint64_t mask = (uint64_t)1 << (x & 63);
+
+  if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask) {
+    return 1;
+  }
+
+  if (set_bit) {
+    return (__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask) != 0;
+  }
+  return 0;
+}
+#endif
+
+
+/*
+ * Maps a uniformly distributed 64 bit value onto [0, n). Filters with a
+ * power of two size just mask, all others take the high half of x * n,
+ * which spreads as evenly as x % n but needs no division.
+ */
+inline static uint64_t reduce(uint64_t x, uint64_t n, int pow2)
+{
+  if (pow2) {
+    return x & (n - 1);
+  }
+
+#ifdef __SIZEOF_INT128__
+  return (uint64_t)(((unsigned __int128)x * n) >> 64);
+#else
+  uint64_t xl = (uint32_t)x, xh = x >> 32;
+  uint64_t nl = (uint32_t)n, nh = n >> 32;
+  uint64_t lh = xl * nh, hl = xh * nl;
+  uint64_t mid = ((xl * nl) >> 32) + (uint32_t)lh + (uint32_t)hl;
+
+  return xh * nh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+
+/*
+ * Builds the mask of the bits of an element within its block of a blocked
+ * filter: 'hashes' positions, each taken from the top bits of successive
+ * steps of a 64 bit LCG seeded with 'h'. (Simpler schemes like stepping
+ * through the block with a fixed stride make the bits of different
+ * elements overlap far more often than random positions would.)
+ */
+inline static void blocked_mask(uint64_t * mask, uint64_t h, int hashes)
+{
+  uint64_t x = h * 0x9e3779b97f4a7c15ULL;
+  int i;
+
+  memset(mask, 0, BLOCK_BYTES);
+  for (i = 0; i < hashes; i++) {
+    unsigned int bit = (unsigned int)(x >> 55);   // top 9 bits
+    mask[bit >> 6] |= (uint64_t)1 << (bit & 63);
+    x = x * 0x5851f42d4c957f2dULL + 0x14057b7ef767814fULL;
+  }
+}
+
+
+static int blocked_test_set(uint64_t * block, const uint64_t * mask,
+                            int set_bits)
+{
+  uint64_t missing = 0;
+  int i;
+
+  for (i = 0; i < BLOCK_WORDS; i++) {   // expensive memory access
+    missing |= mask[i] & ~block[i];
+  }
+
+  if (!missing) {
+    return 1;
+  }
+
+  if (set_bits) {
+    for (i = 0; i < BLOCK_WORDS; i++) {
+      block[i] |= mask[i];
+    }
+  }
+  return 0;
+}
+
+
+#ifdef BLOOM_AVX2
+/*
+ * Same as blocked_test_set(), the block being tested and updated as a
+ * whole with two 256 bit registers.
+ */
+__attribute__((target("avx2")))
+static int blocked_test_set_avx2(uint64_t * block, const uint64_t * mask,
+                                 int set_bits)
+{
+  __m256i lo = _mm256_load_si256((const __m256i *)block);
+  __m256i hi = _mm256_load_si256((const __m256i *)(block + 4));
+  __m256i mlo = _mm256_loadu_si256((const __m256i *)mask);
+  __m256i mhi = _mm256_loadu_si256((const __m256i *)(mask + 4));
+
+  if (_mm256_testc_si256(lo, mlo) & _mm256_testc_si256(hi, mhi)) {
+    return 1;
+  }
+
+  if (set_bits) {
+    _mm256_store_si256((__m256i *)block, _mm256_or_si256(lo, mlo));
+    _mm256_store_si256((__m256i *)(block + 4), _mm256_or_si256(hi, mhi));
+  }
+  return 0;
+}
+#endif
+
+
+#ifdef __ATOMIC_RELAXED
+/*
+ * Same as blocked_test_set() for filters shared by several threads, each
+ * word of the block being read and updated atomically. Whether all bits
+ * were set is decided by the words' values just before setting the bits,
+ * so of several threads adding the same element at once at least one
+ * gets told it wasn't there yet.
+ */
+static int blocked_test_set_atomic(uint64_t * block, const uint64_t * mask,
+                                   int set_bits)
+{
+  uint64_t missing = 0;
+  int i;
+
+  for (i = 0; i < BLOCK_WORDS; i++) {
+    if (mask[i]) {
+      missing |= mask[i] & ~__atomic_load_n(block + i, __ATOMIC_RELAXED);
+    }
+  }
+
+  if (!missing) {
+    return 1;
+  }
+
+  if (!set_bits) {
+    return 0;
+  }
+
+  missing = 0;
+  for (i = 0; i < BLOCK_WORDS; i++) {
+    if (mask[i]) {
+      missing |= mask[i]
+                 & ~__atomic_fetch_or(block + i, mask[i], __ATOMIC_RELAXED);
+    }
+  }
+  return !missing;
+}
+#endif
+
+
+/*
+ * Keeps count of the elements added, passing on whether the element was
+ * found. Concurrent filters count atomically, that's only done for new
+ * elements and thus cheap compared to setting their bits.
+ */
+inline static int count_added(struct bloom * bloom, int found, int add)
+{
+  if (add && !found) {
+#ifdef __ATOMIC_RELAXED
+    if (bloom->flags & BLOOM_CONCURRENT) {
+      __atomic_fetch_add(&bloom->added, 1, __ATOMIC_RELAXED);
+      return found;
+    }
+#endif
+    bloom->added++;
+  }
+  return found;
+}
+
+
+/*
+ * Checks and adds an element of a blocked filter, the block being picked
+ * by 'h1' (see blocked_block()) and the bits within it by 'h2'.
+ */
+static uint64_t * blocked_block(struct bloom * bloom, uint64_t h1)
+{
+  return (uint64_t *)bloom->bf
+         + reduce(h1, bloom->blocks, bloom->flags & BLOOM_POW2) * BLOCK_WORDS;
+}
+
+
+static int blocked_check_add(struct bloom * bloom,
+                             uint64_t * block, uint64_t h2, int add)
+{
+  uint64_t mask[BLOCK_WORDS];
+
+  blocked_mask(mask, h2, bloom->hashes);
+#ifdef __ATOMIC_RELAXED
+  if (bloom->flags & BLOOM_CONCURRENT) {
+    return count_added(bloom, blocked_test_set_atomic(block, mask, add), add);
+  }
+#endif
+#ifdef BLOOM_AVX2
+  if (bloom->simd) {
+    return count_added(bloom, blocked_test_set_avx2(block, mask, add), add);
+  }
+#endif
+  return count_added(bloom, blocked_test_set(block, mask, add), add);
+}
+
+
+/*
+ * The fingerprints of a cuckoo filter are packed without gaps, each one
+ * read and written through the (unaligned, little endian) 64 bit word it
+ * starts in. The bit field has 8 bytes to spare at its end for this, and
+ * fingerprints are at most 56 bits.
+ */
+inline static uint64_t cuckoo_load(const unsigned char * p)
+{
+  uint64_t w;
+
+  memcpy(&w, p, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64(w);
+#endif
+  return w;
+}
+
+
+inline static void cuckoo_store(unsigned char * p, uint64_t w)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64(w);
+#endif
+  memcpy(p, &w, sizeof(w));
+}
+
+
+inline static const unsigned char * cuckoo_bucket(struct bloom * bloom,
+                                                  size_t bucket)
+{
+  return bloom->bf
+         + (((uint64_t)bucket * CUCKOO_SLOTS * bloom->fingerprint) >> 3);
+}
+
+
+inline static uint64_t cuckoo_get(struct bloom * bloom, size_t slot)
+{
+  uint64_t bit = (uint64_t)slot * bloom->fingerprint;
+  uint64_t mask = ((uint64_t)1 << bloom->fingerprint) - 1;
+
+  return (cuckoo_load(bloom->bf + (bit >> 3)) >> (bit & 7)) & mask;
+}
+
+
+inline static void cuckoo_set(struct bloom * bloom, size_t slot, uint64_t fp)
+{
+  uint64_t bit = (uint64_t)slot * bloom->fingerprint;
+  uint64_t mask = ((uint64_t)1 << bloom->fingerprint) - 1;
+  uint64_t w = cuckoo_load(bloom->bf + (bit >> 3));
+
+  w = (w & ~(mask << (bit & 7))) | (fp << (bit & 7));
+  cuckoo_store(bloom->bf + (bit >> 3), w);
+}
+
+
+/*
+ * Slot of 'fp' within the bucket, -1 if not there (0 finds a free slot).
+ * The slots get compared as lanes of the 64 bit word they start in
+ * (SWAR), all four at once for up to 14 bit fingerprints and two at a
+ * time for up to 28 bits, one by one above that. A lane equal to
+ * 'fp' becomes 0 when xor'ed with it, and subtracting 1 from every lane
+ * borrows the top bit of only the zero ones (and possibly of lanes above
+ * them, which doesn't matter as the lowest one wins).
+ */
+static int cuckoo_find(struct bloom * bloom, size_t bucket, uint64_t fp)
+{
+  int f = bloom->fingerprint;
+  int lanes = f <= 14 ? 4 : f <= 28 ? 2 : 1;    // CUCKOO_SLOTS
+  uint64_t ones = lanes == 4 ? 1 | (uint64_t)1 << f | (uint64_t)1 << 2*f
+                               | (uint64_t)1 << 3*f
+                  : lanes == 2 ? 1 | (uint64_t)1 << f : 1;
+  uint64_t mask = ((uint64_t)1 << (lanes * f)) - 1;
+  uint64_t bit = (uint64_t)bucket * CUCKOO_SLOTS * f;
+  int i;
+
+  for (i = 0; i < CUCKOO_SLOTS; i += lanes, bit += (uint64_t)lanes * f) {
+    uint64_t x = (cuckoo_load(bloom->bf + (bit >> 3)) >> (bit & 7)) & mask;
+    uint64_t zero;
+
+    x ^= fp * ones;
+    zero = (x - ones) & ~x & (ones << (f - 1));
+    if (zero) {
+      while (!(zero & ((uint64_t)1 << (f - 1)))) {
+        zero >>= f;
+        i++;
+      }
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+// the top bits of 'h2', never 0 (which marks free slots)
+inline static uint64_t cuckoo_fingerprint(struct bloom * bloom, uint64_t h2)
+{
+  uint64_t fp = h2 >> (64 - bloom->fingerprint);
+
+  return fp ? fp : 1;
+}
+
+
+/*
+ * The other bucket 'fp' may go into, found from the fingerprint alone so
+ * that it can be moved without knowing its element: (hash(fp) - bucket)
+ * modulo the number of buckets leads back and forth between the two.
+ */
+inline static size_t cuckoo_other(struct bloom * bloom, size_t bucket,
+                                  uint64_t fp)
+{
+  size_t h = reduce(fp * 0x9e3779b97f4a7c15ULL, bloom->blocks, 0);
+
+  return h >= bucket ? h - bucket : h + bloom->blocks - bucket;
+}
+
+
+/*
+ * Checks and adds an element of a cuckoo filter, by its fingerprint and
+ * two buckets. An element that finds both its buckets taken goes into
+ * one of them anyway, pushing a random fingerprint there over to its
+ * other bucket, and so on. After CUCKOO_KICKS of those the fingerprint
+ * left over is kept aside as the victim (and still found). When there
+ * already is one, the filter is full.
+ */
+static int cuckoo_check_add(struct bloom * bloom, uint64_t fp,
+                            size_t b1, size_t b2, int add)
+{
+  size_t bucket;
+  int kick;
+  int i;
+
+  if (bloom->full
+      || cuckoo_find(bloom, b1, fp) >= 0 || cuckoo_find(bloom, b2, fp) >= 0
+      || (bloom->victim == fp
+          && (bloom->victim_bucket == b1 || bloom->victim_bucket == b2))) {
+    return 1;
+  }
+
+  if (!add) {
+    return 0;
+  }
+  bloom->added++;
+
+  if ((i = cuckoo_find(bloom, b1, 0)) >= 0) {
+    cuckoo_set(bloom, b1 * CUCKOO_SLOTS + i, fp);
+    return 0;
+  }
+  if ((i = cuckoo_find(bloom, b2, 0)) >= 0) {
+    cuckoo_set(bloom, b2 * CUCKOO_SLOTS + i, fp);
+    return 0;
+  }
+
+  // no room for this one, which still has to be found: from now on every
+  // element is reported present
+  if (bloom->victim) {
+    bloom->full = 1;
+    return 0;
+  }
+
+  bloom->seed = bloom->seed * 0x5851f42d4c957f2dULL + 0x14057b7ef767814fULL;
+  bucket = bloom->seed >> 63 ? b2 : b1;
+  for (kick = 0; kick < CUCKOO_KICKS; kick++) {
+    size_t slot = bucket * CUCKOO_SLOTS;
+    uint64_t kicked;
+
+    bloom->seed = bloom->seed * 0x5851f42d4c957f2dULL
+                  + 0x14057b7ef767814fULL;
+    slot += (size_t)(bloom->seed >> 62);    // CUCKOO_SLOTS
+    kicked = cuckoo_get(bloom, slot);
+    cuckoo_set(bloom, slot, fp);
+    fp = kicked;
+
+    bucket = cuckoo_other(bloom, bucket, fp);
+    if ((i = cuckoo_find(bloom, bucket, 0)) >= 0) {
+      cuckoo_set(bloom, bucket * CUCKOO_SLOTS + i, fp);
+      return 0;
+    }
+  }
+
+  bloom->victim = fp;
+  bloom->victim_bucket = bucket;
+  return 0;
+}
+
+
+/*
+ * Checks and adds an element of a single filter, for scalable filters
+ * just the newest (or whichever one 'bloom' points to).
+ */
+static int filter_check_add(struct bloom * bloom,
+                            uint64_t h1, uint64_t h2, int add)
+{
+  int pow2 = bloom->flags & BLOOM_POW2;
+  int hits = 0;
+  int i;
+
+  if (bloom->flags & BLOOM_BLOCKED) {
+    return blocked_check_add(bloom, blocked_block(bloom, h1), h2, add);
+  }
+
+  if (bloom->flags & BLOOM_CUCKOO) {
+    uint64_t fp = cuckoo_fingerprint(bloom, h2);
+    size_t b1 = reduce(h1, bloom->blocks, pow2);
+    return cuckoo_check_add(bloom, fp, b1, cuckoo_other(bloom, b1, fp), add);
+  }
+
+#ifdef __ATOMIC_RELAXED
+  if (bloom->flags & BLOOM_CONCURRENT) {
+    for (i = 0; i < bloom->hashes; i++) {
+      uint64_t x = reduce(h1 + i*h2, bloom->bits, pow2);
+      if (test_bit_set_bit_atomic(bloom->bf, x, add)) {
+        hits++;
+      }
+    }
+
+    return count_added(bloom, hits == bloom->hashes, add);
+  }
+#endif
+
+  for (i = 0; i < bloom->hashes; i++) {
+    uint64_t x = reduce(h1 + i*h2, bloom->bits, pow2);
+    if (test_bit_set_bit(bloom->bf, x, add)) {
+      hits++;
+    }
+  }
+
+  // 1 == element already in (or collision)
+  return count_added(bloom, hits == bloom->hashes, add);
+}
+
+
+/*
+ * Adds a new filter to a scalable one, for twice the elements of the
+ * current one at half its collision probability. The struct itself always
+ * holds the newest filter, the previous ones get moved to the list behind
+ * 'older'.
+ */
+static int scalable_grow(struct bloom * bloom)
+{
+  struct bloom * older = (struct bloom *)malloc(sizeof(struct bloom));
+
+  if (older == NULL) {
+    return 1;
+  }
+
+  *older = *bloom;
+  if (bloom_init_flags(bloom, SCALABLE_GROWTH * older->entries,
+                       SCALABLE_TIGHTENING * older->error, older->flags)) {
+    *bloom = *older;
+    free(older);
+    return 1;
+  }
+
+  bloom->older = older;
+  return 0;
+}
+
+
+/*
+ * Checks and adds an element of a scalable filter. It is looked for in
+ * all the filters, newest first, and only gets added to the newest one.
+ * Once that holds as many elements as it was sized for, a new filter is
+ * added instead of letting the collision probability rise (or, for cuckoo
+ * filters, once it has a victim and the next insertion might fill it).
+ */
+static int scalable_check_add(struct bloom * bloom,
+                              uint64_t h1, uint64_t h2, int add)
+{
+  struct bloom * filter;
+
+  for (filter = bloom; filter != NULL; filter = filter->older) {
+    if (filter_check_add(filter, h1, h2, 0)) {
+      return 1;
+    }
+  }
+
+  if (!add) {
+    return 0;
+  }
+
+  // out of memory, keep going with the current filter (and retry)
+  if (bloom->added >= bloom->entries || bloom->victim) {
+    scalable_grow(bloom);
+  }
+
+  filter_check_add(bloom, h1, h2, 1);
+  return 0;
+}
+
+
+int bloom_check_add_prehashed(struct bloom * bloom,
+                              uint64_t h1, uint64_t h2, int add)
+{
+  if (bloom->ready == 0) {
+    printf("bloom at %p not initialized!\n", (void *)bloom);
+    return -1;
+  }
+
+  if (bloom->flags & BLOOM_SCALABLE) {
+    return scalable_check_add(bloom, h1, h2, add);
+  }
+
+  return filter_check_add(bloom, h1, h2, add);
+}
+
+
+/*
+ * Checks and adds an element of a regular filter whose bit positions have
+ * already been computed.
+ */
+static int regular_check_add(struct bloom * bloom,
+                             const uint64_t * pos, int add)
+{
+  int hits = 0;
+  int i;
+
+#ifdef __ATOMIC_RELAXED
+  if (bloom->flags & BLOOM_CONCURRENT) {
+    for (i = 0; i < bloom->hashes; i++) {
+      if (test_bit_set_bit_atomic(bloom->bf, pos[i], add)) {
+        hits++;
+      }
+    }
+    return count_added(bloom, hits == bloom->hashes, add);
+  }
+#endif
+
+  for (i = 0; i < bloom->hashes; i++) {
+    if (test_bit_set_bit(bloom->bf, pos[i], add)) {
+      hits++;
+    }
+  }
+  return count_added(bloom, hits == bloom->hashes, add);
+}
+
+
+/*
+ * bloom_check_add_batch() for a single filter.
+ */
+static void filter_check_add_batch(struct bloom * bloom,
+                                   const uint64_t * h1, const uint64_t * h2,
+                                   size_t n, int * results, int add)
+{
+  uint64_t * blocks[BATCH_ELEMENTS];
+  uint64_t pos[BATCH_POSITIONS];
+  uint64_t fps[BATCH_ELEMENTS];
+  size_t buckets[2 * BATCH_ELEMENTS];
+  int pow2 = bloom->flags & BLOOM_POW2;
+  size_t group;
+  size_t start;
+  size_t end;
+  size_t i;
+  int j;
+
+  // Work through groups of elements: first locate all their bits and
+  // start fetching the cache lines holding them, then test and set the
+  // bits in order. The cache misses of a group thus overlap instead of
+  // being waited for one after the other, and its lines are still cached
+  // when needed. (A read prefetch is enough also when adding, lines nobody
+  // else has cached arrive exclusive and get written without further ado.)
+  if (bloom->flags & BLOOM_BLOCKED) {
+    for (start = 0; start < n; start = end) {
+      end = start + BATCH_ELEMENTS < n ? start + BATCH_ELEMENTS : n;
+
+      for (i = start; i < end; i++) {
+        blocks[i - start] = blocked_block(bloom, h1[i]);
+        PREFETCH(blocks[i - start]);
+      }
+      for (i = start; i < end; i++) {
+        results[i] = blocked_check_add(bloom, blocks[i - start], h2[i], add);
+      }
+    }
+    return;
+  }
+
+  if (bloom->flags & BLOOM_CUCKOO) {
+    for (start = 0; start < n; start = end) {
+      end = start + BATCH_ELEMENTS < n ? start + BATCH_ELEMENTS : n;
+
+      for (i = start; i < end; i++) {
+        size_t * b = buckets + 2 * (i - start);
+        fps[i - start] = cuckoo_fingerprint(bloom, h2[i]);
+        b[0] = reduce(h1[i], bloom->blocks, pow2);
+        b[1] = cuckoo_other(bloom, b[0], fps[i - start]);
+        PREFETCH(cuckoo_bucket(bloom, b[0]));
+        PREFETCH(cuckoo_bucket(bloom, b[1]));
+      }
+      for (i = start; i < end; i++) {
+        size_t * b = buckets + 2 * (i - start);
+        results[i] = cuckoo_check_add(bloom, fps[i - start], b[0], b[1], add);
+      }
+    }
+    return;
+  }
+
+  // only happens for collision probabilities below 1e-77
+  if (bloom->hashes > BATCH_POSITIONS) {
+    for (i = 0; i < n; i++) {
+      results[i] = filter_check_add(bloom, h1[i], h2[i], add);
+    }
+    return;
+  }
+
+  // as many elements as their positions fit in pos
+  group = BATCH_POSITIONS / bloom->hashes;
+  if (group > BATCH_ELEMENTS) {
+    group = BATCH_ELEMENTS;
+  }
+
+  for (start = 0; start < n; start = end) {
+    end = start + group < n ? start + group : n;
+
+    for (i = start; i < end; i++) {
+      uint64_t * p = pos + (i - start) * bloom->hashes;
+      for (j = 0; j < bloom->hashes; j++) {
+        p[j] = reduce(h1[i] + j*h2[i], bloom->bits, pow2);
+        PREFETCH(bloom->bf + (p[j] >> 3));
+      }
+    }
+    for (i = start; i < end; i++) {
+      results[i] = regular_check_add(bloom,
+                                     pos + (i - start) * bloom->hashes, add);
+    }
+  }
+}
+
+
+int bloom_check_add_batch(struct bloom * bloom,
+                          const uint64_t * h1, const uint64_t * h2,
+                          size_t n, int * results, int add)
+{
+  size_t start;
+  size_t end;
+  size_t i;
+
+  if (bloom->ready == 0) {
+    printf("bloom at %p not initialized!\n", (void *)bloom);
+    return -1;
+  }
+
+  if (!(bloom->flags & BLOOM_SCALABLE)) {
+    filter_check_add_batch(bloom, h1, h2, n, results, add);
+    return 0;
+  }
+
+  // Elements already in the newest filter are found by a batched lookup,
+  // all others get handled one by one (still finding the newest filter's
+  // lines in the cache). An element found before the group's adds was
+  // there anyway, so the results are the same as without batching.
+  for (start = 0; start < n; start = end) {
+    end = start + BATCH_ELEMENTS < n ? start + BATCH_ELEMENTS : n;
+
+    filter_check_add_batch(bloom, h1 + start, h2 + start, end - start,
+                           results + start, 0);
+    for (i = start; i < end; i++) {
+      if (!results[i]) {
+        results[i] = scalable_check_add(bloom, h1[i], h2[i], add);
+      }
+    }
+  }
+
+  return 0;
+}
+
+
+static int bloom_check_add(struct bloom * bloom,
+                           const void * buffer, int len, int add)
+{
+  // murmurhash2 only gives 32 bits, two of them make up the 64 bit
+  // hash values needed to address large filters
+  uint32_t a = murmurhash2(buffer, len, 0x9747b28c);
+  uint32_t b = murmurhash2(buffer, len, a);
+
+  return bloom_check_add_prehashed(bloom, ((uint64_t)a << 32) | b,
+                                   ((uint64_t)b << 32) | a, add);
+}
+
+
+int bloom_init_size(struct bloom * bloom, int entries, double error,
+                    unsigned int cache_size)
+{
+  return bloom_init(bloom, entries, error);
+}
+
+
+/*
+ * Collision probability of a blocked filter holding 'per_block' elements
+ * per block on average. The number of elements landing in a block is
+ * Poisson distributed, within the block it's a regular bloom filter.
+ */
+static double blocked_error(double per_block, int hashes)
+{
+  double error = 0;
+  double end = per_block + 12 * sqrt(per_block) + 32;
+  double i;
+
+  for (i = 0; i <= end; i++) {
+    double p = exp(i * log(per_block) - per_block - lgamma(i + 1));
+    error += p * pow(1 - pow(1 - 1.0 / BLOCK_BITS, hashes * i), hashes);
+  }
 
-#define MAKESTRING(n) STRING(n)
-#define STRING(n) #n
+  return error;
+}
 
 
-inline static int test_bit_set_bit(unsigned char * buf,
-                                   unsigned int x, int set_bit)
+// rounds up to the next power of two
+static size_t round_pow2(size_t n)
 {
-  unsigned int byte = x >> 3;
-  unsigned char c = buf[byte];        // expensive memory access
-  unsigned int mask = 1 << (x % 8);
+  size_t p = 1;
 
-  if (c & mask) {
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+
+#ifdef MAP_ANONYMOUS
+// whether transparent huge pages have not been switched off altogether
+static int thp_enabled(void)
+{
+  char buf[64];
+  ssize_t n;
+  int fd = open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY);
+
+  if (fd == -1) {
     return 1;
-  } else {
-    if (set_bit) {
-      buf[byte] = c | mask;
+  }
+  n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return 1;
+  }
+  buf[n] = '\0';
+  return strstr(buf, "[never]") == NULL;
+}
+
+
+/*
+ * Spreads the pages of a fresh mapping round-robin over all NUMA nodes,
+ * so threads on any of them see the same average latency and the filter
+ * isn't limited to the memory of the node that happens to touch it first.
+ * Returns 1 if the policy was set, 0 on single node machines or when
+ * the kernel doesn't support it.
+ */
+static int interleave(void * p, size_t len)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  unsigned long nodes = 0;
+  char path[64];
+  int n;
+
+  for (n = 0; n < (int)(8 * sizeof(nodes)); n++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", n);
+    if (access(path, F_OK) == 0) {
+      nodes |= 1UL << n;
     }
+  }
+  if ((nodes & (nodes - 1)) == 0) {
     return 0;
   }
+
+  return syscall(SYS_mbind, p, len, BLOOM_MPOL_INTERLEAVE, &nodes,
+                 8 * sizeof(nodes) + 1, 0) == 0;
+#else
+  (void)p;
+  (void)len;
+  return 0;
+#endif
 }
 
 
-static int bloom_check_add(struct bloom * bloom,
-                           const void * buffer, int len, int add)
+/*
+ * Maps anonymous memory for the bit field. Pages are only backed (by
+ * zeroed memory) when first touched, so unlike calloc() and memset()
+ * nothing is cleared up front. With BLOOM_HUGEPAGES, pages from the
+ * hugetlbfs pool (/proc/sys/vm/nr_hugepages) are tried first, then
+ * transparent huge pages are asked for on a mapping aligned to them.
+ */
+static unsigned char * map_filter(struct bloom * bloom, int flags)
 {
-  if (bloom->ready == 0) {
-    printf("bloom at %p not initialized!\n", (void *)bloom);
-    return -1;
+  size_t len = (bloom->bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+  int prot = PROT_READ | PROT_WRITE;
+  int anon = MAP_PRIVATE | MAP_ANONYMOUS;
+  unsigned char * p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  if (flags & BLOOM_HUGEPAGES) {
+    p = (unsigned char *)mmap(NULL, len, prot, anon | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      bloom->memory = MEMORY_HUGETLB;
+    }
   }
+#endif
 
-  int hits = 0;
-  register unsigned int a = murmurhash2(buffer, len, 0x9747b28c);
-  register unsigned int b = murmurhash2(buffer, len, a);
-  register unsigned int x;
-  register unsigned int i;
+  if (p == MAP_FAILED) {
+    size_t head;
 
-  for (i = 0; i < bloom->hashes; i++) {
-    x = (a + i*b) % bloom->bits;
-    if (test_bit_set_bit(bloom->bf, x, add)) {
-      hits++;
+    // over-allocate by a huge page and trim to a huge page boundary
+    p = (unsigned char *)mmap(NULL, len + HUGE_PAGE, prot, anon, -1, 0);
+    if (p == MAP_FAILED) {
+      return NULL;
+    }
+    head = (HUGE_PAGE - (uintptr_t)p % HUGE_PAGE) % HUGE_PAGE;
+    if (head) {
+      munmap(p, head);
+    }
+    munmap(p + head + len, HUGE_PAGE - head);
+    p += head;
+
+    bloom->memory = MEMORY_MMAP;
+#ifdef MADV_HUGEPAGE
+    if ((flags & BLOOM_HUGEPAGES)
+        && madvise(p, len, MADV_HUGEPAGE) == 0 && thp_enabled()) {
+      bloom->memory = MEMORY_THP;
     }
+#endif
   }
 
-  if (hits == bloom->hashes) {
-    return 1;                // 1 == element already in (or collision)
+  if (flags & BLOOM_INTERLEAVE) {
+    bloom->numa = interleave(p, len);
   }
 
-  return 0;
+  bloom->mapped = len;
+  return p;
 }
+#endif
 
 
-int bloom_init_size(struct bloom * bloom, int entries, double error,
-                    unsigned int cache_size)
+// allocates the zeroed bit field of bloom->bytes
+static int alloc_filter(struct bloom * bloom, int flags)
 {
-  return bloom_init(bloom, entries, error);
+  void * bf;
+
+#ifdef MAP_ANONYMOUS
+  if (flags & (BLOOM_HUGEPAGES | BLOOM_INTERLEAVE)) {
+    bloom->bf = map_filter(bloom, flags);
+    return bloom->bf == NULL;
+  }
+#endif
+
+  bloom->memory = MEMORY_HEAP;
+  if (flags & BLOOM_BLOCKED) {
+    // blocks have to be aligned to cache lines
+    if (posix_memalign(&bf, BLOCK_BYTES, bloom->bytes)) {
+      return 1;
+    }
+    bloom->bf = (unsigned char *)memset(bf, 0, bloom->bytes);
+    return 0;
+  }
+
+  bloom->bf = (unsigned char *)calloc(bloom->bytes, sizeof(unsigned char));
+  return bloom->bf == NULL;
 }
 
 
-int bloom_init(struct bloom * bloom, size_t entries, double error)
+int bloom_init_flags(struct bloom * bloom, size_t entries, double error,
+                     int flags)
 {
   bloom->ready = 0;
+  bloom->flags = flags;
+  bloom->blocks = 0;
+  bloom->simd = 0;
+  bloom->memory = MEMORY_HEAP;
+  bloom->mapped = 0;
+  bloom->numa = 0;
+  bloom->added = 0;
+  bloom->older = NULL;
+  bloom->fingerprint = 0;
+  bloom->full = 0;
+  bloom->victim = 0;
+  bloom->victim_bucket = 0;
+  bloom->seed = 0x853c49e6748fea9bULL;
 
   if (entries < 1 || error == 0) {
     return 1;
   }
 
+#ifndef __ATOMIC_RELAXED
+  if (flags & BLOOM_CONCURRENT) {
+    return 1;
+  }
+#endif
+
+  // growing can't be done concurrently
+  if ((flags & BLOOM_SCALABLE) && (flags & BLOOM_CONCURRENT)) {
+    return 1;
+  }
+
+  // cuckoo filters move fingerprints about, which isn't done concurrently,
+  // and have buckets instead of blocks
+  if ((flags & BLOOM_CUCKOO) && (flags & (BLOOM_CONCURRENT | BLOOM_BLOCKED))) {
+    return 1;
+  }
+
   bloom->entries = entries;
   bloom->error = error;
 
@@ -100,16 +1033,83 @@ int bloom_init(struct bloom * bloom, size_t entries, double error)
   double dentries = (double)entries;
   bloom->bits = (size_t)(dentries * bloom->bpe);
 
+  bloom->hashes = (int)ceil(0.693147180559945 * bloom->bpe);  // ln(2)
+
+  if (flags & BLOOM_CUCKOO) {
+    // an element not added collides with any of the fingerprints in its
+    // two buckets, 2 * CUCKOO_SLOTS * CUCKOO_LOAD of them when filled up
+    bloom->fingerprint =
+      (int)ceil(log2(2 * CUCKOO_SLOTS * CUCKOO_LOAD / error));
+    if (bloom->fingerprint < 4) {
+      bloom->fingerprint = 4;
+    }
+    if (bloom->fingerprint > 56) {
+      return 1;
+    }
+
+    bloom->blocks = (size_t)ceil(dentries / (CUCKOO_SLOTS * CUCKOO_LOAD));
+    if (flags & BLOOM_POW2) {
+      bloom->blocks = round_pow2(bloom->blocks);
+    }
+
+    bloom->hashes = 2;
+    bloom->bits = bloom->blocks * CUCKOO_SLOTS * bloom->fingerprint;
+    bloom->bytes = (bloom->bits + 7) / 8 + 8;
+    bloom->bpe = (double)bloom->bits / dentries;
+
+    if (alloc_filter(bloom, flags)) {
+      return 1;
+    }
+
+    bloom->ready = 1;
+    return 0;
+  }
+
+  if (flags & BLOOM_BLOCKED) {
+    // start from the size of a regular filter, grow until the elements
+    // unevenly spread over the blocks stay within the collision probability
+    bloom->blocks = bloom->bits / BLOCK_BITS + 1;
+    while (blocked_error(dentries / bloom->blocks, bloom->hashes) > error) {
+      bloom->blocks += bloom->blocks / 32 + 1;
+    }
+
+    if (flags & BLOOM_POW2) {
+      bloom->blocks = round_pow2(bloom->blocks);
+    }
+
+    bloom->bits = bloom->blocks * BLOCK_BITS;
+    bloom->bytes = bloom->blocks * BLOCK_BYTES;
+    bloom->bpe = (double)bloom->bits / dentries;
+
+#ifdef BLOOM_AVX2
+    bloom->simd = __builtin_cpu_supports("avx2");
+#endif
+
+    if (alloc_filter(bloom, flags)) {
+      return 1;
+    }
+
+    bloom->ready = 1;
+    return 0;
+  }
+
+  if (flags & BLOOM_POW2) {
+    bloom->bits = round_pow2(bloom->bits < 8 ? 8 : bloom->bits);
+    bloom->bpe = (double)bloom->bits / dentries;
+  }
+
   if (bloom->bits % 8) {
     bloom->bytes = (bloom->bits / 8) + 1;
   } else {
     bloom->bytes = bloom->bits / 8;
   }
 
-  bloom->hashes = (int)ceil(0.693147180559945 * bloom->bpe);  // ln(2)
+  // concurrent filters are accessed by whole 64 bit words
+  if ((flags & BLOOM_CONCURRENT) && bloom->bytes % 8) {
+    bloom->bytes += 8 - bloom->bytes % 8;
+  }
 
-  bloom->bf = (unsigned char *)calloc(bloom->bytes, sizeof(unsigned char));
-  if (bloom->bf == NULL) {
+  if (alloc_filter(bloom, flags)) {
     return 1;
   }
 
@@ -118,6 +1118,18 @@ int bloom_init(struct bloom * bloom, size_t entries, double error)
 }
 
 
+int bloom_init_blocked(struct bloom * bloom, size_t entries, double error)
+{
+  return bloom_init_flags(bloom, entries, error, BLOOM_BLOCKED);
+}
+
+
+int bloom_init(struct bloom * bloom, size_t entries, double error)
+{
+  return bloom_init_flags(bloom, entries, error, 0);
+}
+
+
 int bloom_check(struct bloom * bloom, const void * buffer, size_t len)
 {
   return bloom_check_add(bloom, buffer, len, 0);
@@ -139,15 +1151,423 @@ void bloom_print(struct bloom * bloom)
   (void)printf(" ->bits per elem = %f\n", bloom->bpe);
   (void)printf(" ->bytes = %ld\n", bloom->bytes);
   (void)printf(" ->hash functions = %d\n", bloom->hashes);
+  if (bloom->flags & BLOOM_POW2) {
+    (void)printf(" ->power of two size\n");
+  }
+  if (bloom->flags & BLOOM_CONCURRENT) {
+    (void)printf(" ->concurrent\n");
+  }
+  if (bloom->flags & BLOOM_BLOCKED) {
+    (void)printf(" ->blocks = %ld (%s)\n", bloom->blocks,
+                 bloom->simd ? "avx2" : "portable");
+  }
+  if (bloom->flags & BLOOM_CUCKOO) {
+    (void)printf(" ->cuckoo, %ld buckets of %d %d bit fingerprints%s\n",
+                 bloom->blocks, CUCKOO_SLOTS, bloom->fingerprint,
+                 bloom->full ? ", full" : bloom->victim ? ", with victim" : "");
+  }
+  (void)printf(" ->memory = %s\n", bloom_memory(bloom));
+  if (bloom->flags & BLOOM_SCALABLE) {
+    size_t bytes;
+    int filters = bloom_filters(bloom, &bytes);
+    (void)printf(" ->scalable, %d filters of %ld bytes in total\n",
+                 filters, bytes);
+  }
+}
+
+
+int bloom_filters(struct bloom * bloom, size_t * bytes)
+{
+  struct bloom * filter;
+  int filters = 0;
+
+  if (bytes != NULL) {
+    *bytes = 0;
+  }
+  for (filter = bloom; filter != NULL; filter = filter->older) {
+    filters++;
+    if (bytes != NULL) {
+      *bytes += filter->bytes;
+    }
+  }
+  return filters;
+}
+
+
+const char * bloom_memory(struct bloom * bloom)
+{
+  static const char * names[] = {
+    "heap", "heap",
+    "4k pages", "4k pages, interleaved",
+    "transparent huge pages", "transparent huge pages, interleaved",
+    "huge pages", "huge pages, interleaved",
+    "mapped file", "mapped file",
+  };
+
+  return names[2 * bloom->memory + bloom->numa];
+}
+
+
+// frees the bit field of a single filter
+static void free_filter(struct bloom * bloom)
+{
+  if (bloom->memory == MEMORY_HEAP) {
+    free(bloom->bf);
+  } else {
+    munmap(bloom->bf, bloom->mapped);
+  }
 }
 
 
 void bloom_free(struct bloom * bloom)
 {
   if (bloom->ready) {
-    free(bloom->bf);
+    struct bloom * older = bloom->older;
+
+    free_filter(bloom);
+    while (older != NULL) {
+      struct bloom * next = older->older;
+      free_filter(older);
+      free(older);
+      older = next;
+    }
+  }
+  bloom->ready = 0;
+}
+
+
+// header of each filter in a saved file, laid out without padding
+struct file_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t hash_scheme;
+  uint32_t flags;
+  uint32_t hashes;
+  uint32_t filters;
+  uint64_t entries;
+  double error;
+  uint64_t bits;
+  uint64_t bytes;
+  uint64_t blocks;
+  uint64_t added;
+  double bpe;
+  uint32_t fingerprint;
+  uint32_t full;
+  uint64_t victim;
+  uint64_t victim_bucket;
+  uint64_t seed;
+};
+
+
+static size_t file_align(size_t n)
+{
+  return (n + FILE_ALIGN - 1) / FILE_ALIGN * FILE_ALIGN;
+}
+
+
+static int write_all(int fd, const void * buf, size_t len)
+{
+  const char * p = (const char *)buf;
+
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      return 1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+
+static int read_all(int fd, void * buf, size_t len, off_t offset)
+{
+  char * p = (char *)buf;
+
+  while (len > 0) {
+    ssize_t n = pread(fd, p, len, offset);
+    if (n <= 0) {
+      return 1;
+    }
+    p += n;
+    len -= (size_t)n;
+    offset += n;
+  }
+  return 0;
+}
+
+
+static int save_filters(struct bloom * bloom, int fd)
+{
+  static const char zeros[FILE_ALIGN];
+  char page[FILE_ALIGN];
+  struct file_header * header = (struct file_header *)page;
+  int filters = bloom_filters(bloom, NULL);
+  struct bloom * filter;
+
+  for (filter = bloom; filter != NULL; filter = filter->older) {
+    memset(page, 0, sizeof(page));
+    memcpy(header->magic, FILE_MAGIC, sizeof(header->magic));
+    header->version = FILE_VERSION;
+    header->byte_order = FILE_BYTE_ORDER;
+    header->hash_scheme = HASH_SCHEME;
+    header->flags = (uint32_t)(filter->flags & SAVED_FLAGS);
+    header->hashes = (uint32_t)filter->hashes;
+    header->filters = (uint32_t)filters;
+    header->entries = filter->entries;
+    header->error = filter->error;
+    header->bits = filter->bits;
+    header->bytes = filter->bytes;
+    header->blocks = filter->blocks;
+    header->added = filter->added;
+    header->bpe = filter->bpe;
+    header->fingerprint = (uint32_t)filter->fingerprint;
+    header->full = (uint32_t)filter->full;
+    header->victim = filter->victim;
+    header->victim_bucket = filter->victim_bucket;
+    header->seed = filter->seed;
+
+    if (write_all(fd, page, sizeof(page))
+        || write_all(fd, filter->bf, filter->bytes)
+        || write_all(fd, zeros, file_align(filter->bytes) - filter->bytes)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+int bloom_save(struct bloom * bloom, const char * filename)
+{
+  size_t len = strlen(filename) + 5;
+  char * tmp;
+  int fd;
+  int rv;
+
+  if (bloom->ready == 0) {
+    printf("bloom at %p not initialized!\n", (void *)bloom);
+    return -1;
+  }
+
+  // written next to the file and renamed over it when complete, so there
+  // is always a whole filter (and one loaded from the file with
+  // BLOOM_MMAP keeps its pages)
+  tmp = (char *)malloc(len);
+  if (tmp == NULL) {
+    return 1;
+  }
+  snprintf(tmp, len, "%s.tmp", filename);
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    free(tmp);
+    return 1;
+  }
+
+  rv = save_filters(bloom, fd);
+  if (close(fd)) {
+    rv = 1;
+  }
+  if (rv == 0 && rename(tmp, filename)) {
+    rv = 1;
+  }
+  if (rv) {
+    unlink(tmp);
+  }
+
+  free(tmp);
+  return rv;
+}
+
+
+/*
+ * Whether the sizes in a header go together the way bloom_init_flags()
+ * sets them up for its (saved) flags, so that no bit or bucket position
+ * can be outside of the bit field that gets read from the file.
+ */
+static int header_sizes_ok(const struct file_header * header, int flags)
+{
+  uint64_t bits = header->bits;
+  uint64_t blocks = header->blocks;
+  uint64_t bytes = (bits + 7) / 8;
+
+  if (flags & BLOOM_CUCKOO) {
+    uint64_t bucket_bits = CUCKOO_SLOTS * (uint64_t)header->fingerprint;
+    if ((flags & BLOOM_BLOCKED)
+        || header->fingerprint < 4 || header->fingerprint > 56
+        || header->hashes != 2
+        || blocks < 1 || bits / bucket_bits != blocks || bits % bucket_bits
+        || header->bytes != bytes + 8
+        || header->victim_bucket >= blocks) {
+      return 0;
+    }
+  } else if (flags & BLOOM_BLOCKED) {
+    if (blocks < 1 || bits / BLOCK_BITS != blocks || bits % BLOCK_BITS
+        || header->bytes != bytes) {
+      return 0;
+    }
+  } else {
+    // rounded up to whole 64 bit words if it was concurrent
+    if (bits < 1 || header->bytes < bytes
+        || header->bytes > (bytes + 7) / 8 * 8) {
+      return 0;
+    }
+    blocks = bits;
+  }
+
+  // positions get masked instead of reduced
+  if ((flags & BLOOM_POW2) && (blocks & (blocks - 1))) {
+    return 0;
+  }
+  return 1;
+}
+
+
+/*
+ * Loads the filter whose header is at 'offset' of the file into 'filter',
+ * returns the offset of the next one or 0 on errors (including headers
+ * that don't make sense).
+ */
+static off_t load_filter(struct bloom * filter, int fd, off_t offset,
+                         off_t size, int * filters, int flags)
+{
+  struct file_header header;
+  size_t mapped;
+
+  if (read_all(fd, &header, sizeof(header), offset)
+      || memcmp(header.magic, FILE_MAGIC, sizeof(header.magic))
+      || header.version < 1 || header.version > FILE_VERSION
+      || header.byte_order != FILE_BYTE_ORDER
+      || header.hash_scheme != HASH_SCHEME
+      || header.filters < 1
+      || (*filters && header.filters != (uint32_t)*filters)
+      || header.hashes < 1
+      || !header_sizes_ok(&header, (int)(header.flags & SAVED_FLAGS))) {
+    return 0;
+  }
+
+  mapped = file_align(header.bytes);
+  if ((uint64_t)(size - offset) < FILE_ALIGN + mapped) {
+    return 0;
+  }
+
+  *filters = (int)header.filters;
+  filter->entries = header.entries;
+  filter->error = header.error;
+  filter->bits = header.bits;
+  filter->bytes = header.bytes;
+  filter->hashes = (int)header.hashes;
+  filter->bpe = header.bpe;
+  filter->flags = (int)(header.flags & SAVED_FLAGS)
+                  | (flags & ~SAVED_FLAGS & ~BLOOM_MMAP);
+  filter->blocks = header.blocks;
+  filter->added = header.added;
+  filter->simd = 0;
+  filter->memory = MEMORY_HEAP;
+  filter->mapped = 0;
+  filter->numa = 0;
+  filter->older = NULL;
+  filter->fingerprint = (int)header.fingerprint;
+  filter->full = (int)header.full;
+  filter->victim = header.victim;
+  filter->victim_bucket = header.victim_bucket;
+  filter->seed = header.seed;
+
+#ifdef BLOOM_AVX2
+  if (filter->flags & BLOOM_BLOCKED) {
+    filter->simd = __builtin_cpu_supports("avx2");
+  }
+#endif
+
+  offset += FILE_ALIGN;
+
+  // pages of the bit field get read when first touched, and copied when
+  // first written to (the file itself stays as it is)
+  if ((flags & BLOOM_MMAP) && FILE_ALIGN % sysconf(_SC_PAGESIZE) == 0) {
+    void * p = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, offset);
+    if (p != MAP_FAILED) {
+      filter->bf = (unsigned char *)p;
+      filter->memory = MEMORY_FILE;
+      filter->mapped = mapped;
+      return offset + (off_t)mapped;
+    }
+  }
+
+  // as in bloom_init_flags()
+  if ((filter->flags & BLOOM_CONCURRENT) && filter->bytes % 8) {
+    filter->bytes += 8 - filter->bytes % 8;
+  }
+
+  if (alloc_filter(filter, filter->flags)) {
+    return 0;
+  }
+  if (read_all(fd, filter->bf, header.bytes, offset)) {
+    free_filter(filter);
+    return 0;
   }
+  return offset + (off_t)mapped;
+}
+
+
+int bloom_load(struct bloom * bloom, const char * filename, int flags)
+{
+  struct stat st;
+  struct bloom * newer = bloom;
+  off_t offset;
+  int filters = 0;
+  int n;
+  int fd;
+
   bloom->ready = 0;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return 1;
+  }
+  if (fstat(fd, &st)) {
+    close(fd);
+    return 1;
+  }
+
+  // newest filter first, each further one goes behind the previous
+  offset = load_filter(bloom, fd, 0, st.st_size, &filters, flags);
+  if (offset == 0) {
+    close(fd);
+    return 1;
+  }
+  bloom->ready = 1;
+
+  for (n = 1; n < filters; n++) {
+    struct bloom * filter = (struct bloom *)malloc(sizeof(struct bloom));
+    if (filter != NULL) {
+      offset = load_filter(filter, fd, offset, st.st_size, &filters, flags);
+    }
+    if (filter == NULL || offset == 0) {
+      free(filter);
+      bloom_free(bloom);
+      close(fd);
+      return 1;
+    }
+    newer->older = filter;
+    newer = filter;
+  }
+
+  // mappings stay valid without the descriptor
+  close(fd);
+
+  // as in bloom_init_flags()
+  if ((bloom->flags & (BLOOM_SCALABLE | BLOOM_CUCKOO))
+      && (bloom->flags & BLOOM_CONCURRENT)) {
+    bloom_free(bloom);
+    return 1;
+  }
+
+  return 0;
 }
 
 
@@ -8,6 +8,8 @@
 #ifndef LIBBLOOM_BLOOM_H_
 #define LIBBLOOM_BLOOM_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,6 +31,7 @@ struct bloom
   size_t bits;
   size_t bytes;
   int hashes;
+  size_t added;     // elements added (to the newest filter if scalable)
 
   // Fields below are private to the implementation. These may go away or
   // change incompatibly at any moment. Client code MUST NOT access or rely
@@ -36,9 +39,91 @@ struct bloom
   double bpe;
   unsigned char * bf;
   int ready;
+  int flags;
+  size_t blocks;
+  int simd;
+  int memory;
+  size_t mapped;
+  int numa;
+  struct bloom * older;
+  int fingerprint;
+  int full;
+  uint64_t victim;
+  size_t victim_bucket;
+  uint64_t seed;
 };
 
 
+/** ***************************************************************************
+ * Flags for bloom_init_flags(), may be or'ed together.
+ *
+ *     BLOOM_BLOCKED    - All bits of an element are in one 64 byte block,
+ *                        see bloom_init_blocked().
+ *     BLOOM_POW2       - Round the size of the filter (or its number of
+ *                        blocks) up to a power of two. Bit positions are
+ *                        then found by masking the hash values instead of
+ *                        a multiplication. Costs up to twice the memory and
+ *                        lowers the collision probability accordingly.
+ *     BLOOM_CONCURRENT - The filter may be checked and added to by several
+ *                        threads at once without any locking, bits being
+ *                        set with relaxed atomic operations on 64 bit words.
+ *                        No bits get lost, but another thread is only sure
+ *                        to see an element once it has synchronized with
+ *                        the one that added it (e.g. through a queue).
+ *                        Needs a compiler with the __atomic builtins (gcc,
+ *                        clang), initialization fails otherwise.
+ *                        bloom_init_flags() and bloom_free() must not run
+ *                        concurrently with anything else on the filter.
+ *     BLOOM_HUGEPAGES  - Map the filter with mmap() onto huge pages, so
+ *                        lookups in large filters miss the TLB far less.
+ *                        Pages reserved in /proc/sys/vm/nr_hugepages are
+ *                        used when there are enough, transparent huge
+ *                        pages otherwise. Also, as for BLOOM_INTERLEAVE,
+ *                        memory is only zeroed by the kernel as the filter
+ *                        gets touched, so initialization is instant.
+ *     BLOOM_INTERLEAVE - Map the filter with mmap() and interleave its
+ *                        pages over all NUMA nodes (Linux only, no effect
+ *                        on single node machines).
+ *     BLOOM_SCALABLE   - Grow instead of degrading once more than 'entries'
+ *                        elements get added: a new filter, for twice the
+ *                        elements of the previous one at half its collision
+ *                        probability, takes all further elements. Checks
+ *                        look through all filters, newest first. However
+ *                        many elements get added, the collision probability
+ *                        stays below about twice 'error'. The fields of
+ *                        the struct describe the newest filter, see also
+ *                        bloom_filters(). Not with BLOOM_CONCURRENT.
+ *     BLOOM_MMAP       - Only for bloom_load(), see there.
+ *     BLOOM_CUCKOO     - A cuckoo filter instead of a bloom filter: each
+ *                        element is a small fingerprint in one of two
+ *                        buckets of four, so a check reads two cache lines
+ *                        (at most four if a bucket straddles lines) however
+ *                        low the collision probability. Below an 'error' of
+ *                        about 0.3% it takes less memory than a regular
+ *                        filter. The fingerprints are sized for 'entries'
+ *                        elements at 95% of the slots; once an element can't
+ *                        be placed even by moving others about, the filter
+ *                        is full and from then on reports every element as
+ *                        present (so none gets lost). With BLOOM_SCALABLE a
+ *                        new filter is added instead. Fields 'bits' and
+ *                        'bytes' are those of the fingerprints, 'hashes' is
+ *                        2. Not with BLOOM_BLOCKED or BLOOM_CONCURRENT.
+ *
+ *     Whether the memory asked for was obtained is told by bloom_memory().
+ *     Filters fall back to smaller pages and to the default NUMA policy
+ *     rather than failing to initialize.
+ *
+ */
+#define BLOOM_BLOCKED    1
+#define BLOOM_POW2       2
+#define BLOOM_CONCURRENT 4
+#define BLOOM_HUGEPAGES  8
+#define BLOOM_INTERLEAVE 16
+#define BLOOM_SCALABLE   32
+#define BLOOM_MMAP       64
+#define BLOOM_CUCKOO     128
+
+
 /** ***************************************************************************
  * Initialize the bloom filter for use.
  *
@@ -68,6 +153,44 @@ struct bloom
 int bloom_init(struct bloom * bloom, size_t entries, double error);
 
 
+/** ***************************************************************************
+ * Initialize a bloom filter for use, with the given BLOOM_* flags (see
+ * above). bloom_init() is the same as passing no flags.
+ *
+ * Filters may be larger than 2^32 bits (512 MB), bit positions are always
+ * computed with 64 bit arithmetic.
+ *
+ * Return:
+ * -------
+ *     0 - on success
+ *     1 - on failure
+ *
+ */
+int bloom_init_flags(struct bloom * bloom, size_t entries, double error,
+                     int flags);
+
+
+/** ***************************************************************************
+ * Initialize a blocked bloom filter for use.
+ *
+ * Same as bloom_init(), except that all the bits of an element are placed
+ * within a single 64 byte block (one cache line) of the filter. Checking
+ * or adding an element thus costs at most one cache miss, regardless of
+ * the number of hash functions, and on CPUs supporting AVX2 all of its
+ * bits get tested and set at once.
+ *
+ * For the same number of bits, a blocked filter has a somewhat higher
+ * collision probability than a regular one. To still stay within 'error',
+ * the filter is made larger than bloom_init() would make it (typically by
+ * 10-30%).
+ *
+ * Parameters and return values are the same as for bloom_init(). All
+ * other functions work on a blocked filter as on a regular one.
+ *
+ */
+int bloom_init_blocked(struct bloom * bloom, size_t entries, double error);
+
+
 /** ***************************************************************************
  * Deprecated, use bloom_init()
  *
@@ -117,6 +240,71 @@ int bloom_check(struct bloom * bloom, const void * buffer, size_t len);
 int bloom_add(struct bloom * bloom, const void * buffer, size_t len);
 
 
+/** ***************************************************************************
+ * Check (and optionally add) an element whose hash values the caller has
+ * already computed.
+ *
+ * bloom_check() and bloom_add() hash the element twice with murmurhash2.
+ * When the elements are themselves uniformly distributed (e.g. digests of
+ * a cryptographic hash function) that's wasted work, the caller can as
+ * well derive the two hash values from the element directly and pass them
+ * in. The bits of the element are at (h1 + i*h2) % bits for a regular
+ * filter, for a blocked filter h1 picks the block and h2 the bits in it.
+ *
+ * An element has to be passed with the same h1 and h2 each time, and a
+ * filter should either be used only with this function or only with
+ * bloom_check() and bloom_add().
+ *
+ * Parameters:
+ * -----------
+ *     bloom  - Pointer to an allocated struct bloom (see above).
+ *     h1     - First hash value of the element.
+ *     h2     - Second hash value of the element.
+ *     add    - If non-zero, add the element to the filter.
+ *
+ * Return:
+ * -------
+ *     0 - element was not present (and was added, if so requested)
+ *     1 - element (or a collision) had already been added previously
+ *    -1 - bloom not initialized
+ *
+ */
+int bloom_check_add_prehashed(struct bloom * bloom,
+                              uint64_t h1, uint64_t h2, int add);
+
+
+/** ***************************************************************************
+ * Check (and optionally add) a batch of elements whose hash values the
+ * caller has already computed, see bloom_check_add_prehashed().
+ *
+ * The cache lines of a group of elements are prefetched before any of
+ * them gets tested, so their cache misses overlap instead of being waited
+ * for one after the other. For filters larger than the last level cache
+ * this is much faster than checking the elements one by one. The results
+ * are the same as those of calling bloom_check_add_prehashed() for each
+ * element in turn, also when an element occurs more than once.
+ *
+ * Parameters:
+ * -----------
+ *     bloom   - Pointer to an allocated struct bloom (see above).
+ *     h1      - First hash values of the elements.
+ *     h2      - Second hash values of the elements.
+ *     n       - Number of elements.
+ *     results - Receives the result for each element: 1 if it (or a
+ *               collision) had already been added, 0 if not.
+ *     add     - If non-zero, add the elements to the filter.
+ *
+ * Return:
+ * -------
+ *     0 - on success
+ *    -1 - bloom not initialized
+ *
+ */
+int bloom_check_add_batch(struct bloom * bloom,
+                          const uint64_t * h1, const uint64_t * h2,
+                          size_t n, int * results, int add);
+
+
 /** ***************************************************************************
  * Print (to stdout) info about this bloom filter. Debugging aid.
  *
@@ -124,6 +312,87 @@ int bloom_add(struct bloom * bloom, const void * buffer, size_t len);
 void bloom_print(struct bloom * bloom);
 
 
+/** ***************************************************************************
+ * Describes the memory holding the bit field of an initialized filter:
+ * "heap", "4k pages", "transparent huge pages" or "huge pages" (from the
+ * hugetlbfs pool), followed by ", interleaved" if its pages are spread
+ * over the NUMA nodes, or "mapped file" (see bloom_load()).
+ *
+ * Return: static string, not to be freed
+ *
+ */
+const char * bloom_memory(struct bloom * bloom);
+
+
+/** ***************************************************************************
+ * Counts the filters a BLOOM_SCALABLE filter has grown to (1 for all other
+ * filters).
+ *
+ * Parameters:
+ * -----------
+ *     bloom  - Pointer to an allocated struct bloom (see above).
+ *     bytes  - If not NULL, receives the total size of the filters.
+ *
+ * Return: number of filters
+ *
+ */
+int bloom_filters(struct bloom * bloom, size_t * bytes);
+
+
+/** ***************************************************************************
+ * Save the filter to a file, to be loaded again by bloom_load().
+ *
+ * Besides the bit field, the file holds the filter's parameters, the
+ * number of elements added so far and a version of the way bit positions
+ * are derived from the hash values, so a filter can only be loaded by a
+ * libbloom that will find the same elements in it. The file is written
+ * in the machine's byte order and replaced only once completely written.
+ *
+ * Must not run concurrently with adds to the filter.
+ *
+ * Parameters:
+ * -----------
+ *     bloom    - Pointer to an allocated struct bloom (see above).
+ *     filename - Where to save the filter.
+ *
+ * Return:
+ * -------
+ *     0 - on success
+ *     1 - on failure (see errno)
+ *    -1 - bloom not initialized
+ *
+ */
+int bloom_save(struct bloom * bloom, const char * filename);
+
+
+/** ***************************************************************************
+ * Initialize a bloom filter from a file written by bloom_save(), instead
+ * of through bloom_init_flags().
+ *
+ * The BLOOM_BLOCKED, BLOOM_POW2, BLOOM_SCALABLE and BLOOM_CUCKOO flags
+ * come from the file. Of the others, BLOOM_CONCURRENT, BLOOM_HUGEPAGES and
+ * BLOOM_INTERLEAVE apply as for bloom_init_flags(), and with BLOOM_MMAP
+ * the bit field is mapped from the file instead of being read: the filter
+ * can be used right away, however large, and pages get read as they are
+ * first touched. Changes to a mapped filter are private, the file is only
+ * changed by bloom_save().
+ *
+ * Parameters:
+ * -----------
+ *     bloom    - Pointer to an allocated struct bloom (see above).
+ *     filename - File to load the filter from.
+ *     flags    - BLOOM_* flags, see above.
+ *
+ * Return:
+ * -------
+ *     0 - on success
+ *     1 - on failure (including files not written by bloom_save() of a
+ *         compatible libbloom)
+ *
+ */
+int bloom_load(struct bloom * bloom, const char * filename, int flags);
+
+
 /** ***************************************************************************
  * Deallocate internal storage.
  *
@@ -5,8 +5,12 @@
  *  This file is under BSD license. See LICENSE file.
  */
 
+#define _DEFAULT_SOURCE
+
 #include <assert.h>
 #include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +25,9 @@
 #ifdef __linux
 #include <sys/time.h>
 #include <time.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #endif
 
 
@@ -58,21 +65,62 @@ static int basic()
 }
 
 
+/** ***************************************************************************
+ * Same for a blocked filter.
+ *
+ */
+static int basic_blocked()
+{
+  printf("----- basic_blocked -----\n");
+
+  struct bloom bloom;
+
+  assert(bloom_init_blocked(&bloom, 0, 1.0) == 1);
+  assert(bloom_init_blocked(&bloom, 10, 0) == 1);
+  assert(bloom.ready == 0);
+  assert(bloom_add(&bloom, "hello world", 11) == -1);
+  bloom_free(&bloom);
+
+  assert(bloom_init_blocked(&bloom, 102, 0.1) == 0);
+  assert(bloom.ready == 1);
+  assert(bloom.bytes % 64 == 0);
+  assert(((uintptr_t)bloom.bf % 64) == 0);
+  bloom_print(&bloom);
+
+  assert(bloom_check(&bloom, "hello world", 11) == 0);
+  assert(bloom_add(&bloom, "hello world", 11) == 0);
+  assert(bloom_check(&bloom, "hello world", 11) == 1);
+  assert(bloom_add(&bloom, "hello world", 11) > 0);
+  assert(bloom_add(&bloom, "hello", 5) == 0);
+  assert(bloom_add(&bloom, "hello", 5) > 0);
+  assert(bloom_check(&bloom, "hello", 5) == 1);
+  bloom_free(&bloom);
+
+  return 0;
+}
+
+
 /** ***************************************************************************
  * Create a bloom filter with given parameters and add 'count' random elements
  * into it to see if collission rates are within expectations.
  *
  */
 static int add_random(int entries, double error, int count,
-                      int quiet, int check_error, uint8_t elem_size, int validate)
+                      int quiet, int check_error, uint8_t elem_size, int validate,
+                      int blocked)
 {
   if (!quiet) {
-    printf("----- add_random(%d, %f, %d, %d, %d, %d, %d) -----\n",
-           entries, error, count, quiet, check_error, elem_size, validate);
+    printf("----- add_random(%d, %f, %d, %d, %d, %d, %d, %d) -----\n",
+           entries, error, count, quiet, check_error, elem_size, validate,
+           blocked);
   }
 
   struct bloom bloom;
-  assert(bloom_init(&bloom, entries, error) == 0);
+  if (blocked) {
+    assert(bloom_init_blocked(&bloom, entries, error) == 0);
+  } else {
+    assert(bloom_init(&bloom, entries, error) == 0);
+  }
   if (!quiet) { bloom_print(&bloom); }
 
   char block[elem_size];
@@ -136,146 +184,1389 @@ static int add_random(int entries, double error, int count,
 
 
 /** ***************************************************************************
- * Simple loop to compare performance.
+ * Uniformly distributed 64 bit values (xorshift64*), as hash values for the
+ * prehashed interface.
  *
  */
-static int perf_loop(int entries, int count)
+static uint64_t next_random(uint64_t * x)
 {
-  printf("----- perf_loop -----\n");
+  *x ^= *x >> 12;
+  *x ^= *x << 25;
+  *x ^= *x >> 27;
+  return *x * 0x2545f4914f6cdd1dULL;
+}
+
+
+/** ***************************************************************************
+ * Add 'count' elements with random hash values through the prehashed
+ * interface and check the collision rate and that all of them are found.
+ *
+ */
+static int add_prehashed(int entries, double error, int count, int flags)
+{
+  printf("----- add_prehashed(%d, %f, %d, %d) -----\n",
+         entries, error, count, flags);
 
   struct bloom bloom;
-  assert(bloom_init(&bloom, entries, 0.001) == 0);
-  bloom_print(&bloom);
+  assert(bloom_init_flags(&bloom, entries, error, flags) == 0);
+  printf("memory: %s\n", bloom_memory(&bloom));
 
-  int i;
+  uint64_t * saved = (uint64_t *)malloc(2 * count * sizeof(uint64_t));
+  uint64_t x = 0x0123456789abcdefULL;
   int collisions = 0;
+  int n;
 
-  struct timeval tp;
-  gettimeofday(&tp, NULL);
-  long before = (tp.tv_sec * 1000L) + (tp.tv_usec / 1000L);
+  if (!saved) {
+    printf("error: unable to allocate buffer for validation\n");
+    exit(1);
+  }
 
-  for (i = 0; i < count; i++) {
-    if (bloom_add(&bloom, (void *)&i, sizeof(int))) { collisions++; }
+  for (n = 0; n < 2 * count; n++) {
+    saved[n] = next_random(&x);
   }
 
-  gettimeofday(&tp, NULL);
-  long after = (tp.tv_sec * 1000L) + (tp.tv_usec / 1000L);
+  for (n = 0; n < count; n++) {
+    assert(bloom_check_add_prehashed(&bloom, saved[2*n], saved[2*n+1], 0) >= 0);
+    if (bloom_check_add_prehashed(&bloom, saved[2*n], saved[2*n+1], 1)) {
+      collisions++;
+    }
+  }
 
-  printf("Added %d elements of size %d, took %d ms (collisions=%d)\n",
-         count, (int)sizeof(int), (int)(after - before), collisions);
+  double er = (double)collisions / (double)count;
+  printf("entries: %d, error: %f, count: %d, coll: %d, error: %f\n",
+         entries, error, count, collisions, er);
 
-  printf("%d,%d,%ld\n", entries, bloom.bytes, after - before);
+  if (er > error) {
+    printf("error: expected error %f but observed %f\n", error, er);
+    exit(1);
+  }
 
-  bloom_print(&bloom);
-  bloom_free(&bloom);
+  for (n = 0; n < count; n++) {
+    if (bloom_check_add_prehashed(&bloom, saved[2*n], saved[2*n+1], 0) != 1) {
+      printf("error: data saved in filter is not there!\n");
+      exit(1);
+    }
+  }
 
+  bloom_free(&bloom);
+  assert(bloom_check_add_prehashed(&bloom, 1, 2, 1) == -1);
+  free(saved);
   return 0;
 }
 
 
 /** ***************************************************************************
- * Default set of basic tests.
- *
- * These should run reasonably quick so they can be run all the time.
+ * Check that adding elements in batches gives the same results, and the
+ * same filter, as adding them one by one. Some elements are repeated, also
+ * within a batch.
  *
  */
-static int basic_tests()
+static int add_batch(int entries, double error, int count, int flags)
 {
-  int rv = 0;
+  printf("----- add_batch(%d, %f, %d, %d) -----\n",
+         entries, error, count, flags);
 
-  rv += basic();
-  rv += add_random(10, 0.1, 10, 0, 1, 32, 1);
-  rv += add_random(10000, 0.1, 10000, 0, 1, 32, 1);
-  rv += add_random(10000, 0.01, 10000, 0, 1, 32, 1);
-  rv += add_random(10000, 0.001, 10000, 0, 1, 32, 1);
-  rv += add_random(10000, 0.0001, 10000, 0, 1, 32, 1);
-  rv += add_random(1000000, 0.0001, 1000000, 0, 1, 32, 1);
+  struct bloom single;
+  struct bloom batched;
+  assert(bloom_init_flags(&single, entries, error, flags) == 0);
+  assert(bloom_init_flags(&batched, entries, error, flags) == 0);
 
-  printf("\nBrought to you by libbloom-%s\n", bloom_version());
+  uint64_t * h1 = (uint64_t *)malloc(count * sizeof(uint64_t));
+  uint64_t * h2 = (uint64_t *)malloc(count * sizeof(uint64_t));
+  int * results = (int *)malloc(count * sizeof(int));
+  uint64_t x = 0xfedcba9876543210ULL;
+  int collisions = 0;
+  int n;
+  int b;
+
+  if (!h1 || !h2 || !results) {
+    printf("error: unable to allocate buffers for validation\n");
+    exit(1);
+  }
+
+  for (n = 0; n < count; n++) {
+    if (n % 7 == 6) {
+      int k = n - 1 - (int)(next_random(&x) % (n < 50 ? n : 50));
+      h1[n] = h1[k];
+      h2[n] = h2[k];
+    } else {
+      h1[n] = next_random(&x);
+      h2[n] = next_random(&x);
+    }
+  }
+
+  // batches of varying size, from a single element to a few groups
+  for (n = 0; n < count; n += b) {
+    b = 1 + (int)(next_random(&x) % 100);
+    if (b > count - n) {
+      b = count - n;
+    }
+    assert(bloom_check_add_batch(&batched, h1 + n, h2 + n, b,
+                                 results + n, 1) == 0);
+  }
+
+  for (n = 0; n < count; n++) {
+    int r = bloom_check_add_prehashed(&single, h1[n], h2[n], 1);
+    if (r != results[n]) {
+      printf("error: element %d batched %d, single %d\n", n, results[n], r);
+      exit(1);
+    }
+    collisions += r;
+  }
+
+  if (memcmp(single.bf, batched.bf, single.bytes)) {
+    printf("error: batched filter differs\n");
+    exit(1);
+  }
+
+  assert(bloom_check_add_batch(&batched, h1, h2, count, results, 0) == 0);
+  for (n = 0; n < count; n++) {
+    if (results[n] != 1) {
+      printf("error: data saved in filter is not there!\n");
+      exit(1);
+    }
+  }
+
+  printf("count: %d, already added (repeated or collisions): %d\n",
+         count, collisions);
 
+  free(h1);
+  free(h2);
+  free(results);
+  bloom_free(&single);
+  bloom_free(&batched);
   return 0;
 }
 
 
 /** ***************************************************************************
- * Some longer-running tests.
+ * Add 'count' elements, many more than 'entries', to a scalable filter and
+ * check that it grew and that the collision probability of elements not
+ * added stays at about twice 'error' at most.
  *
  */
-static int larger_tests()
+static int scalable(int entries, double error, int count, int flags)
 {
-  int rv = 0;
-  int e;
+  printf("----- scalable(%d, %f, %d, %d) -----\n",
+         entries, error, count, flags);
 
-  printf("\nAdd 10M elements and verify (0.00001)\n");
-  rv += add_random(10000000, 0.00001, 10000000, 0, 1, 32, 1);
+  struct bloom bloom;
+  assert(bloom_init_flags(&bloom, entries, error,
+                          flags | BLOOM_SCALABLE) == 0);
 
-  printf("\nChecking collision rates with filters from 100K to 1M (0.001)\n");
-  for (e = 100000; e <= 1000000; e+= 100) {
-    rv += add_random(e, 0.001, e, 1, 1, 8, 1);
+  uint64_t x = 0x0f1e2d3c4b5a6978ULL;
+  uint64_t y;
+  size_t bytes;
+  int collisions = 0;
+  int filters;
+  int n;
+
+  for (n = 0; n < count; n++) {
+    uint64_t h1 = next_random(&x);
+    assert(bloom_check_add_prehashed(&bloom, h1, next_random(&x), 1) >= 0);
   }
 
-  return rv;
+  // all of them still there
+  y = 0x0f1e2d3c4b5a6978ULL;
+  for (n = 0; n < count; n++) {
+    uint64_t h1 = next_random(&y);
+    if (bloom_check_add_prehashed(&bloom, h1, next_random(&y), 0) != 1) {
+      printf("error: data saved in filter is not there!\n");
+      exit(1);
+    }
+  }
+
+  // and as many others, never added
+  for (n = 0; n < count; n++) {
+    uint64_t h1 = next_random(&x);
+    if (bloom_check_add_prehashed(&bloom, h1, next_random(&x), 0)) {
+      collisions++;
+    }
+  }
+
+  filters = bloom_filters(&bloom, &bytes);
+  double er = (double)collisions / (double)count;
+  printf("filters: %d, bytes: %ld, coll: %d, error: %f\n",
+         filters, bytes, collisions, er);
+
+  if (filters < 2) {
+    printf("error: filter did not grow\n");
+    exit(1);
+  }
+
+  // filled up, the filters' collision probabilities add up to almost
+  // twice 'error', allow for chance and rounding of the number of hashes
+  if (er > 2.2 * error) {
+    printf("error: expected error below %f but observed %f\n",
+           2.2 * error, er);
+    exit(1);
+  }
+
+  bloom_free(&bloom);
+  return 0;
 }
 
 
 /** ***************************************************************************
- * With no options, runs brief default tests.
- *
- * With -L, runs some longer-running tests.
+ * Add twice as many elements as a cuckoo filter is sized for. It fills up,
+ * but must still find every element added.
  *
- * To test collisions over a range of sizes: -G START END INCREMENT ERROR
- * This produces output that can be graphed with collisions/dograph
- * See also collision_test make target.
+ */
+static int cuckoo_full(int entries, int flags)
+{
+  printf("----- cuckoo_full(%d, %d) -----\n", entries, flags);
+
+  struct bloom bloom;
+  assert(bloom_init_flags(&bloom, entries, 0.01, flags | BLOOM_CUCKOO) == 0);
+
+  uint64_t x = 0x5a5a5a5a12345678ULL;
+  uint64_t y;
+  int n;
+
+  for (n = 0; n < 2 * entries; n++) {
+    uint64_t h1 = next_random(&x);
+    assert(bloom_check_add_prehashed(&bloom, h1, next_random(&x), 1) >= 0);
+  }
+  bloom_print(&bloom);
+  assert(bloom.full);
+
+  y = 0x5a5a5a5a12345678ULL;
+  for (n = 0; n < 2 * entries; n++) {
+    uint64_t h1 = next_random(&y);
+    if (bloom_check_add_prehashed(&bloom, h1, next_random(&y), 0) != 1) {
+      printf("error: data saved in filter is not there!\n");
+      exit(1);
+    }
+  }
+
+  bloom_free(&bloom);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Save a filter, load it back (read or mapped, as given by 'load_flags')
+ * and check that it is the same filter. Changes to the loaded filter must
+ * not show up in the file until it is saved again.
  *
- * To test collisions, run with options: -c ENTRIES ERROR COUNT
- * Where 'ENTRIES' is the expected number of entries used to initialize the
- * bloom filter and 'ERROR' is the acceptable probability of collision
- * used to initialize the bloom filter. 'COUNT' is the actual number of
- * entries inserted.
+ */
+static int save_load(int entries, int count, int flags, int load_flags)
+{
+  printf("----- save_load(%d, %d, %d, %d) -----\n",
+         entries, count, flags, load_flags);
+
+  const char * filename = "/tmp/libbloom-test.bloom";
+  struct bloom bloom;
+  struct bloom loaded;
+  struct bloom * a;
+  struct bloom * b;
+  uint64_t x = 0x1122334455667788ULL;
+  uint64_t y;
+  int n;
+
+  assert(bloom_init_flags(&bloom, entries, 0.001, flags) == 0);
+  for (n = 0; n < count; n++) {
+    uint64_t h1 = next_random(&x);
+    bloom_check_add_prehashed(&bloom, h1, next_random(&x), 1);
+  }
+
+  assert(bloom_save(&bloom, filename) == 0);
+  assert(bloom_load(&loaded, filename, load_flags) == 0);
+  printf("filters: %d, added: %ld, memory: %s\n",
+         bloom_filters(&loaded, NULL), loaded.added, bloom_memory(&loaded));
+
+  for (a = &bloom, b = &loaded; a != NULL; a = a->older, b = b->older) {
+    assert(b != NULL);
+    assert(a->entries == b->entries && a->error == b->error);
+    assert(a->bits == b->bits && a->hashes == b->hashes);
+    assert(a->blocks == b->blocks && a->added == b->added);
+    assert(memcmp(a->bf, b->bf, a->bytes) == 0);
+  }
+  assert(b == NULL);
+
+  y = 0x1122334455667788ULL;
+  for (n = 0; n < count; n++) {
+    uint64_t h1 = next_random(&y);
+    if (bloom_check_add_prehashed(&loaded, h1, next_random(&y), 0) != 1) {
+      printf("error: data saved in filter is not there!\n");
+      exit(1);
+    }
+  }
+
+  // add more to both, the file must stay as it was
+  size_t added = bloom.added;
+  for (n = 0; n < count; n++) {
+    uint64_t h1 = next_random(&x);
+    uint64_t h2 = next_random(&x);
+    assert(bloom_check_add_prehashed(&bloom, h1, h2, 1) ==
+           bloom_check_add_prehashed(&loaded, h1, h2, 1));
+  }
+  assert(bloom.added == loaded.added);
+
+  struct bloom saved;
+  assert(bloom_load(&saved, filename, 0) == 0);
+  assert(saved.added == added || (flags & BLOOM_SCALABLE));
+  assert(bloom_filters(&saved, NULL) < bloom_filters(&bloom, NULL) ||
+         saved.added < bloom.added);
+  bloom_free(&saved);
+
+  // then save the loaded one over its own file
+  assert(bloom_save(&loaded, filename) == 0);
+  bloom_free(&loaded);
+
+  assert(bloom_load(&loaded, filename, load_flags) == 0);
+  for (a = &bloom, b = &loaded; a != NULL; a = a->older, b = b->older) {
+    assert(b != NULL);
+    assert(a->added == b->added);
+    assert(memcmp(a->bf, b->bf, a->bytes) == 0);
+  }
+  assert(b == NULL);
+  bloom_free(&loaded);
+
+  // anything else doesn't load
+  FILE * f = fopen(filename, "r+");
+  assert(f != NULL);
+  fputs("libbloop", f);
+  fclose(f);
+  assert(bloom_load(&loaded, filename, load_flags) == 1);
+  assert(bloom_load(&loaded, "/nonexistent/libbloom.bloom", load_flags) == 1);
+
+  unlink(filename);
+  bloom_free(&bloom);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Save a filter, then overwrite one field of its header at a time (at its
+ * offset in the file format) and check that sizes which don't go together
+ * are refused, and flags that are up to the loader are ignored.
  *
- * To test performance only, run with options:  -p ENTRIES COUNT
- * Where 'ENTRIES' is the expected number of entries used to initialize the
- * bloom filter and 'COUNT' is the actual number of entries inserted.
+ */
+static void patch_header(const char * filename, long offset, uint64_t value,
+                         size_t size)
+{
+  FILE * f = fopen(filename, "r+");
+  assert(f != NULL);
+  assert(fseek(f, offset, SEEK_SET) == 0);
+  assert(fwrite(&value, size, 1, f) == 1);
+  fclose(f);
+}
+
+
+static int load_corrupt(int flags)
+{
+  printf("----- load_corrupt(%d) -----\n", flags);
+
+  const char * filename = "/tmp/libbloom-test.bloom";
+  struct bloom bloom;
+  struct bloom loaded;
+
+  // flags, bits, bytes, blocks and fingerprint of the header
+  const long flags_at = 20, bits_at = 48, bytes_at = 56, blocks_at = 64;
+  const long fingerprint_at = 88;
+
+  assert(bloom_init_flags(&bloom, 10000, 0.001, flags) == 0);
+
+  // loader flags in the file
+  assert(bloom_save(&bloom, filename) == 0);
+  patch_header(filename, flags_at,
+               (uint64_t)(flags | BLOOM_CONCURRENT | BLOOM_HUGEPAGES), 4);
+  assert(bloom_load(&loaded, filename, 0) == 0);
+  assert(loaded.flags == flags);
+  bloom_free(&loaded);
+
+  // a bit field larger than the one saved
+  assert(bloom_save(&bloom, filename) == 0);
+  patch_header(filename, bits_at, bloom.bits + 4096 * 8, 8);
+  assert(bloom_load(&loaded, filename, 0) == 1);
+
+  // sizes that don't match
+  assert(bloom_save(&bloom, filename) == 0);
+  patch_header(filename, bytes_at, bloom.bytes - 1, 8);
+  assert(bloom_load(&loaded, filename, 0) == 1);
+
+  // (regular filters have no blocks, only cuckoo filters fingerprints)
+  if (flags & (BLOOM_BLOCKED | BLOOM_CUCKOO)) {
+    assert(bloom_save(&bloom, filename) == 0);
+    patch_header(filename, blocks_at, bloom.blocks + 1, 8);
+    assert(bloom_load(&loaded, filename, 0) == 1);
+  }
+
+  if (flags & BLOOM_CUCKOO) {
+    assert(bloom_save(&bloom, filename) == 0);
+    patch_header(filename, fingerprint_at, (uint64_t)bloom.fingerprint + 1, 4);
+    assert(bloom_load(&loaded, filename, 0) == 1);
+  }
+
+  // another kind of filter with the same sizes
+  assert(bloom_save(&bloom, filename) == 0);
+  patch_header(filename, flags_at,
+               (uint64_t)(flags ^ (BLOOM_BLOCKED | BLOOM_CUCKOO)), 4);
+  assert(bloom_load(&loaded, filename, 0) == 1);
+
+  unlink(filename);
+  bloom_free(&bloom);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Check that elements of a filter larger than 2^32 bits get spread over all
+ * of it: add 'count' elements (through both interfaces) and see if the part
+ * above 2^32 bits gets its share of bits.
  *
  */
-int main(int argc, char **argv)
+static int above_4g(int count, int flags)
 {
-  // Calls return() instead of exit() just to make valgrind mark as
-  // an error any reachable allocations. That makes them show up
-  // when running the tests.
+  printf("----- above_4g(%d, %d) -----\n", count, flags);
 
-  int rv = 0;
+  struct bloom bloom;
+  uint64_t x = 0xfedcba9876543210ULL;
+  size_t set = 0;
+  size_t i;
+  int n;
 
-  if (argc == 1) {
-    printf("----- Running basic tests -----\n");
-    rv = basic_tests();
-    printf("----- DONE Running basic tests -----\n");
-    return rv;
+  // 460M entries at 1% take some 4.4G bits
+  assert(bloom_init_flags(&bloom, 460000000, 0.01, flags) == 0);
+  assert(bloom.bits > ((size_t)1 << 32));
+  bloom_print(&bloom);
+
+  for (n = 0; n < count; n++) {
+    uint64_t h1 = next_random(&x);
+    uint64_t h2 = next_random(&x);
+    assert(bloom_add(&bloom, &h1, sizeof(h1)) == 0);
+    assert(bloom_check(&bloom, &h1, sizeof(h1)) == 1);
+    assert(bloom_check_add_prehashed(&bloom, h1, h2, 1) == 0);
+    assert(bloom_check_add_prehashed(&bloom, h1, h2, 0) == 1);
   }
 
-  if (!strncmp(argv[1], "-L", 2)) {
-    return larger_tests();
+  for (i = (size_t)1 << 29; i < bloom.bytes; i++) {
+    set += __builtin_popcount(bloom.bf[i]);
   }
 
-  if (!strncmp(argv[1], "-G", 2)) {
-    if (argc != 6) {
-      printf("-G START END INCREMENT ERROR\n");
-      return 1;
-    }
-    int e;
-    for (e = atoi(argv[2]); e <= atoi(argv[3]); e+= atoi(argv[4])) {
-      rv += add_random(e, atof(argv[5]), e, 1, 0, 32, 1);
-    }
-    return rv;
+  double expected = 2.0 * count * bloom.hashes
+                    * ((double)bloom.bits - 4294967296.0) / bloom.bits;
+  printf("bits set above 2^32: %ld, expected about %.0f\n", set, expected);
+
+  if (set < 0.9 * expected || set > 1.1 * expected) {
+    printf("error: bits above 2^32 not used as expected\n");
+    exit(1);
   }
 
-  if (!strncmp(argv[1], "-c", 2)) {
-    if (argc != 5) {
-      printf("-c ENTRIES ERROR COUNT\n");
-      return 1;
-    }
+  bloom_free(&bloom);
+  return 0;
+}
 
-    return add_random(atoi(argv[2]), atof(argv[3]), atoi(argv[4]), 0, 1, 32, 1);
+
+/** ***************************************************************************
+ * Fill a filter of about 'gigabytes' GB up to its capacity, then measure its
+ * actual false positive rate with elements that weren't added.
+ *
+ */
+static int fill_large(double gigabytes, double error, int flags)
+{
+  printf("----- fill_large(%f, %f, %d) -----\n", gigabytes, error, flags);
+
+  struct bloom bloom;
+  double bpe = -log(error) / 0.480453013918201;
+  size_t entries = (size_t)(gigabytes * 8 * 1073741824.0 / bpe);
+  uint64_t x = 0x0123456789abcdefULL;
+  int tests = 10000000;
+  int positives = 0;
+  size_t n;
+
+  assert(bloom_init_flags(&bloom, entries, error, flags) == 0);
+  bloom_print(&bloom);
+
+  for (n = 0; n < entries; n++) {
+    uint64_t h1 = next_random(&x);
+    bloom_check_add_prehashed(&bloom, h1, next_random(&x), 1);
+  }
+
+  for (n = 0; n < tests; n++) {
+    uint64_t h1 = next_random(&x);
+    if (bloom_check_add_prehashed(&bloom, h1, next_random(&x), 0)) {
+      positives++;
+    }
+  }
+
+  double fp = (double)positives / tests;
+  printf("entries: %ld, error: %f, bytes: %ld, false positives: %f\n",
+         entries, error, bloom.bytes, fp);
+
+  if (fp > 1.1 * error) {
+    printf("error: expected error %f but observed %f\n", error, fp);
+    exit(1);
+  }
+
+  bloom_free(&bloom);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Several threads adding the same elements to a concurrent filter at once,
+ * each one starting at a different element. Right after adding an element
+ * a thread must find it, and when all are done every element must be in
+ * the filter, or bits got lost.
+ *
+ */
+struct stress_args
+{
+  struct bloom * bloom;
+  int start;
+  int count;
+  int missing;
+};
+
+
+static uint64_t stress_hash(uint64_t x)
+{
+  // splitmix64, so all threads get the same hash values for an element
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+
+static void * stress_thread(void * arg)
+{
+  struct stress_args * args = (struct stress_args *)arg;
+  int n;
+
+  for (n = 0; n < args->count; n++) {
+    uint64_t e = (args->start + n) % args->count;
+    uint64_t h1 = stress_hash(2 * e);
+    uint64_t h2 = stress_hash(2 * e + 1);
+
+    bloom_check_add_prehashed(args->bloom, h1, h2, 1);
+    if (bloom_check_add_prehashed(args->bloom, h1, h2, 0) != 1) {
+      args->missing++;
+    }
+  }
+
+  return NULL;
+}
+
+
+static int concurrent_stress(int count, int threads, int flags)
+{
+  printf("----- concurrent_stress(%d, %d, %d) -----\n", count, threads, flags);
+
+  struct bloom bloom;
+  pthread_t tids[threads];
+  struct stress_args args[threads];
+  int missing = 0;
+  int t;
+  int n;
+
+  // a small filter, so the threads keep hitting the same words
+  assert(bloom_init_flags(&bloom, count, 0.01,
+                          flags | BLOOM_CONCURRENT) == 0);
+  assert(bloom.bytes % 8 == 0);
+
+  for (t = 0; t < threads; t++) {
+    args[t].bloom = &bloom;
+    args[t].start = t * (count / threads);
+    args[t].count = count;
+    args[t].missing = 0;
+    assert(pthread_create(&tids[t], NULL, stress_thread, &args[t]) == 0);
+  }
+
+  for (t = 0; t < threads; t++) {
+    assert(pthread_join(tids[t], NULL) == 0);
+    missing += args[t].missing;
+  }
+
+  for (n = 0; n < count; n++) {
+    if (bloom_check_add_prehashed(&bloom, stress_hash(2 * (uint64_t)n),
+                                  stress_hash(2 * (uint64_t)n + 1), 0) != 1) {
+      missing++;
+    }
+  }
+
+  printf("elements: %d, threads: %d, false negatives: %d\n",
+         count, threads, missing);
+
+  if (missing) {
+    printf("error: elements got lost by concurrent adds\n");
+    exit(1);
+  }
+
+  bloom_free(&bloom);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Collision rate sweep over filters for START to END entries (in steps of
+ * INCREMENT) at collision probability 'error', spread over 'threads'
+ * threads. Each point is the same test as add_random() with elements of
+ * 32 bytes, only with elements from a generator seeded by the point's
+ * parameters, so a sweep gives the same results on any number of threads.
+ * Lines are printed in order of the points, as soon as all points before
+ * them are done.
+ *
+ */
+#define SWEEP_LINE 96
+
+struct sweep
+{
+  int start;
+  int increment;
+  int points;
+  double error;
+  int next;                     // next point to be taken by a thread
+  char * lines;                 // SWEEP_LINE bytes per point, "" until done
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+};
+
+
+static void sweep_point(int entries, double error, char * line)
+{
+  struct bloom bloom;
+  uint64_t element[4];
+  uint64_t seed;
+  uint64_t x;
+  int collisions = 0;
+  int n;
+  int i;
+
+  memcpy(&seed, &error, sizeof(seed));
+  seed = stress_hash(seed ^ stress_hash((uint64_t)entries));
+  if (seed == 0) {
+    seed = 1;
+  }
+
+  assert(bloom_init(&bloom, entries, error) == 0);
+
+  x = seed;
+  for (n = 0; n < entries; n++) {
+    for (i = 0; i < 4; i++) {
+      element[i] = next_random(&x);
+    }
+    if (bloom_add(&bloom, element, sizeof(element))) { collisions++; }
+  }
+
+  x = seed;
+  for (n = 0; n < entries; n++) {
+    for (i = 0; i < 4; i++) {
+      element[i] = next_random(&x);
+    }
+    if (!bloom_check(&bloom, element, sizeof(element))) {
+      printf("error: data saved in filter is not there!\n");
+      exit(1);
+    }
+  }
+
+  snprintf(line, SWEEP_LINE, "%d %f %d %d %f %d\n",
+           entries, error, entries, collisions,
+           (double)collisions / (double)entries, (int)bloom.bytes);
+  bloom_free(&bloom);
+}
+
+
+static void * sweep_thread(void * arg)
+{
+  struct sweep * sweep = (struct sweep *)arg;
+  char line[SWEEP_LINE];
+
+  for (;;) {
+    int point = __atomic_fetch_add(&sweep->next, 1, __ATOMIC_RELAXED);
+    if (point >= sweep->points) {
+      return NULL;
+    }
+
+    sweep_point(sweep->start + point * sweep->increment, sweep->error, line);
+
+    pthread_mutex_lock(&sweep->lock);
+    memcpy(sweep->lines + (size_t)point * SWEEP_LINE, line, SWEEP_LINE);
+    pthread_cond_signal(&sweep->done);
+    pthread_mutex_unlock(&sweep->lock);
+  }
+}
+
+
+static int collision_sweep(int start, int end, int increment, double error,
+                           int threads)
+{
+  struct sweep sweep;
+  pthread_t tids[threads];
+  int point;
+  int t;
+
+  if (increment < 1 || end < start) {
+    printf("-G needs START <= END and INCREMENT > 0\n");
+    return 1;
+  }
+
+  sweep.start = start;
+  sweep.increment = increment;
+  sweep.points = (end - start) / increment + 1;
+  sweep.error = error;
+  sweep.next = 0;
+  sweep.lines = (char *)calloc(sweep.points, SWEEP_LINE);
+  if (!sweep.lines) {
+    printf("error: unable to allocate buffer for results\n");
+    exit(1);
+  }
+  pthread_mutex_init(&sweep.lock, NULL);
+  pthread_cond_init(&sweep.done, NULL);
+
+  for (t = 0; t < threads; t++) {
+    pthread_create(&tids[t], NULL, sweep_thread, &sweep);
+  }
+
+  for (point = 0; point < sweep.points; point++) {
+    char * line = sweep.lines + (size_t)point * SWEEP_LINE;
+
+    pthread_mutex_lock(&sweep.lock);
+    while (line[0] == '\0') {
+      pthread_cond_wait(&sweep.done, &sweep.lock);
+    }
+    pthread_mutex_unlock(&sweep.lock);
+
+    fputs(line, stdout);
+    fflush(stdout);
+  }
+
+  for (t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  pthread_mutex_destroy(&sweep.lock);
+  pthread_cond_destroy(&sweep.done);
+  free(sweep.lines);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Compare the kinds of filters for 'entries' elements at collision
+ * probability 'error': memory per element, actual false positive rate
+ * and time per lookup (of elements not added, one by one and in batches).
+ *
+ */
+static int compare(int entries, double error)
+{
+  printf("----- compare(%d, %f) -----\n", entries, error);
+
+  static const int kinds[] = { 0, BLOOM_BLOCKED, BLOOM_CUCKOO };
+  static const char * names[] = { "bloom", "blocked", "cuckoo" };
+  int tests = 10000000;
+  uint64_t * h1 = (uint64_t *)malloc(tests * sizeof(uint64_t));
+  uint64_t * h2 = (uint64_t *)malloc(tests * sizeof(uint64_t));
+  int * results = (int *)malloc(tests * sizeof(int));
+  int k;
+  int n;
+
+  if (!h1 || !h2 || !results) {
+    printf("error: unable to allocate buffers for lookups\n");
+    exit(1);
+  }
+
+  for (k = 0; k < 3; k++) {
+    struct bloom bloom;
+    uint64_t x = 0x0123456789abcdefULL;
+    struct timeval t0, t1, t2;
+    int positives = 0;
+
+    assert(bloom_init_flags(&bloom, entries, error, kinds[k]) == 0);
+    for (n = 0; n < entries; n++) {
+      uint64_t a = next_random(&x);
+      bloom_check_add_prehashed(&bloom, a, next_random(&x), 1);
+    }
+    for (n = 0; n < tests; n++) {
+      h1[n] = next_random(&x);
+      h2[n] = next_random(&x);
+    }
+
+    gettimeofday(&t0, NULL);
+    for (n = 0; n < tests; n++) {
+      positives += bloom_check_add_prehashed(&bloom, h1[n], h2[n], 0);
+    }
+    gettimeofday(&t1, NULL);
+    bloom_check_add_batch(&bloom, h1, h2, tests, results, 0);
+    gettimeofday(&t2, NULL);
+
+    printf("%-8s bits/entry %6.2f  false positives %f  "
+           "lookup %6.1f ns, batched %6.1f ns\n",
+           names[k], 8.0 * bloom.bytes / entries,
+           (double)positives / tests,
+           ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_usec - t0.tv_usec) * 1e3)
+           / tests,
+           ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_usec - t1.tv_usec) * 1e3)
+           / tests);
+    bloom_free(&bloom);
+  }
+
+  free(h1);
+  free(h2);
+  free(results);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Benchmark matrix: for every combination of the given numbers of entries,
+ * collision probabilities, schemes (see bench_schemes), batch sizes and
+ * thread counts, fill a filter and time lookups of elements not added.
+ * Adds are timed single threaded (with the batch size, 1 meaning through
+ * bloom_check_add_prehashed()), lookups run on all threads at once, each
+ * with its share of BENCH_LOOKUPS elements. Writes one CSV line per
+ * combination to stdout, see bench_matrix() for the columns.
+ *
+ */
+#define BENCH_LOOKUPS 4000000
+#define BENCH_MAX_BATCH 4096
+#define BENCH_MAX_VALUES 64
+
+struct bench_scheme
+{
+  const char * name;
+  int flags;
+};
+
+static const struct bench_scheme bench_schemes[] = {
+  { "regular", 0 },
+  { "pow2", BLOOM_POW2 },
+  { "blocked", BLOOM_BLOCKED },
+  { "blocked-pow2", BLOOM_BLOCKED | BLOOM_POW2 },
+  { "cuckoo", BLOOM_CUCKOO },
+  { "cuckoo-pow2", BLOOM_CUCKOO | BLOOM_POW2 },
+};
+
+#define BENCH_SCHEMES (int)(sizeof(bench_schemes) / sizeof(bench_schemes[0]))
+
+struct bench_args
+{
+  struct bloom * bloom;
+  const uint64_t * h1;
+  const uint64_t * h2;
+  int count;
+  int batch;
+  int positives;
+};
+
+
+static int bench_check_add(struct bloom * bloom, const uint64_t * h1,
+                           const uint64_t * h2, int count, int batch, int add)
+{
+  int results[BENCH_MAX_BATCH];
+  int positives = 0;
+  int n;
+  int i;
+
+  if (batch == 1) {
+    for (n = 0; n < count; n++) {
+      positives += bloom_check_add_prehashed(bloom, h1[n], h2[n], add);
+    }
+    return positives;
+  }
+
+  for (n = 0; n < count; n += batch) {
+    int b = count - n < batch ? count - n : batch;
+    bloom_check_add_batch(bloom, h1 + n, h2 + n, b, results, add);
+    for (i = 0; i < b; i++) {
+      positives += results[i];
+    }
+  }
+  return positives;
+}
+
+
+static void * bench_thread(void * arg)
+{
+  struct bench_args * args = (struct bench_args *)arg;
+
+  args->positives = bench_check_add(args->bloom, args->h1, args->h2,
+                                    args->count, args->batch, 0);
+  return NULL;
+}
+
+
+static double bench_seconds(const struct timeval * since)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - since->tv_sec) + (now.tv_usec - since->tv_usec) / 1e6;
+}
+
+
+/*
+ * Counts the cache misses (of the last level cache, as the kernel maps
+ * PERF_COUNT_HW_CACHE_MISSES) of this process and the threads it starts
+ * from now on. Returns -1 where that isn't possible, e.g. without access
+ * to hardware counters (see /proc/sys/kernel/perf_event_paranoid).
+ */
+static int bench_perf_open(void)
+{
+#if defined(__linux) && defined(SYS_perf_event_open)
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+
+static long long bench_perf_close(int fd)
+{
+  long long count = -1;
+
+#if defined(__linux) && defined(SYS_perf_event_open)
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+    count = -1;
+  }
+  close(fd);
+#endif
+  return count;
+}
+
+
+// parses a comma separated list of numbers, returns how many there were
+static int bench_values(char * list, double * values)
+{
+  char * v;
+  int n = 0;
+
+  for (v = strtok(list, ","); v != NULL && n < BENCH_MAX_VALUES;
+       v = strtok(NULL, ",")) {
+    values[n++] = atof(v);
+  }
+  return n;
+}
+
+
+// parses a comma separated list of scheme names ("all" for all of them),
+// like bench_values() up to BENCH_MAX_VALUES of them
+static int bench_scheme_list(char * list, int * schemes)
+{
+  char * v;
+  int n = 0;
+  int i;
+
+  for (v = strtok(list, ","); v != NULL && n < BENCH_MAX_VALUES;
+       v = strtok(NULL, ",")) {
+    for (i = 0; i < BENCH_SCHEMES && n < BENCH_MAX_VALUES; i++) {
+      if (!strcmp(v, "all") || !strcmp(v, bench_schemes[i].name)) {
+        schemes[n++] = i;
+        if (strcmp(v, "all")) {
+          break;
+        }
+      }
+    }
+    if (i == BENCH_SCHEMES && strcmp(v, "all")) {
+      fprintf(stderr, "unknown scheme %s\n", v);
+      exit(1);
+    }
+  }
+  return n;
+}
+
+
+static int bench_matrix(char * entries_list, char * errors_list,
+                        char * schemes_list, char * batches_list,
+                        char * threads_list, int perf)
+{
+  double entries[BENCH_MAX_VALUES];
+  double errors[BENCH_MAX_VALUES];
+  double batches[BENCH_MAX_VALUES];
+  double threads[BENCH_MAX_VALUES];
+  int schemes[BENCH_MAX_VALUES];
+  int n_entries = bench_values(entries_list, entries);
+  int n_errors = bench_values(errors_list, errors);
+  int n_schemes = bench_scheme_list(schemes_list, schemes);
+  int n_batches = bench_values(batches_list, batches);
+  int n_threads = bench_values(threads_list, threads);
+  uint64_t * h1 = (uint64_t *)malloc(BENCH_LOOKUPS * sizeof(uint64_t));
+  uint64_t * h2 = (uint64_t *)malloc(BENCH_LOOKUPS * sizeof(uint64_t));
+  uint64_t add1[BENCH_MAX_BATCH];
+  uint64_t add2[BENCH_MAX_BATCH];
+  uint64_t x = 0x0123456789abcdefULL;
+  int e, r, s, b, t;
+  int n;
+
+  if (!h1 || !h2) {
+    fprintf(stderr, "error: unable to allocate buffers for lookups\n");
+    exit(1);
+  }
+
+  if (perf) {
+    int fd = bench_perf_open();
+    if (fd < 0) {
+      fprintf(stderr, "cache misses can't be counted here\n");
+      perf = 0;
+    } else {
+      bench_perf_close(fd);
+    }
+  }
+
+  // elements looked up, never added (those are from another seed)
+  for (n = 0; n < BENCH_LOOKUPS; n++) {
+    h1[n] = next_random(&x);
+    h2[n] = next_random(&x);
+  }
+
+  printf("entries,error,scheme,batch,threads,bytes,bits_per_entry,"
+         "false_positives,add_ns,lookup_ns,lookups_per_s,"
+         "cache_misses_per_lookup\n");
+
+  for (e = 0; e < n_entries; e++)
+  for (r = 0; r < n_errors; r++)
+  for (s = 0; s < n_schemes; s++)
+  for (b = 0; b < n_batches; b++) {
+    const struct bench_scheme * scheme = &bench_schemes[schemes[s]];
+    size_t count = (size_t)entries[e];
+    int batch = (int)batches[b];
+    struct bloom bloom;
+    struct timeval start;
+    double add_seconds;
+    size_t added;
+
+    if (batch < 1 || batch > BENCH_MAX_BATCH) {
+      fprintf(stderr, "batch sizes go from 1 to %d\n", BENCH_MAX_BATCH);
+      exit(1);
+    }
+
+    if (bloom_init_flags(&bloom, count, errors[r], scheme->flags)) {
+      fprintf(stderr, "skipping %s filter for %ld entries at %f\n",
+              scheme->name, count, errors[r]);
+      continue;
+    }
+
+    uint64_t y = 0xfedcba9876543210ULL;
+    gettimeofday(&start, NULL);
+    for (added = 0; added < count; added += (size_t)batch) {
+      int k = count - added < (size_t)batch ? (int)(count - added) : batch;
+      for (n = 0; n < k; n++) {
+        add1[n] = next_random(&y);
+        add2[n] = next_random(&y);
+      }
+      bench_check_add(&bloom, add1, add2, k, batch, 1);
+    }
+    add_seconds = bench_seconds(&start);
+
+    for (t = 0; t < n_threads; t++) {
+      int nthreads = (int)threads[t] < 1 ? 1 : (int)threads[t];
+      pthread_t tids[nthreads];
+      struct bench_args args[nthreads];
+      int per_thread = BENCH_LOOKUPS / nthreads;
+      int positives = 0;
+      int fd = perf ? bench_perf_open() : -1;
+      double seconds;
+      long long misses = -1;
+      int i;
+
+      gettimeofday(&start, NULL);
+      for (i = 0; i < nthreads; i++) {
+        args[i].bloom = &bloom;
+        args[i].h1 = h1 + i * per_thread;
+        args[i].h2 = h2 + i * per_thread;
+        args[i].count = per_thread;
+        args[i].batch = batch;
+        pthread_create(&tids[i], NULL, bench_thread, &args[i]);
+      }
+      for (i = 0; i < nthreads; i++) {
+        pthread_join(tids[i], NULL);
+        positives += args[i].positives;
+      }
+      seconds = bench_seconds(&start);
+      if (fd >= 0) {
+        misses = bench_perf_close(fd);
+      }
+
+      double lookups = (double)per_thread * nthreads;
+      printf("%ld,%g,%s,%d,%d,%ld,%.3f,%.6f,%.1f,%.1f,%.0f,",
+             count, errors[r], scheme->name, batch, nthreads, bloom.bytes,
+             8.0 * bloom.bytes / count, positives / lookups,
+             add_seconds * 1e9 / count, seconds * 1e9 * nthreads / lookups,
+             lookups / seconds);
+      if (misses >= 0) {
+        printf("%.3f", misses / lookups);
+      }
+      printf("\n");
+      fflush(stdout);
+    }
+
+    bloom_free(&bloom);
+  }
+
+  free(h1);
+  free(h2);
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Simple loop to compare performance.
+ *
+ */
+static int perf_loop(int entries, int count)
+{
+  printf("----- perf_loop -----\n");
+
+  struct bloom bloom;
+  assert(bloom_init(&bloom, entries, 0.001) == 0);
+  bloom_print(&bloom);
+
+  int i;
+  int collisions = 0;
+
+  struct timeval tp;
+  gettimeofday(&tp, NULL);
+  long before = (tp.tv_sec * 1000L) + (tp.tv_usec / 1000L);
+
+  for (i = 0; i < count; i++) {
+    if (bloom_add(&bloom, (void *)&i, sizeof(int))) { collisions++; }
+  }
+
+  gettimeofday(&tp, NULL);
+  long after = (tp.tv_sec * 1000L) + (tp.tv_usec / 1000L);
+
+  printf("Added %d elements of size %d, took %d ms (collisions=%d)\n",
+         count, (int)sizeof(int), (int)(after - before), collisions);
+
+  printf("%d,%d,%ld\n", entries, bloom.bytes, after - before);
+
+  bloom_print(&bloom);
+  bloom_free(&bloom);
+
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Default set of basic tests.
+ *
+ * These should run reasonably quick so they can be run all the time.
+ *
+ */
+static int basic_tests()
+{
+  int rv = 0;
+
+  rv += basic();
+  rv += add_random(10, 0.1, 10, 0, 1, 32, 1, 0);
+  rv += add_random(10000, 0.1, 10000, 0, 1, 32, 1, 0);
+  rv += add_random(10000, 0.01, 10000, 0, 1, 32, 1, 0);
+  rv += add_random(10000, 0.001, 10000, 0, 1, 32, 1, 0);
+  rv += add_random(10000, 0.0001, 10000, 0, 1, 32, 1, 0);
+  rv += add_random(1000000, 0.0001, 1000000, 0, 1, 32, 1, 0);
+
+  rv += basic_blocked();
+  rv += add_random(10, 0.1, 10, 0, 1, 32, 1, 1);
+  rv += add_random(10000, 0.1, 10000, 0, 1, 32, 1, 1);
+  rv += add_random(10000, 0.01, 10000, 0, 1, 32, 1, 1);
+  rv += add_random(10000, 0.001, 10000, 0, 1, 32, 1, 1);
+  rv += add_random(1000000, 0.0001, 1000000, 0, 1, 32, 1, 1);
+
+  rv += add_prehashed(10000, 0.01, 10000, 0);
+  rv += add_prehashed(1000000, 0.0001, 1000000, 0);
+  rv += add_prehashed(10000, 0.01, 10000, BLOOM_BLOCKED);
+  rv += add_prehashed(1000000, 0.0001, 1000000, BLOOM_BLOCKED);
+  rv += add_prehashed(10000, 0.01, 10000, BLOOM_POW2);
+  rv += add_prehashed(1000000, 0.0001, 1000000, BLOOM_POW2);
+  rv += add_prehashed(1000000, 0.0001, 1000000, BLOOM_BLOCKED | BLOOM_POW2);
+  rv += add_prehashed(1000000, 0.0001, 1000000, BLOOM_HUGEPAGES);
+  rv += add_prehashed(1000000, 0.0001, 1000000,
+                      BLOOM_BLOCKED | BLOOM_HUGEPAGES);
+  rv += add_prehashed(10000, 0.01, 10000, BLOOM_INTERLEAVE);
+  rv += add_prehashed(10000, 0.01, 10000, BLOOM_CUCKOO);
+  rv += add_prehashed(1000000, 0.0001, 1000000, BLOOM_CUCKOO);
+  rv += add_prehashed(1000000, 0.0001, 1000000, BLOOM_CUCKOO | BLOOM_POW2);
+  rv += add_prehashed(1000000, 0.0001, 1000000,
+                      BLOOM_CUCKOO | BLOOM_HUGEPAGES);
+
+  rv += add_batch(100000, 0.001, 100000, 0);
+  rv += add_batch(100000, 0.001, 100000, BLOOM_POW2);
+  rv += add_batch(100000, 0.001, 100000, BLOOM_BLOCKED);
+  rv += add_batch(100000, 0.001, 100000, BLOOM_BLOCKED | BLOOM_CONCURRENT);
+  rv += add_batch(10000, 0.001, 100000, BLOOM_SCALABLE);
+  rv += add_batch(10000, 0.001, 100000, BLOOM_BLOCKED | BLOOM_SCALABLE);
+  rv += add_batch(100000, 0.001, 100000, BLOOM_CUCKOO);
+  rv += add_batch(10000, 0.001, 100000, BLOOM_CUCKOO | BLOOM_SCALABLE);
+
+  rv += scalable(10000, 0.01, 1000000, 0);
+  rv += scalable(10000, 0.001, 1000000, BLOOM_BLOCKED);
+  rv += scalable(1000, 0.01, 100000, BLOOM_POW2);
+  rv += scalable(10000, 0.001, 1000000, BLOOM_CUCKOO);
+
+  rv += cuckoo_full(10000, 0);
+  rv += cuckoo_full(10000, BLOOM_POW2);
+
+  rv += save_load(10000, 5000, 0, 0);
+  rv += save_load(10000, 5000, 0, BLOOM_MMAP);
+  rv += save_load(10000, 5000, BLOOM_BLOCKED | BLOOM_POW2, BLOOM_MMAP);
+  rv += save_load(10000, 5000, BLOOM_BLOCKED, BLOOM_CONCURRENT);
+  rv += save_load(1000, 10000, BLOOM_SCALABLE, 0);
+  rv += save_load(1000, 10000, BLOOM_SCALABLE | BLOOM_BLOCKED, BLOOM_MMAP);
+  rv += save_load(10000, 5000, BLOOM_CUCKOO, 0);
+  rv += save_load(1000, 10000, BLOOM_SCALABLE | BLOOM_CUCKOO, BLOOM_MMAP);
+
+  rv += load_corrupt(0);
+  rv += load_corrupt(BLOOM_POW2);
+  rv += load_corrupt(BLOOM_BLOCKED);
+  rv += load_corrupt(BLOOM_CUCKOO);
+
+  rv += concurrent_stress(200000, 8, 0);
+  rv += concurrent_stress(200000, 8, BLOOM_POW2);
+  rv += concurrent_stress(200000, 8, BLOOM_BLOCKED);
+  rv += concurrent_stress(1000, 16, BLOOM_BLOCKED);
+
+  rv += above_4g(100000, 0);
+  rv += above_4g(100000, BLOOM_BLOCKED);
+  rv += above_4g(100000, BLOOM_HUGEPAGES);
+
+  printf("\nBrought to you by libbloom-%s\n", bloom_version());
+
+  return 0;
+}
+
+
+/** ***************************************************************************
+ * Some longer-running tests.
+ *
+ */
+static int larger_tests()
+{
+  int rv = 0;
+  int e;
+
+  printf("\nAdd 10M elements and verify (0.00001)\n");
+  rv += add_random(10000000, 0.00001, 10000000, 0, 1, 32, 1, 0);
+
+  printf("\nFill filters of 2GB and check their false positive rate\n");
+  rv += fill_large(2, 0.001, 0);
+  rv += fill_large(2, 0.001, BLOOM_BLOCKED);
+  rv += fill_large(2, 0.001, BLOOM_BLOCKED | BLOOM_POW2);
+
+  printf("\nChecking collision rates with filters from 100K to 1M (0.001)\n");
+  for (e = 100000; e <= 1000000; e+= 100) {
+    rv += add_random(e, 0.001, e, 1, 1, 8, 1, 0);
+  }
+
+  return rv;
+}
+
+
+/** ***************************************************************************
+ * With no options, runs brief default tests.
+ *
+ * With -L, runs some longer-running tests.
+ *
+ * To test collisions over a range of sizes:
+ *     -G START END INCREMENT ERROR [THREADS]
+ * This produces output that can be graphed with collisions/dograph
+ * See also collision_test make target. The sizes are tested on THREADS
+ * threads (default: one per CPU), the output is the same for any number.
+ *
+ * To check the false positive rate of a filter of a given size (e.g. one
+ * larger than 2^32 bits) filled to its capacity: -F GIGABYTES ERROR FLAGS
+ * Where 'FLAGS' are the BLOOM_* flags passed to bloom_init_flags().
+ *
+ * To test collisions, run with options: -c ENTRIES ERROR COUNT
+ * Where 'ENTRIES' is the expected number of entries used to initialize the
+ * bloom filter and 'ERROR' is the acceptable probability of collision
+ * used to initialize the bloom filter. 'COUNT' is the actual number of
+ * entries inserted.
+ *
+ * To compare memory use, false positive rate and lookup times of regular,
+ * blocked and cuckoo filters: -C ENTRIES ERROR
+ *
+ * To run a benchmark matrix, writing CSV to stdout:
+ *     -B ENTRIES ERRORS SCHEMES BATCHES THREADS [perf]
+ * Each a comma separated list of values, SCHEMES being names from
+ * bench_schemes or "all". With 'perf', cache misses are counted as well.
+ * See also bench make target.
+ *
+ * To test performance only, run with options:  -p ENTRIES COUNT
+ * Where 'ENTRIES' is the expected number of entries used to initialize the
+ * bloom filter and 'COUNT' is the actual number of entries inserted.
+ *
+ */
+int main(int argc, char **argv)
+{
+  // Calls return() instead of exit() just to make valgrind mark as
+  // an error any reachable allocations. That makes them show up
+  // when running the tests.
+
+  int rv = 0;
+
+  if (argc == 1) {
+    printf("----- Running basic tests -----\n");
+    rv = basic_tests();
+    printf("----- DONE Running basic tests -----\n");
+    return rv;
+  }
+
+  if (!strncmp(argv[1], "-L", 2)) {
+    return larger_tests();
+  }
+
+  if (!strncmp(argv[1], "-G", 2)) {
+    if (argc != 6 && argc != 7) {
+      printf("-G START END INCREMENT ERROR [THREADS]\n");
+      return 1;
+    }
+    int threads = argc == 7 ? atoi(argv[6])
+                            : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return collision_sweep(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]),
+                           atof(argv[5]), threads < 1 ? 1 : threads);
+  }
+
+  if (!strncmp(argv[1], "-F", 2)) {
+    if (argc != 5) {
+      printf("-F GIGABYTES ERROR FLAGS\n");
+      return 1;
+    }
+    return fill_large(atof(argv[2]), atof(argv[3]), atoi(argv[4]));
+  }
+
+  if (!strncmp(argv[1], "-c", 2)) {
+    if (argc != 5) {
+      printf("-c ENTRIES ERROR COUNT\n");
+      return 1;
+    }
+
+    return add_random(atoi(argv[2]), atof(argv[3]), atoi(argv[4]), 0, 1, 32, 1, 0);
+  }
+
+  if (!strncmp(argv[1], "-C", 2)) {
+    if (argc != 4) {
+      printf("-C ENTRIES ERROR\n");
+      return 1;
+    }
+    return compare(atoi(argv[2]), atof(argv[3]));
+  }
+
+  if (!strncmp(argv[1], "-B", 2)) {
+    if (argc != 7 && !(argc == 8 && !strcmp(argv[7], "perf"))) {
+      printf("-B ENTRIES ERRORS SCHEMES BATCHES THREADS [perf]\n");
+      return 1;
+    }
+    return bench_matrix(argv[2], argv[3], argv[4], argv[5], argv[6],
+                        argc == 8);
   }
 
   if (!strncmp(argv[1], "-p", 2)) {
@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
 #include <boost/thread.hpp>
 #include <boost/program_options.hpp>
 #include <boost/exception/all.hpp>
@@ -7,8 +12,11 @@
 #include "libbloom/bloom.h"
 #include "sha_digest/sha256.h"
 
+#include "chain_index.hpp"
 #include "datatypes.hpp"
+#include "hash_algo.hpp"
 #include "main.hpp"
+#include "memory_store.hpp"
 #include "thread_database.hpp"
 #include "thread_hasher.hpp"
 
@@ -22,16 +30,49 @@ po::variables_map parse_args(int ac, char** av) {
         ("help", "produce help message")
         ("seed", po::value<std::string>()->default_value("foo bar moo rar baz fez kek ayy!"),
          "string to start hashing from")
+        ("algo", po::value<std::string>()->default_value("sha256"),
+         "hash algorithm to walk with (sha1, sha224, sha256, sha384, sha512)")
         ("bitlen", po::value<size_t>()->default_value(32),
          "collision prefix bit length")
         ("batch-size", po::value<ull>()->default_value(1e4),
          "hasher thread batch size for DB operations")
-        ("bloom-size", po::value<ull>()->default_value(1e7),
-         "bloom filter size")
+        ("store", po::value<std::string>()->default_value("leveldb"),
+         "where hashes are kept: leveldb, or memory (a hash table of bloom-size hashes, no bloom filter and DB thread)")
+        ("store-index", po::bool_switch(),
+         "keep where each hash is in the chains in the memory store instead of its preimage (smaller records, the colliding preimage gets recomputed from checkpoints)")
+        ("checkpoint-interval", po::value<size_t>()->default_value(4096),
+         "chain steps between the checkpoints of store-index")
+        ("bloom-size", po::value<ull>()->default_value(0),
+         "bloom filter (or memory store) size (0 = bloom-safety times the number of hashes expected until a collision at bitlen)")
+        ("bloom-safety", po::value<double>()->default_value(3),
+         "how many times the expected number of hashes an automatically sized bloom filter holds (the chance of needing more is exp(-pi/4 * safety^2))")
         ("bloom-prob", po::value<double>()->default_value(0.0001),
          "bloom filter false-positive probability")
+        ("filter", po::value<std::string>()->default_value("bloom"),
+         "approximate membership filter: bloom or cuckoo (less memory below about 0.3% FP probability, bloom-size is a hard limit unless scalable)")
+        ("bloom-blocked", po::bool_switch(),
+         "keep all bits of a hash in one cache line of the bloom filter (larger, but one cache miss per lookup)")
+        ("bloom-pow2", po::bool_switch(),
+         "round the bloom filter size up to a power of two (up to twice the memory, cheaper lookups)")
+        ("bloom-hugepages", po::bool_switch(),
+         "map the bloom filter onto huge pages (fewer TLB misses, no zeroing at startup)")
+        ("bloom-interleave", po::bool_switch(),
+         "interleave the bloom filter's pages over all NUMA nodes")
+        ("bloom-scalable", po::bool_switch(),
+         "add larger bloom filters as needed instead of degrading past bloom-size elements")
+        ("bloom-load", po::value<std::string>()->default_value(""),
+         "start from a bloom filter saved by bloom-save, mapped from the file (together with the database it was saved along with, and a different seed)")
+        ("bloom-save", po::value<std::string>()->default_value(""),
+         "save the bloom filter to this file when done")
         ("ldb-path", po::value<std::string>()->default_value("/tmp/shabang.ldb"),
          "path to LevelDB store")
+        ("sha-backend", po::value<std::string>()->default_value("auto"),
+         "hash function implementation (auto, portable; sha1: shani, avx2; "
+         "sha256: shani, avx2, avx512; sha384, sha512: avx2)")
+        ("progress", po::value<size_t>()->default_value(10),
+         "seconds between progress reports (0 = none)")
+        ("chains", po::value<size_t>()->default_value(1),
+         "number of hash chains to advance in parallel (0 = as many as the backend hashes at once)")
     ;
 
     po::variables_map vm;
@@ -43,8 +84,20 @@ po::variables_map parse_args(int ac, char** av) {
         BOOST_THROW_EXCEPTION(OptionParserError());
     }
 
+    if (vm.count("algo")) {
+        if (!algo_digest_size(vm["algo"].as<std::string>())) {
+            std::cout << "Unknown hash algorithm." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+    }
+
     if (vm.count("bitlen")) {
-        if (vm["bitlen"].as<size_t>() > 8 * SHA256_HASH_SIZE) {
+        // (no hash is empty then, the store's metadata key is)
+        if (vm["bitlen"].as<size_t>() < 1) {
+            std::cout << "Prefix bit length needs to be >0." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+        if (vm["bitlen"].as<size_t>() > 8 * algo_digest_size(vm["algo"].as<std::string>())) {
             std::cout << "Prefix bit length cannot be longer than the whole hash size!" << std::endl;
             BOOST_THROW_EXCEPTION(OptionParserError());
         }
@@ -57,9 +110,9 @@ po::variables_map parse_args(int ac, char** av) {
         }
     }
 
-    if (vm.count("bloom-size")) {
-        if (vm["bloom-size"].as<ull>() < 1) {
-            std::cout << "Need to store at least one element lol." << std::endl;
+    if (vm.count("bloom-safety")) {
+        if (vm["bloom-safety"].as<double>() <= 0.0) {
+            std::cout << "Safety factor needs to be >0." << std::endl;
             BOOST_THROW_EXCEPTION(OptionParserError());
         }
     }
@@ -71,76 +124,254 @@ po::variables_map parse_args(int ac, char** av) {
         }
     }
 
+    if (vm.count("store")) {
+        if (vm["store"].as<std::string>() != "leveldb" && vm["store"].as<std::string>() != "memory") {
+            std::cout << "Store needs to be leveldb or memory." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+        if (vm["store"].as<std::string>() == "memory"
+            && (!vm["bloom-load"].as<std::string>().empty() || !vm["bloom-save"].as<std::string>().empty())) {
+            std::cout << "The memory store has no bloom filter to load or save." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+        if (vm["store"].as<std::string>() != "memory" && vm["store-index"].as<bool>()) {
+            std::cout << "Only the memory store can keep chain positions." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+    }
+
+    if (vm.count("checkpoint-interval")) {
+        if (vm["checkpoint-interval"].as<size_t>() < 1) {
+            std::cout << "Checkpoint interval needs to be >0." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+    }
+
+    if (vm.count("filter")) {
+        if (vm["filter"].as<std::string>() != "bloom" && vm["filter"].as<std::string>() != "cuckoo") {
+            std::cout << "Filter needs to be bloom or cuckoo." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+        if (vm["filter"].as<std::string>() == "cuckoo" && vm["bloom-blocked"].as<bool>()) {
+            std::cout << "A cuckoo filter can't be blocked." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+    }
+
+    if (vm.count("sha-backend")) {
+        if (algo_backend_by_name(vm["algo"].as<std::string>(), vm["sha-backend"].as<std::string>()) < 0) {
+            std::cout << "Unknown or unsupported backend for this hash algorithm." << std::endl;
+            BOOST_THROW_EXCEPTION(OptionParserError());
+        }
+    }
+
     return vm;
 }
 
 
-int main(int ac, char** av) {
-    po::variables_map vm;
-    try {
-        vm = parse_args(ac, av);
-    } catch (OptionParserError) {
-        return 1;
+int algo_backend_by_name(const std::string &algo, const std::string &name) {
+#define ALGO_BACKEND_BY_NAME(Algo)          \
+    if (algo == Algo::name()) {             \
+        return Algo::backend_by_name(name); \
+    }
+    SHABANG_FOR_EACH_ALGO(ALGO_BACKEND_BY_NAME)
+#undef ALGO_BACKEND_BY_NAME
+    return -1;
+}
+
+
+size_t algo_digest_size(const std::string &name) {
+#define ALGO_DIGEST_SIZE(Algo)          \
+    if (name == Algo::name()) {         \
+        return Algo::digest_size;       \
     }
+    SHABANG_FOR_EACH_ALGO(ALGO_DIGEST_SIZE)
+#undef ALGO_DIGEST_SIZE
+    return 0;
+}
+
+
+/*
+ * Number of hashes expected until a collision of bitlen bit prefixes:
+ * by the birthday bound, about sqrt(pi/2 * 2^bitlen). That's also the
+ * expected length of the tail plus cycle of a single chain.
+ */
+static double expectedHashes(size_t bitlen) {
+    return 1.2533141373155 * std::pow(2.0, bitlen / 2.0);
+}
 
+
+/*
+ * False positives are the DB reads that didn't find the hash, out of all
+ * hashes (nearly all of which weren't in the filter yet).
+ */
+static void printFilterStats(const SearchStats &stats, double bloom_prob) {
+    ull hashes = stats.hashes.load();
+    ull confirmed = stats.confirmed.load();
+    ull reads = stats.db_reads.load();
+    ull false_positives = reads - confirmed;
+
+    std::cout << stats.filter_hits.load() << " bloom filter hits, " << reads << " checked by DB, "
+              << confirmed << " confirmed, " << false_positives << " false positives (observed FP rate "
+              << (hashes ? static_cast<double>(false_positives) / hashes : 0.0) << ", configured " << bloom_prob << ")";
+}
+
+
+template <class Algo>
+int run(const po::variables_map &vm) {
     std::string seed = vm["seed"].as<std::string>();
     size_t bitlen = vm["bitlen"].as<size_t>();
     ull batch_size = vm["batch-size"].as<ull>();
     ull bloom_size = vm["bloom-size"].as<ull>();
     double bloom_prob = vm["bloom-prob"].as<double>();
+    double bloom_safety = vm["bloom-safety"].as<double>();
+    size_t progress = vm["progress"].as<size_t>();
+    int bloom_flags = (vm["bloom-blocked"].as<bool>() ? BLOOM_BLOCKED : 0)
+                      | (vm["bloom-pow2"].as<bool>() ? BLOOM_POW2 : 0)
+                      | (vm["bloom-hugepages"].as<bool>() ? BLOOM_HUGEPAGES : 0)
+                      | (vm["bloom-interleave"].as<bool>() ? BLOOM_INTERLEAVE : 0)
+                      | (vm["bloom-scalable"].as<bool>() ? BLOOM_SCALABLE : 0)
+                      | (vm["filter"].as<std::string>() == "cuckoo" ? BLOOM_CUCKOO : 0);
+    std::string bloom_load_path = vm["bloom-load"].as<std::string>();
+    std::string bloom_save_path = vm["bloom-save"].as<std::string>();
     std::string ldb_path = vm["ldb-path"].as<std::string>();
+    int sha_backend = Algo::backend_by_name(vm["sha-backend"].as<std::string>());
+    size_t chains = vm["chains"].as<size_t>();
+    bool memory = vm["store"].as<std::string>() == "memory";
+    size_t checkpoint_interval = vm["store-index"].as<bool>() ? vm["checkpoint-interval"].as<size_t>() : 0;
+
+    // pick the implementation before any hashing is done
+    Algo::set_backend(sha_backend);
+    if (!chains)
+        chains = Algo::lanes();
+    std::cout << "Using " << Algo::backend_name() << " " << Algo::name() << " backend." << std::endl;
 
     // queues
-    DbReqQueue dbq(batch_size);
+    DbReqQueue<Algo> dbq(batch_size);
     HasherResQueue hresq(1);
-    DbResQueue dbresq(1);
+    DbResQueue<Algo> dbresq(1);
 
-    // db setup
-    leveldb::DB* db;
+    // db setup, the memory store needs none
+    leveldb::DB* db = nullptr;
     leveldb::Options options;
-    options.create_if_missing = true;
-    options.error_if_exists = true;
-    leveldb::Status status = leveldb::DB::Open(options, ldb_path, &db);
-    if (!status.ok()) {
-        std::cout << "Failed to create LevelDB!" << std::endl;
-        return 1;
+    SearchStats stats;
+    boost::thread database;
+    if (!memory) {
+        options.create_if_missing = true;
+        // a loaded bloom filter goes with the database it was saved along with
+        options.error_if_exists = bloom_load_path.empty();
+        leveldb::Status status = leveldb::DB::Open(options, ldb_path, &db);
+        if (!status.ok()) {
+            std::cout << "Failed to create LevelDB!" << std::endl;
+            return 1;
+        }
+
+        // only the significant bytes of the hashes get stored, so a store
+        // only goes with the algorithm and bit length it was written for
+        if (bloom_load_path.empty()) {
+            if (!writeDbMeta(db, Algo::name(), bitlen).ok()) {
+                std::cout << "Failed to write to LevelDB!" << std::endl;
+                return 1;
+            }
+        } else if (!checkDbMeta(db, Algo::name(), bitlen)) {
+            std::cout << "LevelDB at " << ldb_path << " doesn't hold " << bitlen << " bit " << Algo::name() << " hashes!" << std::endl;
+            return 1;
+        }
+
+        // db thread
+        database = boost::thread(thread_database<Algo>, db, (bitlen + 7) / 8, &dbq, &dbresq, &stats);
     }
 
-    // db thread
-    boost::thread database(thread_database, db, &dbq, &dbresq);
+    if (!bloom_size && bloom_load_path.empty()) {
+        // capped far above any memory, just so the conversion is defined
+        double expected = expectedHashes(bitlen);
+        bloom_size = static_cast<ull>(std::min(bloom_safety * expected, 1e15)) + 1;
+        std::cout << (memory ? "Memory store" : "Bloom filter") << " sized for " << bloom_safety << " times the " << expected << " hashes expected until a collision." << std::endl;
+    }
 
-    // bloom setup
+    // memory store or bloom setup
+    std::unique_ptr<MemoryStore> store;
     struct bloom bloom;
-    std::cout << "Setting up bloom filter for up to " << bloom_size / 1e6 << "M elems @ " << bloom_prob <<  " FP probability." << std::endl;
-    if (bloom_init(&bloom, bloom_size, bloom_prob)) {
-        std::cout << "Failed to init bloom filter! Tried to allocate " << static_cast<double>(bloom.bytes) / 1024 / 1024 <<  " MB." << std::endl;
-        bloom_print(&bloom);
-        return 1;
+    if (memory) {
+        size_t len = (bitlen + 7) / 8;
+        // positions only go up to the number of hashes the store takes
+        size_t value_len = len;
+        if (checkpoint_interval)
+            value_len = indexBytes(MemoryStore::capacity_for(bloom_size) - 1);
+        std::cout << "Setting up memory store for up to " << bloom_size / 1e6 << "M hashes of " << len << " bytes and "
+                  << (checkpoint_interval ? "their chain positions" : "their preimages") << " of " << value_len << " bytes." << std::endl;
+        try {
+            store.reset(new MemoryStore(bloom_size, len, value_len));
+        } catch (std::bad_alloc &) {
+            std::cout << "Failed to allocate memory store!" << std::endl;
+            return 1;
+        }
+        std::cout << "Memory store using " << static_cast<double>(store->bytes()) / 1024 / 1024 << " MB." << std::endl;
+    } else if (!bloom_load_path.empty()) {
+        std::cout << "Loading bloom filter from " << bloom_load_path << "." << std::endl;
+        if (bloom_load(&bloom, bloom_load_path.c_str(), bloom_flags | BLOOM_MMAP)) {
+            std::cout << "Failed to load bloom filter!" << std::endl;
+            return 1;
+        }
+        std::cout << "Bloom filter holds " << bloom.added << " elements." << std::endl;
+    } else {
+        std::cout << "Setting up " << (bloom_flags & BLOOM_BLOCKED ? "blocked " : "") << (bloom_flags & BLOOM_CUCKOO ? "cuckoo" : "bloom") << " filter for up to " << bloom_size / 1e6 << "M elems @ " << bloom_prob <<  " FP probability." << std::endl;
+        if (bloom_init_flags(&bloom, bloom_size, bloom_prob, bloom_flags)) {
+            std::cout << "Failed to init bloom filter! Tried to allocate " << static_cast<double>(bloom.bytes) / 1024 / 1024 <<  " MB." << std::endl;
+            bloom_print(&bloom);
+            return 1;
+        }
     }
-    std::cout << "Bloom filter using " << static_cast<double>(bloom.bytes) / 1024 / 1024 <<  " MB (" << bloom.bpe << " bits per element)." << std::endl;
+    if (!memory)
+        std::cout << "Bloom filter using " << static_cast<double>(bloom.bytes) / 1024 / 1024 <<  " MB (" << bloom.bpe << " bits per element) in " << bloom_memory(&bloom) << "." << std::endl;
 
-    // seed setup
-    Hash seed_hash;
-    SHA256_Context ctx;
-    sha256_initialize(&ctx);
-    sha256_add_bytes(&ctx, seed.c_str(), seed.length());
-    sha256_calculate(&ctx, &seed_hash[0]);
-    trimHash(&seed_hash, bitlen);
+    // seed setup, the first chain starts from the seed itself and
+    // any further ones from the seed with the chain number appended
+    std::vector<Hash<Algo>> seed_hashes(chains);
+    for (size_t i = 0; i < chains; i++) {
+        std::string chain_seed = i ? seed + " " + std::to_string(i) : seed;
+        Algo::hash_string(chain_seed, &seed_hashes[i][0]);
+        trimHash(&seed_hashes[i], bitlen);
+    }
 
     std::cout << "Starting hasher thread with first " << bitlen << " bits of seed hash" << std::endl << "\t";
-    printHash(&seed_hash);
+    printHash(&seed_hashes[0]);
     std::cout << std::endl;
+    if (chains > 1)
+        std::cout << "...and " << chains - 1 << " more chains." << std::endl;
 
     // hasher thread
-    boost::thread hasher(thread_hasher, &seed_hash, bitlen, &bloom, &dbq, &hresq);
+    boost::thread hasher(thread_hasher<Algo>, &seed_hashes, bitlen, memory ? nullptr : &bloom, &dbq, &hresq, &stats, store.get(), checkpoint_interval, &dbresq);
 
-    // wait for db to confirm a collision
-    database.join();
+    // wait for db (or the hasher itself, with the memory store) to confirm
+    // a collision, meanwhile reporting progress
+    boost::thread &searcher = memory ? hasher : database;
+    if (progress) {
+        while (!searcher.try_join_for(boost::chrono::seconds(progress))) {
+            std::cout << "Progress: " << stats.hashes.load() << " hashes ("
+                      << 100 * stats.hashes.load() / expectedHashes(bitlen) << "% of expected), ";
+            if (memory)
+                std::cout << store->size() << " in memory store";
+            else
+                printFilterStats(stats, bloom_prob);
+            std::cout << "." << std::endl;
+        }
+    } else {
+        searcher.join();
+    }
     
     // print the collision
-    DbRes result;
+    DbRes<Algo> result;
     while (!dbresq.pop(result));
 
+    // ...unless the memory store ran full before there was one
+    if (!std::get<3>(result)) {
+        ull hashes;
+        while (!hresq.pop(hashes));
+        std::cout << "Memory store full after " << hashes << " hashes, without a collision! Give it a larger bloom-size." << std::endl;
+        return 1;
+    }
+
     if (std::get<0>(result) == std::get<1>(result)) {
         std::cout << "Found a hash cycle!" << std::endl;
         std::cout << "\t";
@@ -156,13 +387,33 @@ int main(int ac, char** av) {
         std::cout << std::endl << "DB confirmed collision in " << std::get<3>(result) << " queries." << std::endl;
     }
 
-    // stop hasher thread
-    std::cout << "Interrupting hasher thread..." << std::endl;
-    hasher.interrupt();
-    hasher.join();
+    // stop hasher thread (already done with the memory store)
+    if (hasher.joinable()) {
+        std::cout << "Interrupting hasher thread..." << std::endl;
+        hasher.interrupt();
+        hasher.join();
+    }
     ull hashes;
     while (!hresq.pop(hashes));
     std::cout << "Hasher thread processed " << hashes << " hashes." << std::endl;
+    if (memory) {
+        std::cout << "Memory store holds " << store->size() << " hashes, " << 100.0 * store->size() / store->capacity() << "% of its capacity." << std::endl;
+        return 0;
+    }
+    std::cout << "Filter stats: ";
+    printFilterStats(stats, bloom_prob);
+    std::cout << ", filled to " << 100.0 * bloom.added / bloom.entries << "%." << std::endl;
+    if (bloom_flags & BLOOM_SCALABLE) {
+        size_t bytes;
+        int filters = bloom_filters(&bloom, &bytes);
+        std::cout << "Bloom filter grew to " << filters << " filters using " << static_cast<double>(bytes) / 1024 / 1024 << " MB." << std::endl;
+    }
+
+    if (!bloom_save_path.empty()) {
+        std::cout << "Saving bloom filter to " << bloom_save_path << "." << std::endl;
+        if (bloom_save(&bloom, bloom_save_path.c_str()))
+            std::cout << "Failed to save bloom filter!" << std::endl;
+    }
 
     // cleanup    
     bloom_free(&bloom);
@@ -171,3 +422,24 @@ int main(int ac, char** av) {
 
     return 0;
 }
+
+
+int main(int ac, char** av) {
+    po::variables_map vm;
+    try {
+        vm = parse_args(ac, av);
+    } catch (OptionParserError) {
+        return 1;
+    }
+
+    // everything handling hashes is instantiated per algorithm
+    std::string algo = vm["algo"].as<std::string>();
+#define RUN_ALGO(Algo)                  \
+    if (algo == Algo::name()) {         \
+        return run<Algo>(vm);           \
+    }
+    SHABANG_FOR_EACH_ALGO(RUN_ALGO)
+#undef RUN_ALGO
+
+    return 1;
+}
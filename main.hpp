@@ -13,5 +13,7 @@ struct OptionParserError : public boost::exception, public std::runtime_error {
 
 
 boost::program_options::variables_map parse_args(int ac, char** av);
+int algo_backend_by_name(const std::string &algo, const std::string &name);
+size_t algo_digest_size(const std::string &name);
 
 #endif // SHABANG_MAIN_HPP_
@@ -0,0 +1,170 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "memory_store.hpp"
+
+
+// tags of free and of claimed but not yet written slots, all others have
+// the top bit set
+const uint8_t TAG_EMPTY = 0x00;
+const uint8_t TAG_BUSY = 0x01;
+
+// slots probed at once
+const size_t GROUP = 16;
+
+
+#ifdef __SSE2__
+// a group's tags read as two words, which may alias the tag bytes
+typedef uint64_t __attribute__((may_alias)) TagWord;
+#endif
+
+
+/*
+ * Bit masks of the slots of a group whose tag is tag, is empty and is
+ * busy, bit i standing for the i-th slot. Other threads claim and write
+ * tags meanwhile, so they're read by atomic loads only. With SSE2 those
+ * are two relaxed loads of the (16 byte aligned) group's 8 byte halves
+ * rather than a plain vector load, which the compiler could hoist out of
+ * the busy wait; x86 loads see every byte as a value stored to it.
+ */
+static inline void groupMasks(const uint8_t *group, uint8_t tag, unsigned *match, unsigned *empty, unsigned *busy) {
+#ifdef __SSE2__
+    const TagWord *words = reinterpret_cast<const TagWord *>(group);
+    __m128i tags = _mm_set_epi64x(static_cast<long long>(__atomic_load_n(words + 1, __ATOMIC_RELAXED)),
+                                  static_cast<long long>(__atomic_load_n(words, __ATOMIC_RELAXED)));
+    *match = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(static_cast<char>(tag)))));
+    *empty = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_setzero_si128())));
+    *busy = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8(TAG_BUSY))));
+#else
+    *match = *empty = *busy = 0;
+    for (size_t i = 0; i < GROUP; i++) {
+        uint8_t t = __atomic_load_n(group + i, __ATOMIC_RELAXED);
+        *match |= static_cast<unsigned>(t == tag) << i;
+        *empty |= static_cast<unsigned>(t == TAG_EMPTY) << i;
+        *busy |= static_cast<unsigned>(t == TAG_BUSY) << i;
+    }
+#endif
+}
+
+
+/*
+ * A power of two of slots, filled to at most 7/8 when holding the
+ * expected number of elements.
+ */
+static size_t slotsFor(size_t elements) {
+    size_t slots = GROUP;
+    while (slots / 8 * 7 < elements)
+        slots *= 2;
+    return slots;
+}
+
+
+MemoryStore::MemoryStore(size_t elements, size_t key_len, size_t value_len)
+: key_len(key_len), value_len(value_len), slots(slotsFor(elements)), max_size(capacity_for(elements)),
+  tags(nullptr), entries(nullptr), count(0) {
+
+    // calloc() gets large blocks as fresh zeroed pages from the kernel,
+    // they're only backed as they get touched (and aligns them to 16
+    // bytes, so every group of tags is aligned)
+    tags = static_cast<uint8_t *>(calloc(slots, 1));
+    entries = static_cast<uch *>(calloc(slots, key_len + value_len));
+    if (!tags || !entries) {
+        free(tags);
+        free(entries);
+        throw std::bad_alloc();
+    }
+}
+
+
+MemoryStore::~MemoryStore() {
+    free(tags);
+    free(entries);
+}
+
+
+bool MemoryStore::find_or_insert(const uch *key, const uch *value, uint64_t hash, uch *found) {
+    uint8_t tag = static_cast<uint8_t>((hash >> 57) | 0x80);
+    size_t pos = hash & (slots - 1) & ~(GROUP - 1);
+
+    for (;;) {
+        const uint8_t *group = tags + pos;
+        unsigned match, empty, busy;
+
+        // a slot being written might get the key, wait for it
+        do {
+            groupMasks(group, tag, &match, &empty, &busy);
+        } while (busy);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        for (; match; match &= match - 1) {
+            const uch *entry = entries + (pos + static_cast<size_t>(__builtin_ctz(match))) * (key_len + value_len);
+            if (!memcmp(entry, key, key_len)) {
+                memcpy(found, entry + key_len, value_len);
+                return true;
+            }
+        }
+
+        if (empty) {
+            size_t slot = pos + static_cast<size_t>(__builtin_ctz(empty));
+            uint8_t expected = TAG_EMPTY;
+
+            // taken by another thread in the meantime, look at the group again
+            if (!__atomic_compare_exchange_n(tags + slot, &expected, TAG_BUSY, false,
+                                             __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                continue;
+
+            if (__atomic_add_fetch(&count, 1, __ATOMIC_RELAXED) > max_size) {
+                __atomic_sub_fetch(&count, 1, __ATOMIC_RELAXED);
+                __atomic_store_n(tags + slot, TAG_EMPTY, __ATOMIC_RELEASE);
+                BOOST_THROW_EXCEPTION(MemoryStoreFull());
+            }
+
+            uch *entry = entries + slot * (key_len + value_len);
+            memcpy(entry, key, key_len);
+            memcpy(entry + key_len, value, value_len);
+            __atomic_store_n(tags + slot, tag, __ATOMIC_RELEASE);
+            return false;
+        }
+
+        // all taken, on to the next group
+        pos = (pos + GROUP) & (slots - 1);
+    }
+}
+
+
+void MemoryStore::prefetch(uint64_t hash) const {
+#ifdef __GNUC__
+    __builtin_prefetch(tags + (hash & (slots - 1) & ~(GROUP - 1)));
+#else
+    (void)hash;
+#endif
+}
+
+
+size_t MemoryStore::size() const {
+    return __atomic_load_n(&count, __ATOMIC_RELAXED);
+}
+
+
+size_t MemoryStore::capacity() const {
+    return max_size;
+}
+
+
+size_t MemoryStore::bytes() const {
+    return slots * (1 + key_len + value_len);
+}
+
+
+size_t MemoryStore::value_size() const {
+    return value_len;
+}
+
+
+// inserts beyond 15/16 of the slots get refused
+size_t MemoryStore::capacity_for(size_t elements) {
+    return slotsFor(elements) / 16 * 15;
+}
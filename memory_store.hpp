@@ -0,0 +1,69 @@
+#ifndef SHABANG_MEMORY_STORE_HPP_
+#define SHABANG_MEMORY_STORE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <boost/exception/all.hpp>
+#include "datatypes.hpp"
+
+
+/*
+ * Exception for when more hashes get inserted than the store was sized for.
+ */
+struct MemoryStoreFull : public boost::exception, public std::runtime_error {
+    MemoryStoreFull()
+    : std::runtime_error("The memory store is full, give it a larger size!")
+    {}
+};
+
+
+/*
+ * In-memory alternative to LevelDB: an open-addressing hash table of
+ * trimmed hashes (keys), stored as only the key_len bytes that can be
+ * non-zero, and values of value_len bytes (their trimmed preimages, or
+ * where they are in the chains). Sized once for a number of elements, it
+ * never grows.
+ *
+ * Every slot has a one byte tag in an array of their own: empty, busy
+ * (being written) or seven bits of the key's hash. Lookups probe groups of
+ * 16 tags at once (with SSE2 where available) and only compare the keys
+ * whose tag matches, so a lookup mostly costs one cache miss for the tags
+ * and one for the matching key. Several threads may insert at once, slots
+ * get claimed by compare-and-swap of their tag.
+ */
+class MemoryStore {
+public:
+    MemoryStore(size_t elements, size_t key_len, size_t value_len);
+    ~MemoryStore();
+
+    MemoryStore(const MemoryStore &) = delete;
+    MemoryStore &operator=(const MemoryStore &) = delete;
+
+    // Looks up key, whose hash (e.g. from bloomSeeds()) has to be uniformly
+    // distributed. If it's there, copies its value to found and returns
+    // true, otherwise inserts it with value. Throws MemoryStoreFull.
+    bool find_or_insert(const uch *key, const uch *value, uint64_t hash, uch *found);
+
+    // starts fetching the tags a lookup of hash probes first
+    void prefetch(uint64_t hash) const;
+
+    size_t size() const;
+    size_t capacity() const;
+    size_t bytes() const;
+    size_t value_size() const;
+
+    // capacity() of a store sized for elements
+    static size_t capacity_for(size_t elements);
+
+private:
+    size_t key_len;
+    size_t value_len;
+    size_t slots;
+    size_t max_size;
+    uint8_t *tags;
+    uch *entries;
+    size_t count;
+};
+
+#endif // SHABANG_MEMORY_STORE_HPP_
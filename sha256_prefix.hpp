@@ -0,0 +1,137 @@
+#ifndef SHABANG_SHA256_PREFIX_HPP_
+#define SHABANG_SHA256_PREFIX_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * Header-only SHA-256 of single-block messages whose bit length is known
+ * at compile time. With the length fixed, all words of the padded block
+ * past the message are constants, so after unrolling the compiler folds
+ * every part of the message schedule that depends only on them, as well
+ * as the digest words that aren't needed for a prefix of OutBits bits.
+ * Portable code only, the hardware backends of sha_digest are faster
+ * where they're available.
+ */
+
+constexpr uint32_t sha256PrefixK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+constexpr uint32_t sha256PrefixIV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+
+constexpr uint32_t sha256PrefixRotr(uint32_t x, unsigned n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+
+/*
+ * Word t of the block a message of Bits bits gets padded to, with all
+ * the message bits set to zero.
+ */
+template <size_t Bits>
+constexpr uint32_t sha256PrefixPad(size_t t) {
+    return (t == Bits / 32 ? uint32_t(0x80000000) >> (Bits % 32) : 0)
+         | (t == 15 ? uint32_t(Bits) : 0);
+}
+
+
+/*
+ * Loads word t of the message, only reading the bytes holding message
+ * bits and putting the padding in after the last one.
+ */
+template <size_t Bits>
+inline uint32_t sha256PrefixLoad(const unsigned char *in, size_t t) {
+    const size_t bytes = (Bits + 7) / 8;
+    uint32_t w = 0;
+
+    for (size_t i = 0; i < 4; i++)
+        if (4 * t + i < bytes)
+            w |= uint32_t(in[4 * t + i]) << (24 - 8 * i);
+
+    if (t == Bits / 32)
+        w = (w & ~(uint32_t(0xFFFFFFFF) >> (Bits % 32))) | sha256PrefixPad<Bits>(t);
+
+    return w;
+}
+
+
+// one round, with the variables renamed instead of moving them around;
+// from round 16 on the schedule is kept in a circular buffer of 16 words
+#define SHA256_PREFIX_ROUND(a, b, c, d, e, f, g, h, t)                            \
+    do {                                                                          \
+        if ((t) >= 16) {                                                          \
+            const uint32_t w2 = w[((t) - 2) & 15], w15 = w[((t) - 15) & 15];      \
+            w[(t) & 15] += (sha256PrefixRotr(w2, 17) ^ sha256PrefixRotr(w2, 19) ^ (w2 >> 10)) \
+                         + w[((t) - 7) & 15]                                      \
+                         + (sha256PrefixRotr(w15, 7) ^ sha256PrefixRotr(w15, 18) ^ (w15 >> 3)); \
+        }                                                                         \
+        h += (sha256PrefixRotr(e, 6) ^ sha256PrefixRotr(e, 11) ^ sha256PrefixRotr(e, 25)) \
+           + ((e & f) ^ (~e & g)) + sha256PrefixK[t] + w[(t) & 15];               \
+        d += h;                                                                   \
+        h += (sha256PrefixRotr(a, 2) ^ sha256PrefixRotr(a, 13) ^ sha256PrefixRotr(a, 22)) \
+           + ((a & b) ^ (a & c) ^ (b & c));                                       \
+    } while (0)
+
+#define SHA256_PREFIX_ROUND8(t)                                                   \
+    SHA256_PREFIX_ROUND(a, b, c, d, e, f, g, h, (t) + 0);                         \
+    SHA256_PREFIX_ROUND(h, a, b, c, d, e, f, g, (t) + 1);                         \
+    SHA256_PREFIX_ROUND(g, h, a, b, c, d, e, f, (t) + 2);                         \
+    SHA256_PREFIX_ROUND(f, g, h, a, b, c, d, e, (t) + 3);                         \
+    SHA256_PREFIX_ROUND(e, f, g, h, a, b, c, d, (t) + 4);                         \
+    SHA256_PREFIX_ROUND(d, e, f, g, h, a, b, c, (t) + 5);                         \
+    SHA256_PREFIX_ROUND(c, d, e, f, g, h, a, b, (t) + 6);                         \
+    SHA256_PREFIX_ROUND(b, c, d, e, f, g, h, a, (t) + 7)
+
+
+/*
+ * Hashes the first Bits bits of in, writing (at least) the first OutBits
+ * bits of the digest to out. Only whole 32-bit words of the digest are
+ * written, anything after the last one needed is left alone.
+ */
+template <size_t Bits, size_t OutBits = 256>
+inline void sha256Prefix(const unsigned char *in, unsigned char *out) {
+    static_assert(Bits <= 447, "message has to fit into a single block");
+    static_assert(OutBits <= 256, "digest has only 256 bits");
+
+    uint32_t w[16];
+    for (size_t t = 0; t < 16; t++)
+        w[t] = t < (Bits + 31) / 32 ? sha256PrefixLoad<Bits>(in, t) : sha256PrefixPad<Bits>(t);
+
+    uint32_t a = sha256PrefixIV[0], b = sha256PrefixIV[1], c = sha256PrefixIV[2], d = sha256PrefixIV[3];
+    uint32_t e = sha256PrefixIV[4], f = sha256PrefixIV[5], g = sha256PrefixIV[6], h = sha256PrefixIV[7];
+
+    SHA256_PREFIX_ROUND8(0);
+    SHA256_PREFIX_ROUND8(8);
+    SHA256_PREFIX_ROUND8(16);
+    SHA256_PREFIX_ROUND8(24);
+    SHA256_PREFIX_ROUND8(32);
+    SHA256_PREFIX_ROUND8(40);
+    SHA256_PREFIX_ROUND8(48);
+    SHA256_PREFIX_ROUND8(56);
+
+    const uint32_t state[8] = { a, b, c, d, e, f, g, h };
+    for (size_t i = 0; i < (OutBits + 31) / 32; i++) {
+        const uint32_t v = sha256PrefixIV[i] + state[i];
+        out[4 * i] = static_cast<unsigned char>(v >> 24);
+        out[4 * i + 1] = static_cast<unsigned char>(v >> 16);
+        out[4 * i + 2] = static_cast<unsigned char>(v >> 8);
+        out[4 * i + 3] = static_cast<unsigned char>(v);
+    }
+}
+
+#undef SHA256_PREFIX_ROUND8
+#undef SHA256_PREFIX_ROUND
+
+#endif // SHABANG_SHA256_PREFIX_HPP_
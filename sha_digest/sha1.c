@@ -50,6 +50,8 @@
 #define NEED_U64_LOW
 
 #include "sha1.h"
+#include "sha1_shani.h"
+#include "sha1_mb.h"
 
 /* Circular left rotation of 32-bit value 'val' left by 'bits' bits
    (assumes that 'bits' is always within range from 0 to 32) */
@@ -75,8 +77,38 @@ static const sha_u32 K[ ] = { 0x5a827999,
 
 /* Local functions */
 
+static void sha1_compress( sha_u32             * state,
+                           const unsigned char * buf );
 static void sha1_process_block( SHA1_Context * context );
 static void sha1_evaluate( SHA1_Context * context );
+static void sha1_pad_block( unsigned char         buf[ 64 ],
+                            const unsigned char * d,
+                            size_t                num_bits );
+static void sha1_store( const sha_u32 * state,
+                        unsigned char   digest[ SHA1_HASH_SIZE ] );
+static int sha1_oneblock_lanes( const void * const  * data,
+                                size_t                num_bits,
+                                unsigned char * const * digest,
+                                size_t                count );
+
+
+/* Most messages any backend compresses in parallel */
+
+#define MAX_LANES  8
+
+
+/* The selected backend and the block compression function it uses.
+   These only get changed by sha1_set_backend(), which has to be
+   called before any other threads start using this module. */
+
+static int sha1_backend = SHA1_BACKEND_PORTABLE;
+
+static void ( * compress_block )( sha_u32             * state,
+                                  const unsigned char * buf )
+                                                            = sha1_compress;
+
+static const char * const backend_names[ SHA1_BACKEND_COUNT ] =
+                                      { "auto", "portable", "shani", "avx2" };
 
 
 /*----------------------------------------------------------------*
@@ -140,12 +172,20 @@ sha1_add_bytes( SHA1_Context * context,
         if ( sha_u64_lt( context->count, sha_u64_set( 0, 8 * len ) ) )
              return context->error = SHA_DIGEST_INPUT_TOO_LONG;
 
-        memcpy( context->buf + context->index, data, len );
+        /* Whole blocks get compressed straight from the input instead
+           of being copied into the buffer first */
+
+        if ( len == 64 )
+            compress_block( context->H, data );
+        else
+        {
+            memcpy( context->buf + context->index, data, len );
+            if ( ( context->index += len ) == 64 )
+                sha1_process_block( context );
+        }
+
         data       = ( unsigned char * ) data + len;
         num_bytes -= len;
-
-        if ( ( context->index += len ) == 64 )
-            sha1_process_block( context );
     }
 
     return SHA_DIGEST_OK;
@@ -263,10 +303,6 @@ int
 sha1_calculate( SHA1_Context  * context,
                 unsigned char   digest[ SHA1_HASH_SIZE ] )
 {
-    size_t i,
-           j;
-
-
     if ( ! context || ! digest )
         return SHA_DIGEST_INVALID_ARG;
 
@@ -276,18 +312,299 @@ sha1_calculate( SHA1_Context  * context,
     if ( ! context->is_calculated )
         sha1_evaluate( context );
 
-    for ( i = j = 0; j < SHA1_HASH_SIZE; i++ )
+    sha1_store( context->H, digest );
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Calculates the hash of a message short enough to fit together
+ * with its padding into a single block (i.e. of not more than
+ * SHA1_ONEBLOCK_MAX_BITS bits) in one go, setting up the padded
+ * block directly instead of going through the buffering and bit
+ * counting of the functions for adding data.
+ *----------------------------------------------------------------*/
+
+int
+sha1_oneblock( const void    * data,
+               size_t          num_bits,
+               unsigned char   digest[ SHA1_HASH_SIZE ] )
+{
+    unsigned char buf[ 64 ];
+    sha_u32       state[ 5 ];
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( num_bits > SHA1_ONEBLOCK_MAX_BITS )
+        return SHA_DIGEST_INPUT_TOO_LONG;
+
+    sha1_pad_block( buf, data, num_bits );
+
+    memcpy( state, H, sizeof H );
+    compress_block( state, buf );
+    sha1_store( state, digest );
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Like sha1_oneblock(), but for 'count' messages of the same
+ * length at once. With the AVX2 backend batches of 8 messages
+ * get compressed in parallel, so for best throughput 'count'
+ * should be a multiple of what sha1_lanes() returns.
+ *----------------------------------------------------------------*/
+
+int
+sha1_oneblock_multi( const void * const  * data,
+                     size_t                num_bits,
+                     unsigned char * const * digest,
+                     size_t                count )
+{
+    size_t n;
+    int    ret;
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    while ( count > 0 )
+    {
+        n = count > MAX_LANES ? MAX_LANES : count;
+
+        if ( ( ret = sha1_oneblock_lanes( data, num_bits, digest, n ) )
+                                                            != SHA_DIGEST_OK )
+            return ret;
+
+        data   += n;
+        digest += n;
+        count  -= n;
+    }
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns if a backend can be used on the machine we're running
+ *----------------------------------------------------------------*/
+
+int
+sha1_backend_available( int backend )
+{
+    switch ( backend )
+    {
+        case SHA1_BACKEND_AUTO :
+        case SHA1_BACKEND_PORTABLE :
+            return 1;
+
+#if defined SHA_CPU_X86
+        case SHA1_BACKEND_SHANI :
+            return ( sha_cpu_features( ) & SHA_CPU_SHANI ) != 0;
+
+        case SHA1_BACKEND_AVX2 :
+            return ( sha_cpu_features( ) & SHA_CPU_AVX2 ) != 0;
+#endif
+
+        default :
+            return 0;
+    }
+}
+
+
+/*----------------------------------------------------------------*
+ * Selects the implementation of the block compression used by all
+ * functions of this module, with SHA1_BACKEND_AUTO the fastest one
+ * the CPU supports gets picked. Not thread-safe, it must be called
+ * before any hashing is done by other threads.
+ *----------------------------------------------------------------*/
+
+int
+sha1_set_backend( int backend )
+{
+    /* In order of preference for the automatic selection: for batches
+       of messages the AVX2 kernel beats the SHA extensions, which then
+       still get used for single blocks */
+
+    static const int preferred[ ] = { SHA1_BACKEND_AVX2,
+                                      SHA1_BACKEND_SHANI,
+                                      SHA1_BACKEND_PORTABLE };
+    size_t i;
+
+
+    if ( backend == SHA1_BACKEND_AUTO )
+    {
+        for ( i = 0; ! sha1_backend_available( preferred[ i ] ); i++ )
+            /* empty */ ;
+        backend = preferred[ i ];
+    }
+    else if ( ! sha1_backend_available( backend ) )
+        return SHA_DIGEST_INVALID_ARG;
+
+    /* The multi-buffer backend only helps with several messages at
+       once, single blocks still get done with the best other code */
+
+#if defined SHA_CPU_X86
+    if ( backend != SHA1_BACKEND_PORTABLE
+         && ( sha_cpu_features( ) & SHA_CPU_SHANI ) )
+        compress_block = sha1_shani_compress;
+    else
+#endif
+        compress_block = sha1_compress;
+
+    sha1_backend = backend;
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns the currently used backend
+ *----------------------------------------------------------------*/
+
+int
+sha1_get_backend( void )
+{
+    return sha1_backend;
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns the name of a backend (or NULL for an invalid one)
+ *----------------------------------------------------------------*/
+
+const char *
+sha1_backend_name( int backend )
+{
+    if ( backend < 0 || backend >= SHA1_BACKEND_COUNT )
+        return NULL;
+
+    return backend_names[ backend ];
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns the number of messages the current backend compresses
+ * in parallel
+ *----------------------------------------------------------------*/
+
+size_t
+sha1_lanes( void )
+{
+    return sha1_backend == SHA1_BACKEND_AVX2 ? 8 : 1;
+}
+
+
+/*----------------------------------------------------------------*
+ * Hashes up to MAX_LANES single-block messages with the selected
+ * backend. The AVX2 kernel always works on all of its lanes, so
+ * for an incomplete batch the unused ones get filled with copies
+ * of the first message, unless less than half of them would be
+ * used, then it's faster to compress the blocks one by one.
+ *----------------------------------------------------------------*/
+
+static int
+sha1_oneblock_lanes( const void * const  * data,
+                     size_t                num_bits,
+                     unsigned char * const * digest,
+                     size_t                count )
+{
+    unsigned char buf[ MAX_LANES ][ 64 ];
+    sha_u32       state[ MAX_LANES ][ 5 ];
+    size_t        i;
+
+
+    if ( num_bits > SHA1_ONEBLOCK_MAX_BITS )
+        return SHA_DIGEST_INPUT_TOO_LONG;
+
+    for ( i = 0; i < count; i++ )
     {
-        digest[ j++ ] = context->H[ i ] >> 24;
-        digest[ j++ ] = context->H[ i ] >> 16;
-        digest[ j++ ] = context->H[ i ] >>  8;
-        digest[ j++ ] = context->H[ i ];
+        if ( ! data[ i ] || ! digest[ i ] )
+            return SHA_DIGEST_INVALID_ARG;
+
+        sha1_pad_block( buf[ i ], data[ i ], num_bits );
+        memcpy( state[ i ], H, sizeof H );
     }
 
+#if defined SHA_CPU_X86
+    if ( sha1_backend == SHA1_BACKEND_AVX2 && 2 * count >= MAX_LANES )
+    {
+        for ( i = count; i < MAX_LANES; i++ )
+        {
+            memcpy( buf[ i ], buf[ 0 ], 64 );
+            memcpy( state[ i ], H, sizeof H );
+        }
+
+        sha1_avx2_compress_x8( state, ( const unsigned char ( * )[ 64 ] ) buf );
+    }
+    else
+#endif
+        for ( i = 0; i < count; i++ )
+            compress_block( state[ i ], buf[ i ] );
+
+    for ( i = 0; i < count; i++ )
+        sha1_store( state[ i ], digest[ i ] );
+
     return SHA_DIGEST_OK;
 }
 
 
+/*----------------------------------------------------------------*
+ * Sets up the padded block for a message of at most
+ * SHA1_ONEBLOCK_MAX_BITS bits: the message is followed by the
+ * single set bit and 0 up to the bit count, which never needs
+ * more than the last two bytes. For a number of bits that isn't
+ * a multiple of 8 the remaining bits are taken from the highest
+ * bits of the last byte, as with sha1_add_bits().
+ *----------------------------------------------------------------*/
+
+static void
+sha1_pad_block( unsigned char         buf[ 64 ],
+                const unsigned char * d,
+                size_t                num_bits )
+{
+    size_t len = num_bits / 8,
+           rem = num_bits % 8;
+
+
+    memcpy( buf, d, len );
+
+    if ( rem == 0 )
+        buf[ len ] = 0x80;
+    else
+        buf[ len ] = ( SHA_T8( d[ len ] ) & SHA_T8( 0xFF << ( 8 - rem ) ) )
+                     | ( 0x80 >> rem );
+
+    memset( buf + len + 1, 0, 61 - len );
+    buf[ 62 ] = SHA_T8( num_bits >> 8 );
+    buf[ 63 ] = SHA_T8( num_bits );
+}
+
+
+/*----------------------------------------------------------------*
+ * Converts the hash state to the (big-endian) digest
+ *----------------------------------------------------------------*/
+
+static void
+sha1_store( const sha_u32 * state,
+            unsigned char   digest[ SHA1_HASH_SIZE ] )
+{
+    size_t i,
+           j;
+
+
+    for ( i = j = 0; j < SHA1_HASH_SIZE; i++ )
+    {
+        digest[ j++ ] = state[ i ] >> 24;
+        digest[ j++ ] = state[ i ] >> 16;
+        digest[ j++ ] = state[ i ] >>  8;
+        digest[ j++ ] = state[ i ];
+    }
+}
+
+
 /*----------------------------------------------------------------*
  * Central routine for calculating the hash value. See the FIPS
  * 180-3 standard p. 17f for a detailed explanation.
@@ -302,19 +619,19 @@ sha1_calculate( SHA1_Context  * context,
 #define f4  f2
 
 static void
-sha1_process_block( SHA1_Context * context )
+sha1_compress( sha_u32             * state,
+               const unsigned char * buf )
 {
     size_t         t;
     sha_u32        W[ 80 ];
     sha_u32        A, B, C, D, E, tmp;
-    unsigned char *buf = context->buf;
 
 
-    A = context->H[ 0 ];
-    B = context->H[ 1 ];
-    C = context->H[ 2 ];
-    D = context->H[ 3 ];
-    E = context->H[ 4 ];
+    A = state[ 0 ];
+    B = state[ 1 ];
+    C = state[ 2 ];
+    D = state[ 3 ];
+    E = state[ 4 ];
 
     for ( t = 0; t < 16; t++ )
     {
@@ -383,12 +700,23 @@ sha1_process_block( SHA1_Context * context )
         A = tmp;
     }
 
-    context->H[ 0 ] = SHA_T32( context->H[ 0 ] + A );
-    context->H[ 1 ] = SHA_T32( context->H[ 1 ] + B );
-    context->H[ 2 ] = SHA_T32( context->H[ 2 ] + C );
-    context->H[ 3 ] = SHA_T32( context->H[ 3 ] + D );
-    context->H[ 4 ] = SHA_T32( context->H[ 4 ] + E );
+    state[ 0 ] = SHA_T32( state[ 0 ] + A );
+    state[ 1 ] = SHA_T32( state[ 1 ] + B );
+    state[ 2 ] = SHA_T32( state[ 2 ] + C );
+    state[ 3 ] = SHA_T32( state[ 3 ] + D );
+    state[ 4 ] = SHA_T32( state[ 4 ] + E );
+}
+
+
+/*----------------------------------------------------------------*
+ * Processes the block in the context's buffer with the selected
+ * backend
+ *----------------------------------------------------------------*/
 
+static void
+sha1_process_block( SHA1_Context * context )
+{
+    compress_block( context->H, context->buf );
     context->index = 0;
 }
 
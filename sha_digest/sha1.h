@@ -55,6 +55,22 @@ extern "C" {
 #define SHA1_HASH_SIZE        20
 
 
+/* Longest message (in bits) that still fits together with its padding
+   into a single block and thus can be hashed by sha1_oneblock() */
+
+#define SHA1_ONEBLOCK_MAX_BITS    447
+
+
+/* Implementations of the block compression sha1_set_backend() can
+   select from (not all of them are available on every machine) */
+
+#define SHA1_BACKEND_AUTO         0
+#define SHA1_BACKEND_PORTABLE     1
+#define SHA1_BACKEND_SHANI        2
+#define SHA1_BACKEND_AVX2         3
+#define SHA1_BACKEND_COUNT        4
+
+
 #if ! defined SHA_DIGEST_OK
 #define SHA_DIGEST_OK               0
 #endif
@@ -92,6 +108,19 @@ int sha1_add_bits( SHA1_Context * context,
                    size_t         num_bits );
 int sha1_calculate( SHA1_Context  * context,
 					unsigned char   digest[ SHA1_HASH_SIZE ] );
+int sha1_oneblock( const void    * data,
+                   size_t          num_bits,
+                   unsigned char   digest[ SHA1_HASH_SIZE ] );
+int sha1_oneblock_multi( const void * const  * data,
+                         size_t                num_bits,
+                         unsigned char * const * digest,
+                         size_t                count );
+
+int sha1_set_backend( int backend );
+int sha1_get_backend( void );
+int sha1_backend_available( int backend );
+const char * sha1_backend_name( int backend );
+size_t sha1_lanes( void );
 
 #ifdef __cplusplus
 }
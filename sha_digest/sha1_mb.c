@@ -0,0 +1,143 @@
+/*
+ *  Multi-buffer SHA-1 block compression with AVX2 (8 lanes): the
+ *  rounds are the ones from FIPS 180-3, but every operation works
+ *  on one 32-bit word of each of the messages at once. Words of the
+ *  blocks and the hash states are gathered into the lanes with a
+ *  stride of the block resp. state size.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "sha1_mb.h"
+
+#if defined SHA_CPU_X86
+
+#include <immintrin.h>
+
+
+/* Constants required for hash calculation (see p. 11 of FIPS 180-3) */
+
+static const sha_u32 K[ ] = { 0x5a827999,
+                              0x6ed9eba1,
+                              0x8f1bbcdc,
+                              0xca62c1d6 };
+
+
+#define AVX2_TARGET  __attribute__( ( target( "avx2" ) ) )
+
+#define ADD( x, y )       _mm256_add_epi32( x, y )
+#define XOR( x, y )       _mm256_xor_si256( x, y )
+#define ROTL( x, n )      _mm256_or_si256( _mm256_slli_epi32( x, n ),       \
+                                           _mm256_srli_epi32( x, 32 - n ) )
+#define SET1( k )         _mm256_set1_epi32( ( int ) ( k ) )
+#define BSWAP( x )        _mm256_shuffle_epi8( x, bswap )
+#define GATHER( p, s )    _mm256_i32gather_epi32( ( const int * ) ( p ),   \
+                              _mm256_mullo_epi32( lane, _mm256_set1_epi32( s ) ), 4 )
+#define SCATTER( p, s, x )                                                 \
+    do {                                                                   \
+        sha_u32 v_[ 8 ];                                                   \
+        int     l_;                                                        \
+        _mm256_storeu_si256( ( __m256i * ) v_, x );                        \
+        for ( l_ = 0; l_ < 8; l_++ )                                       \
+            ( p )[ ( s ) * l_ ] = v_[ l_ ];                                \
+    } while ( 0 )
+
+
+/* The logic functions of the four groups of 20 rounds */
+
+#define F1( b, c, d )  XOR( d, _mm256_and_si256( b, XOR( c, d ) ) )
+#define F2( b, c, d )  XOR( XOR( b, c ), d )
+#define F3( b, c, d )  _mm256_or_si256( _mm256_and_si256( b, c ),          \
+                           _mm256_and_si256( d, _mm256_or_si256( b, c ) ) )
+#define F4             F2
+
+
+/* One round, W[ i ] holds message word t + i, mod 16 (from word 16
+   on it gets calculated from the previous ones in place) */
+
+#define ROUND( a, b, c, d, e, i, F, k )                                    \
+    do {                                                                   \
+        if ( t + i >= 16 )                                                 \
+            W[ ( t + i ) & 15 ] =                                          \
+                ROTL( XOR( XOR( W[ ( t + i + 13 ) & 15 ],                  \
+                                W[ ( t + i +  8 ) & 15 ] ),                \
+                           XOR( W[ ( t + i +  2 ) & 15 ],                  \
+                                W[ ( t + i      ) & 15 ] ) ), 1 );         \
+        e = ADD( ADD( e, ROTL( a, 5 ) ),                                   \
+                 ADD( F( b, c, d ), ADD( k, W[ ( t + i ) & 15 ] ) ) );     \
+        b = ROTL( b, 30 );                                                 \
+    } while ( 0 )
+
+/* 20 rounds, the state variables rotate by one each round, so after
+   five of them they're back in place */
+
+#define ROUNDS20( t0, F, n )                                               \
+    do {                                                                   \
+        k = SET1( K[ n ] );                                                \
+        for ( t = t0; t < t0 + 20; t += 5 )                                \
+        {                                                                  \
+            ROUND( A, B, C, D, E, 0, F, k );                               \
+            ROUND( E, A, B, C, D, 1, F, k );                               \
+            ROUND( D, E, A, B, C, 2, F, k );                               \
+            ROUND( C, D, E, A, B, 3, F, k );                               \
+            ROUND( B, C, D, E, A, 4, F, k );                               \
+        }                                                                  \
+    } while ( 0 )
+
+
+/*----------------------------------------------------------------*
+ *----------------------------------------------------------------*/
+
+AVX2_TARGET void
+sha1_avx2_compress_x8( sha_u32             state[ ][ 5 ],
+                       const unsigned char block[ ][ 64 ] )
+{
+    const __m256i lane  = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+    const __m256i bswap = _mm256_setr_epi8(
+                             3,  2,  1,  0,  7,  6,  5,  4,
+                            11, 10,  9,  8, 15, 14, 13, 12,
+                             3,  2,  1,  0,  7,  6,  5,  4,
+                            11, 10,  9,  8, 15, 14, 13, 12 );
+    __m256i S[ 5 ], W[ 16 ];
+    __m256i A, B, C, D, E, k;
+    int     i, t;
+
+
+    for ( i = 0; i < 5; i++ )
+        S[ i ] = GATHER( state[ 0 ] + i, 5 );
+
+    A = S[ 0 ]; B = S[ 1 ]; C = S[ 2 ]; D = S[ 3 ]; E = S[ 4 ];
+
+    for ( i = 0; i < 16; i++ )
+        W[ i ] = BSWAP( GATHER( ( const sha_u32 * ) block[ 0 ] + i, 16 ) );
+
+    ROUNDS20(  0, F1, 0 );
+    ROUNDS20( 20, F2, 1 );
+    ROUNDS20( 40, F3, 2 );
+    ROUNDS20( 60, F4, 3 );
+
+    S[ 0 ] = ADD( S[ 0 ], A ); S[ 1 ] = ADD( S[ 1 ], B );
+    S[ 2 ] = ADD( S[ 2 ], C ); S[ 3 ] = ADD( S[ 3 ], D );
+    S[ 4 ] = ADD( S[ 4 ], E );
+
+    for ( i = 0; i < 5; i++ )
+        SCATTER( state[ 0 ] + i, 5, S[ i ] );
+}
+
+#endif /* SHA_CPU_X86 */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
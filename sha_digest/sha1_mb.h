@@ -0,0 +1,53 @@
+/*
+ *  Multi-buffer SHA-1 block compression with AVX2, each 32-bit SIMD
+ *  lane working on a different message.
+ *
+ *  This function may only be called when sha_cpu_features() reports
+ *  SHA_CPU_AVX2, normally it's not used directly but via
+ *  sha1_oneblock_multi().
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#if ! defined SHA1_MB_HEADER_
+#define SHA1_MB_HEADER_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sha_types.h"
+#include "sha_cpu.h"
+
+
+#if defined SHA_CPU_X86
+
+/* Compresses 8 blocks (stored one after another) into as many hash
+   states (also stored one after another) */
+
+void sha1_avx2_compress_x8( sha_u32             state[ ][ 5 ],
+                            const unsigned char block[ ][ 64 ] );
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! SHA1_MB_HEADER_ */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,130 @@
+/*
+ *  SHA-1 block compression using the x86 SHA extensions (sha1rnds4,
+ *  sha1nexte, sha1msg1 and sha1msg2), see
+ *
+ *  https://software.intel.com/en-us/articles/intel-sha-extensions
+ *
+ *  A, B, C and D are kept in one register (A in the highest word),
+ *  E only in the highest word of a second one, where it gets added
+ *  to the message words. Each call of sha1rnds4 does four rounds,
+ *  sha1nexte derives E for the next four rounds from the A of four
+ *  rounds before. The message schedule is computed four words at a
+ *  time from the last 16 ones with the two message instructions and
+ *  a XOR.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "sha1_shani.h"
+
+#if defined SHA_CPU_X86
+
+#include <immintrin.h>
+
+
+#define SHANI_TARGET  __attribute__( ( target( "sha,sse4.1" ) ) )
+
+
+/*----------------------------------------------------------------*
+ *----------------------------------------------------------------*/
+
+SHANI_TARGET void
+sha1_shani_compress( sha_u32             * state,
+                     const unsigned char * block )
+{
+    const __m128i mask = _mm_set_epi64x( 0x0001020304050607LL,
+                                         0x08090a0b0c0d0e0fLL );
+    __m128i abcd, abcd_prev, e_prev;
+    __m128i E[ 2 ], W[ 4 ];
+    int     g;
+
+
+    abcd = _mm_shuffle_epi32(
+                 _mm_loadu_si128( ( const __m128i * ) state ), 0x1B );
+    E[ 0 ] = _mm_set_epi32( ( int ) state[ 4 ], 0, 0, 0 );
+
+    abcd_prev = abcd;
+    e_prev    = E[ 0 ];
+
+    /* Each iteration does four rounds. The message words for the next
+       group get finished with sha1msg2 and those for the ones after
+       that prepared with sha1msg1 and the XOR, as far as still needed.
+       E[ g & 1 ] holds E for the current group, the other one is set
+       to the state before the group, sha1nexte turns that into E for
+       the next one. The round function and constant change every 20
+       rounds, sha1rnds4 needs them as an immediate value. */
+
+#pragma GCC unroll 20
+    for ( g = 0; g < 20; g++ )
+    {
+        if ( g < 4 )
+            W[ g ] = _mm_shuffle_epi8(
+                _mm_loadu_si128( ( const __m128i * ) ( block + 16 * g ) ),
+                mask );
+
+        if ( g == 0 )
+            E[ 0 ] = _mm_add_epi32( E[ 0 ], W[ 0 ] );
+        else
+            E[ g & 1 ] = _mm_sha1nexte_epu32( E[ g & 1 ], W[ g & 3 ] );
+
+        if ( g >= 3 && g < 19 )
+            W[ ( g + 1 ) & 3 ] = _mm_sha1msg2_epu32( W[ ( g + 1 ) & 3 ],
+                                                     W[ g & 3 ] );
+
+        E[ ( g + 1 ) & 1 ] = abcd;
+
+        switch ( g / 5 )
+        {
+            case 0 :
+                abcd = _mm_sha1rnds4_epu32( abcd, E[ g & 1 ], 0 );
+                break;
+
+            case 1 :
+                abcd = _mm_sha1rnds4_epu32( abcd, E[ g & 1 ], 1 );
+                break;
+
+            case 2 :
+                abcd = _mm_sha1rnds4_epu32( abcd, E[ g & 1 ], 2 );
+                break;
+
+            default :
+                abcd = _mm_sha1rnds4_epu32( abcd, E[ g & 1 ], 3 );
+                break;
+        }
+
+        if ( g >= 1 && g < 17 )
+            W[ ( g + 3 ) & 3 ] = _mm_sha1msg1_epu32( W[ ( g + 3 ) & 3 ],
+                                                     W[ g & 3 ] );
+
+        if ( g >= 2 && g < 18 )
+            W[ ( g + 2 ) & 3 ] = _mm_xor_si128( W[ ( g + 2 ) & 3 ],
+                                                W[ g & 3 ] );
+    }
+
+    /* E is what the A before the last four rounds turns into, the
+       previous E gets added in the same go */
+
+    E[ 0 ] = _mm_sha1nexte_epu32( E[ 0 ], e_prev );
+    abcd   = _mm_add_epi32( abcd, abcd_prev );
+
+    _mm_storeu_si128( ( __m128i * ) state, _mm_shuffle_epi32( abcd, 0x1B ) );
+    state[ 4 ] = ( sha_u32 ) _mm_extract_epi32( E[ 0 ], 3 );
+}
+
+#endif /* SHA_CPU_X86 */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
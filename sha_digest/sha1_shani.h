@@ -0,0 +1,51 @@
+/*
+ *  SHA-1 block compression using the x86 SHA extensions.
+ *
+ *  This function may only be called when sha_cpu_features() reports
+ *  SHA_CPU_SHANI, normally it's not used directly but selected via
+ *  sha1_set_backend().
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#if ! defined SHA1_SHANI_HEADER_
+#define SHA1_SHANI_HEADER_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sha_types.h"
+#include "sha_cpu.h"
+
+
+#if defined SHA_CPU_X86
+
+/* Compresses a single 64 byte block into the hash state */
+
+void sha1_shani_compress( sha_u32             * state,
+                          const unsigned char * block );
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! SHA1_SHANI_HEADER_ */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
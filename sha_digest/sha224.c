@@ -145,6 +145,8 @@ static const sha_u32 K[ ] = { 0x428a2f98,
 
 /* Local functions */
 
+static void sha224_compress( sha_u32             * state,
+                             const unsigned char * buf );
 static void sha224_process_block( SHA224_Context * context );
 static void sha224_evaluate( SHA224_Context * context );
 
@@ -210,12 +212,20 @@ sha224_add_bytes( SHA224_Context * context,
         if ( sha_u64_lt( context->count, sha_u64_set( 0, 8 * len ) ) )
             return context->error = SHA_DIGEST_INPUT_TOO_LONG;
 
-        memcpy( context->buf + context->index, data, len );
+        /* Whole blocks get compressed straight from the input instead
+           of being copied into the buffer first */
+
+        if ( len == 64 )
+            sha224_compress( context->H, data );
+        else
+        {
+            memcpy( context->buf + context->index, data, len );
+            if ( ( context->index += len ) == 64 )
+                sha224_process_block( context );
+        }
+
         data       = ( unsigned char * ) data + len;
         num_bytes -= len;
-
-        if ( ( context->index += len ) == 64 )
-            sha224_process_block( context );
     }
 
     return SHA_DIGEST_OK;
@@ -358,6 +368,54 @@ sha224_calculate( SHA224_Context  * context,
 }
 
 
+/*----------------------------------------------------------------*
+ * Calculates the hash of a message short enough to fit together
+ * with its padding into a single block (i.e. of not more than
+ * SHA224_ONEBLOCK_MAX_BITS bits) in one go, setting up the padded
+ * block directly instead of going through the buffering and bit
+ * counting of the functions for adding data. The bit count then
+ * never needs more than the last two bytes of the block.
+ *----------------------------------------------------------------*/
+
+int
+sha224_oneblock( const void    * data,
+                 size_t          num_bits,
+                 unsigned char   digest[ SHA224_HASH_SIZE ] )
+{
+    SHA224_Context context;
+    const unsigned char *d = data;
+    size_t len = num_bits / 8,
+           rem = num_bits % 8;
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( num_bits > SHA224_ONEBLOCK_MAX_BITS )
+        return SHA_DIGEST_INPUT_TOO_LONG;
+
+    sha224_initialize( &context );
+
+    memcpy( context.buf, d, len );
+
+    if ( rem == 0 )
+        context.buf[ len ] = 0x80;
+    else
+        context.buf[ len ] =   ( SHA_T8( d[ len ] )
+                               & SHA_T8( 0xFF << ( 8 - rem ) ) )
+                             | ( 0x80 >> rem );
+
+    memset( context.buf + len + 1, 0, 61 - len );
+    context.buf[ 62 ] = SHA_T8( num_bits >> 8 );
+    context.buf[ 63 ] = SHA_T8( num_bits );
+
+    sha224_process_block( &context );
+    context.is_calculated = 1;
+
+    return sha224_calculate( &context, digest );
+}
+
+
 /*----------------------------------------------------------------*
  * Central routine for calculating the hash value. See the FIPS
  * 180-3 standard p. 21f for a detailed explanation.
@@ -376,22 +434,22 @@ sha224_calculate( SHA224_Context  * context,
 #define sig1( x )  ( ROTR( 17, x ) ^ ROTR( 19, x ) ^ SHR( 10, x ) )
 
 static void
-sha224_process_block( SHA224_Context * context )
+sha224_compress( sha_u32             * state,
+                 const unsigned char * buf )
 {
     size_t         t;
     sha_u32        W[ 64 ];
     sha_u32        A, B, C, D, E, F, G, H, tmp;
-    unsigned char *buf = context->buf;
 
 
-    A = context->H[ 0 ];
-    B = context->H[ 1 ];
-    C = context->H[ 2 ];
-    D = context->H[ 3 ];
-    E = context->H[ 4 ];
-    F = context->H[ 5 ];
-    G = context->H[ 6 ];
-    H = context->H[ 7 ];
+    A = state[ 0 ];
+    B = state[ 1 ];
+    C = state[ 2 ];
+    D = state[ 3 ];
+    E = state[ 4 ];
+    F = state[ 5 ];
+    G = state[ 6 ];
+    H = state[ 7 ];
 
     for ( t = 0; t < 16; t++ )
     {
@@ -427,15 +485,25 @@ sha224_process_block( SHA224_Context * context )
         A = SHA_T32( tmp + Sig0 + Maj );
     }
 
-    context->H[ 0 ] = SHA_T32( context->H[ 0 ] + A );
-    context->H[ 1 ] = SHA_T32( context->H[ 1 ] + B );
-    context->H[ 2 ] = SHA_T32( context->H[ 2 ] + C );
-    context->H[ 3 ] = SHA_T32( context->H[ 3 ] + D );
-    context->H[ 4 ] = SHA_T32( context->H[ 4 ] + E );
-    context->H[ 5 ] = SHA_T32( context->H[ 5 ] + F );
-    context->H[ 6 ] = SHA_T32( context->H[ 6 ] + G );
-    context->H[ 7 ] = SHA_T32( context->H[ 7 ] + H );
+    state[ 0 ] = SHA_T32( state[ 0 ] + A );
+    state[ 1 ] = SHA_T32( state[ 1 ] + B );
+    state[ 2 ] = SHA_T32( state[ 2 ] + C );
+    state[ 3 ] = SHA_T32( state[ 3 ] + D );
+    state[ 4 ] = SHA_T32( state[ 4 ] + E );
+    state[ 5 ] = SHA_T32( state[ 5 ] + F );
+    state[ 6 ] = SHA_T32( state[ 6 ] + G );
+    state[ 7 ] = SHA_T32( state[ 7 ] + H );
+}
+
 
+/*----------------------------------------------------------------*
+ * Processes the block in the context's buffer
+ *----------------------------------------------------------------*/
+
+static void
+sha224_process_block( SHA224_Context * context )
+{
+    sha224_compress( context->H, context->buf );
     context->index = 0;
 }
 
@@ -56,6 +56,12 @@ extern "C" {
 #define SHA224_HASH_SIZE        28
 
 
+/* Longest message (in bits) that still fits together with its padding
+   into a single block and thus can be hashed by sha224_oneblock() */
+
+#define SHA224_ONEBLOCK_MAX_BITS    447
+
+
 #if ! defined SHA_DIGEST_OK
 #define SHA_DIGEST_OK               0
 #endif
@@ -93,6 +99,9 @@ int sha224_add_bits( SHA224_Context * context,
                      size_t           num_bits );
 int sha224_calculate( SHA224_Context * context,
                       unsigned char    digest[ SHA224_HASH_SIZE ] );
+int sha224_oneblock( const void    * data,
+                     size_t          num_bits,
+                     unsigned char   digest[ SHA224_HASH_SIZE ] );
 
 #ifdef __cplusplus
 }
@@ -49,6 +49,8 @@
 #define NEED_U64_LOW
 
 #include "sha256.h"
+#include "sha256_shani.h"
+#include "sha256_mb.h"
 
 /* Circular right rotation of 32-bit value 'val' left by 'bits' bits
    (assumes that 'bits' is always within range from 0 to 32) */
@@ -144,8 +146,44 @@ static const sha_u32 K[ ] = { 0x428a2f98,
 
 /* Local functions */
 
+static void sha256_compress( sha_u32             * state,
+                             const unsigned char * buf );
 static void sha256_process_block( SHA256_Context * context );
 static void sha256_evaluate( SHA256_Context * context );
+static void sha256_pad_block( unsigned char         buf[ 64 ],
+                              const unsigned char * d,
+                              size_t                num_bits );
+static void sha256_store( const sha_u32 * state,
+                          unsigned char   digest[ SHA256_HASH_SIZE ] );
+static int sha256_oneblock_lanes( const void * const  * data,
+                                  size_t                num_bits,
+                                  unsigned char * const * digest,
+                                  size_t                count,
+                                  int                   backend );
+static void sha256_compress_lanes( sha_u32       state[ ][ 8 ],
+                                   unsigned char block[ ][ 64 ],
+                                   size_t        count,
+                                   int           backend );
+
+
+/* Most messages any backend compresses in parallel */
+
+#define MAX_LANES  16
+
+
+/* The selected backend and the block compression function it uses.
+   These only get changed by sha256_set_backend(), which has to be
+   called before any other threads start using this module. */
+
+static int sha256_backend = SHA256_BACKEND_PORTABLE;
+static unsigned int cpu_features = 0;
+
+static void ( * compress_block )( sha_u32             * state,
+                                  const unsigned char * buf )
+                                                            = sha256_compress;
+
+static const char * const backend_names[ SHA256_BACKEND_COUNT ] =
+                            { "auto", "portable", "shani", "avx2", "avx512" };
 
 
 /*----------------------------------------------------------------*
@@ -202,8 +240,6 @@ sha256_add_bytes( SHA256_Context * context,
         if ( context->index + len > 64 )
             len = 64 - context->index;
 
-        memcpy( context->buf + context->index, data, len );
-
         /* Increment bit count, abort on input of 2^64 or more bits */
 
         context->count = sha_u64_plus( context->count,
@@ -211,11 +247,20 @@ sha256_add_bytes( SHA256_Context * context,
         if ( sha_u64_lt( context->count, sha_u64_set( 0, 8 * len ) ) )
             return context->error = SHA_DIGEST_INPUT_TOO_LONG;
 
+        /* Whole blocks get compressed straight from the input instead
+           of being copied into the buffer first */
+
+        if ( len == 64 )
+            compress_block( context->H, data );
+        else
+        {
+            memcpy( context->buf + context->index, data, len );
+            if ( ( context->index += len ) == 64 )
+                sha256_process_block( context );
+        }
+
         data       = ( unsigned char * ) data + len;
         num_bytes -= len;
-
-        if ( ( context->index += len ) == 64 )
-            sha256_process_block( context );
     }
 
     return SHA_DIGEST_OK;
@@ -358,6 +403,409 @@ sha256_calculate( SHA256_Context  * context,
 }
 
 
+/*----------------------------------------------------------------*
+ * Calculates the hash of a message short enough to fit together
+ * with its padding into a single block (i.e. of not more than
+ * SHA256_ONEBLOCK_MAX_BITS bits) in one go. The padded block is
+ * set up directly, avoiding all the buffering and bit counting
+ * the context based functions need to do.
+ *----------------------------------------------------------------*/
+
+int
+sha256_oneblock( const void    * data,
+                 size_t          num_bits,
+                 unsigned char   digest[ SHA256_HASH_SIZE ] )
+{
+    unsigned char buf[ 64 ];
+    sha_u32       state[ 8 ];
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( num_bits > SHA256_ONEBLOCK_MAX_BITS )
+        return SHA_DIGEST_INPUT_TOO_LONG;
+
+    sha256_pad_block( buf, data, num_bits );
+
+    memcpy( state, H, sizeof H );
+    compress_block( state, buf );
+    sha256_store( state, digest );
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Like sha256_oneblock(), but for 'count' messages of the same
+ * length at once. Backends that can compress several independent
+ * blocks in parallel get handed as many of them as they can deal
+ * with in one go, so for best throughput 'count' should be a
+ * multiple of what sha256_lanes() returns.
+ *----------------------------------------------------------------*/
+
+int
+sha256_oneblock_multi( const void * const  * data,
+                       size_t                num_bits,
+                       unsigned char * const * digest,
+                       size_t                count )
+{
+    size_t lanes = sha256_lanes( ),
+           n;
+    int    ret;
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    while ( count > 0 )
+    {
+        n = count > lanes ? lanes : count;
+
+        if ( ( ret = sha256_oneblock_lanes( data, num_bits, digest, n,
+                                            sha256_backend ) )
+                                                            != SHA_DIGEST_OK )
+            return ret;
+
+        data   += n;
+        digest += n;
+        count  -= n;
+    }
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Hashes exactly 8 single-block messages of the same length with
+ * the AVX2 kernel, or, if the CPU doesn't support AVX2 (as found
+ * out by the last call of sha256_set_backend()), the selected
+ * backend.
+ *----------------------------------------------------------------*/
+
+int
+sha256_x8( const void * const  * data,
+           size_t                num_bits,
+           unsigned char * const * digest )
+{
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    return sha256_oneblock_lanes( data, num_bits, digest, 8,
+                                  cpu_features & SHA_CPU_AVX2 ?
+                                  SHA256_BACKEND_AVX2 : sha256_backend );
+}
+
+
+/*----------------------------------------------------------------*
+ * Hashes exactly 16 single-block messages of the same length with
+ * the AVX-512 kernel, falling back to the AVX2 kernel resp. the
+ * selected backend if not supported by the CPU.
+ *----------------------------------------------------------------*/
+
+int
+sha256_x16( const void * const  * data,
+            size_t                num_bits,
+            unsigned char * const * digest )
+{
+    int backend = sha256_backend;
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( cpu_features & SHA_CPU_AVX512 )
+        backend = SHA256_BACKEND_AVX512;
+    else if ( cpu_features & SHA_CPU_AVX2 )
+        backend = SHA256_BACKEND_AVX2;
+
+    return sha256_oneblock_lanes( data, num_bits, digest, 16, backend );
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns if a backend can be used on the machine we're running
+ *----------------------------------------------------------------*/
+
+int
+sha256_backend_available( int backend )
+{
+    switch ( backend )
+    {
+        case SHA256_BACKEND_AUTO :
+        case SHA256_BACKEND_PORTABLE :
+            return 1;
+
+#if defined SHA_CPU_X86
+        case SHA256_BACKEND_SHANI :
+            return ( sha_cpu_features( ) & SHA_CPU_SHANI ) != 0;
+
+        case SHA256_BACKEND_AVX2 :
+            return ( sha_cpu_features( ) & SHA_CPU_AVX2 ) != 0;
+
+        case SHA256_BACKEND_AVX512 :
+            return ( sha_cpu_features( ) & SHA_CPU_AVX512 ) != 0;
+#endif
+
+        default :
+            return 0;
+    }
+}
+
+
+/*----------------------------------------------------------------*
+ * Selects the implementation of the block compression used by all
+ * functions of this module, with SHA256_BACKEND_AUTO the fastest
+ * one the CPU supports gets picked. Not thread-safe, it must be
+ * called before any hashing is done by other threads.
+ *----------------------------------------------------------------*/
+
+int
+sha256_set_backend( int backend )
+{
+    /* In order of preference for the automatic selection */
+
+    static const int preferred[ ] = { SHA256_BACKEND_AVX512,
+                                      SHA256_BACKEND_SHANI,
+                                      SHA256_BACKEND_AVX2,
+                                      SHA256_BACKEND_PORTABLE };
+    size_t i;
+
+
+    if ( backend == SHA256_BACKEND_AUTO )
+    {
+        for ( i = 0; ! sha256_backend_available( preferred[ i ] ); i++ )
+            /* empty */ ;
+        backend = preferred[ i ];
+    }
+    else if ( ! sha256_backend_available( backend ) )
+        return SHA_DIGEST_INVALID_ARG;
+
+    cpu_features = sha_cpu_features( );
+
+    /* The multi-buffer backends only help with several messages at
+       once, single blocks still get done with the best other code */
+
+#if defined SHA_CPU_X86
+    if ( backend != SHA256_BACKEND_PORTABLE
+         && ( cpu_features & SHA_CPU_SHANI ) )
+        compress_block = sha256_shani_compress;
+    else
+#endif
+        compress_block = sha256_compress;
+
+    sha256_backend = backend;
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns the currently used backend
+ *----------------------------------------------------------------*/
+
+int
+sha256_get_backend( void )
+{
+    return sha256_backend;
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns the name of a backend (or NULL for an invalid one)
+ *----------------------------------------------------------------*/
+
+const char *
+sha256_backend_name( int backend )
+{
+    if ( backend < 0 || backend >= SHA256_BACKEND_COUNT )
+        return NULL;
+
+    return backend_names[ backend ];
+}
+
+
+/*----------------------------------------------------------------*
+ * Returns the number of messages the current backend compresses
+ * in parallel. With the SHA extensions interleaving two messages
+ * hides most of the latency of the round instruction, with four
+ * the registers don't suffice anymore and it gets slower again.
+ *----------------------------------------------------------------*/
+
+size_t
+sha256_lanes( void )
+{
+    switch ( sha256_backend )
+    {
+        case SHA256_BACKEND_SHANI :
+            return 2;
+
+        case SHA256_BACKEND_AVX2 :
+            return 8;
+
+        case SHA256_BACKEND_AVX512 :
+            return 16;
+
+        default :
+            return 1;
+    }
+}
+
+
+/*----------------------------------------------------------------*
+ * Hashes up to MAX_LANES single-block messages with the given
+ * backend
+ *----------------------------------------------------------------*/
+
+static int
+sha256_oneblock_lanes( const void * const  * data,
+                       size_t                num_bits,
+                       unsigned char * const * digest,
+                       size_t                count,
+                       int                   backend )
+{
+    unsigned char buf[ MAX_LANES ][ 64 ];
+    sha_u32       state[ MAX_LANES ][ 8 ];
+    size_t        i;
+
+
+    if ( num_bits > SHA256_ONEBLOCK_MAX_BITS )
+        return SHA_DIGEST_INPUT_TOO_LONG;
+
+    for ( i = 0; i < count; i++ )
+    {
+        if ( ! data[ i ] || ! digest[ i ] )
+            return SHA_DIGEST_INVALID_ARG;
+
+        sha256_pad_block( buf[ i ], data[ i ], num_bits );
+        memcpy( state[ i ], H, sizeof H );
+    }
+
+    sha256_compress_lanes( state, buf, count, backend );
+
+    for ( i = 0; i < count; i++ )
+        sha256_store( state[ i ], digest[ i ] );
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Compresses up to MAX_LANES blocks into their hash states with
+ * the given backend. The multi-buffer kernels always work on all
+ * of their lanes, so for an incomplete last batch the unused ones
+ * get filled with copies of the first block and state (both arrays
+ * must thus be large enough for the complete batch). If less than
+ * half of the lanes would be used it's faster to compress the rest
+ * one by one.
+ *----------------------------------------------------------------*/
+
+static void
+sha256_compress_lanes( sha_u32       state[ ][ 8 ],
+                       unsigned char block[ ][ 64 ],
+                       size_t        count,
+                       int           backend )
+{
+    size_t i = 0;
+
+
+#if defined SHA_CPU_X86
+    if ( backend == SHA256_BACKEND_AVX2 || backend == SHA256_BACKEND_AVX512 )
+    {
+        size_t lanes = backend == SHA256_BACKEND_AVX2 ? 8 : 16,
+               j;
+
+        for ( ; i < count && 2 * ( count - i ) >= lanes; i += lanes )
+        {
+            for ( j = count; j < i + lanes; j++ )
+            {
+                memcpy( block[ j ], block[ 0 ], 64 );
+                memcpy( state[ j ], state[ 0 ], sizeof state[ 0 ] );
+            }
+
+            if ( lanes == 8 )
+                sha256_avx2_compress_x8( state + i,
+                           ( const unsigned char ( * )[ 64 ] ) block + i );
+            else
+                sha256_avx512_compress_x16( state + i,
+                           ( const unsigned char ( * )[ 64 ] ) block + i );
+        }
+
+        i = i > count ? count : i;
+    }
+
+    if ( backend == SHA256_BACKEND_SHANI )
+        for ( ; i + 2 <= count; i += 2 )
+        {
+            sha_u32             *sp[ 2 ];
+            const unsigned char *bp[ 2 ];
+
+            sp[ 0 ] = state[ i ];
+            sp[ 1 ] = state[ i + 1 ];
+            bp[ 0 ] = block[ i ];
+            bp[ 1 ] = block[ i + 1 ];
+            sha256_shani_compress_x2( sp, bp );
+        }
+#endif
+
+    for ( ; i < count; i++ )
+        compress_block( state[ i ], block[ i ] );
+}
+
+
+/*----------------------------------------------------------------*
+ * Sets up the padded block for a message of at most
+ * SHA256_ONEBLOCK_MAX_BITS bits: the message is followed by the
+ * single set bit and 0 up to the bit count, which never needs
+ * more than the last two bytes. For a number of bits that isn't
+ * a multiple of 8 the remaining bits are taken from the highest
+ * bits of the last byte, as with sha256_add_bits().
+ *----------------------------------------------------------------*/
+
+static void
+sha256_pad_block( unsigned char         buf[ 64 ],
+                  const unsigned char * d,
+                  size_t                num_bits )
+{
+    size_t len = num_bits / 8,
+           rem = num_bits % 8;
+
+
+    memcpy( buf, d, len );
+
+    if ( rem == 0 )
+        buf[ len ] = 0x80;
+    else
+        buf[ len ] = ( SHA_T8( d[ len ] ) & SHA_T8( 0xFF << ( 8 - rem ) ) )
+                     | ( 0x80 >> rem );
+
+    memset( buf + len + 1, 0, 61 - len );
+    buf[ 62 ] = SHA_T8( num_bits >> 8 );
+    buf[ 63 ] = SHA_T8( num_bits );
+}
+
+
+/*----------------------------------------------------------------*
+ * Converts the hash state to the (big-endian) digest
+ *----------------------------------------------------------------*/
+
+static void
+sha256_store( const sha_u32 * state,
+              unsigned char   digest[ SHA256_HASH_SIZE ] )
+{
+    size_t i,
+           j;
+
+
+    for ( i = j = 0; j < SHA256_HASH_SIZE; i++ )
+    {
+        digest[ j++ ] = state[ i ] >> 24;
+        digest[ j++ ] = state[ i ] >> 16;
+        digest[ j++ ] = state[ i ] >>  8;
+        digest[ j++ ] = state[ i ];
+    }
+}
+
+
 /*----------------------------------------------------------------*
  * Central routine for calculating the hash value. See the FIPS
  * 180-3 standard p. 21f for a detailed explanation.
@@ -376,22 +824,22 @@ sha256_calculate( SHA256_Context  * context,
 #define sig1( x )  ( ROTR( 17, x ) ^ ROTR( 19, x ) ^ SHR( 10, x ) )
 
 static void
-sha256_process_block( SHA256_Context * context )
+sha256_compress( sha_u32             * state,
+                 const unsigned char * buf )
 {
     size_t         t;
     sha_u32        W[ 64 ];
     sha_u32        A, B, C, D, E, F, G, H, tmp;
-    unsigned char *buf = context->buf;
 
 
-    A = context->H[ 0 ];
-    B = context->H[ 1 ];
-    C = context->H[ 2 ];
-    D = context->H[ 3 ];
-    E = context->H[ 4 ];
-    F = context->H[ 5 ];
-    G = context->H[ 6 ];
-    H = context->H[ 7 ];
+    A = state[ 0 ];
+    B = state[ 1 ];
+    C = state[ 2 ];
+    D = state[ 3 ];
+    E = state[ 4 ];
+    F = state[ 5 ];
+    G = state[ 6 ];
+    H = state[ 7 ];
 
     for ( t = 0; t < 16; t++ )
     {
@@ -427,15 +875,330 @@ sha256_process_block( SHA256_Context * context )
         A = SHA_T32( tmp + Sig0 + Maj );
     }
 
-    context->H[ 0 ] = SHA_T32( context->H[ 0 ] + A );
-    context->H[ 1 ] = SHA_T32( context->H[ 1 ] + B );
-    context->H[ 2 ] = SHA_T32( context->H[ 2 ] + C );
-    context->H[ 3 ] = SHA_T32( context->H[ 3 ] + D );
-    context->H[ 4 ] = SHA_T32( context->H[ 4 ] + E );
-    context->H[ 5 ] = SHA_T32( context->H[ 5 ] + F );
-    context->H[ 6 ] = SHA_T32( context->H[ 6 ] + G );
-    context->H[ 7 ] = SHA_T32( context->H[ 7 ] + H );
+    state[ 0 ] = SHA_T32( state[ 0 ] + A );
+    state[ 1 ] = SHA_T32( state[ 1 ] + B );
+    state[ 2 ] = SHA_T32( state[ 2 ] + C );
+    state[ 3 ] = SHA_T32( state[ 3 ] + D );
+    state[ 4 ] = SHA_T32( state[ 4 ] + E );
+    state[ 5 ] = SHA_T32( state[ 5 ] + F );
+    state[ 6 ] = SHA_T32( state[ 6 ] + G );
+    state[ 7 ] = SHA_T32( state[ 7 ] + H );
+}
+
+
+/*----------------------------------------------------------------*
+ * Sets up a plan for hashing single-block messages of 'num_bits'
+ * bits. Of the padded block only the first ceil(num_bits / 32)
+ * words depend on the message, the rest (the set bit following
+ * the message, the 0 and the bit count) is the same for all of
+ * them. Thus all message schedule words calculated only from these
+ * constant words can be precomputed, as well as the constant terms
+ * of the words that still vary, the sums of the round constants
+ * and the constant words and, since it starts from the initial
+ * hash value, everything of the first round except adding in the
+ * first message word.
+ * Only the first 'out_bits' bits of the digest are going to be of
+ * interest (e.g. when just a prefix of the hash gets compared),
+ * words of it after those aren't calculated nor stored.
+ *----------------------------------------------------------------*/
+
+int
+sha256_plan_init( SHA256_Plan * plan,
+                  size_t        num_bits,
+                  size_t        out_bits )
+{
+    static const unsigned char zero[ 56 ] = { 0 };
+    unsigned char buf[ 64 ];
+    unsigned char *b = buf;
+    int           varies[ 64 ];
+    size_t        t;
+
+
+    if ( ! plan )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( num_bits > SHA256_ONEBLOCK_MAX_BITS )
+        return SHA_DIGEST_INPUT_TOO_LONG;
+
+    if ( out_bits > 8 * SHA256_HASH_SIZE )
+        return SHA_DIGEST_INVALID_ARG;
+
+    plan->num_bits  = num_bits;
+    plan->out_words = ( out_bits + 31 ) / 32;
+    plan->words    = ( num_bits + 31 ) / 32;
+    plan->mask     = num_bits % 32 ?
+                     SHA_T32( 0xFFFFFFFFUL << ( 32 - num_bits % 32 ) ) :
+                     0xFFFFFFFFUL;
+
+    /* Padding an all-zero message leaves just the constant bits */
+
+    sha256_pad_block( buf, zero, num_bits );
+
+    for ( t = 0; t < 16; t++ )
+    {
+        plan->W[ t ]  = SHA_T8L( *b++ ) << 24;
+        plan->W[ t ] |= SHA_T8L( *b++ ) << 16;
+        plan->W[ t ] |= SHA_T8L( *b++ ) <<  8;
+        plan->W[ t ] |= SHA_T8L( *b++ );
+
+        plan->vary[ t ] = 0;
+        varies[ t ]     = t < plan->words;
+    }
+
+    /* For the later words record which of the four terms they're
+       calculated from vary and sum up the ones that don't */
+
+    for ( ; t < 64; t++ )
+    {
+        plan->vary[ t ] =   ( varies[ t -  2 ] ? SHA256_PLAN_SIG1 : 0 )
+                          | ( varies[ t -  7 ] ? SHA256_PLAN_W7   : 0 )
+                          | ( varies[ t - 15 ] ? SHA256_PLAN_SIG0 : 0 )
+                          | ( varies[ t - 16 ] ? SHA256_PLAN_W16  : 0 );
+        varies[ t ] = plan->vary[ t ] != 0;
+
+        plan->W[ t ] = 0;
+        if ( ! varies[ t - 2 ] )
+            plan->W[ t ] += sig1( plan->W[ t - 2 ] );
+        if ( ! varies[ t - 7 ] )
+            plan->W[ t ] += plan->W[ t - 7 ];
+        if ( ! varies[ t - 15 ] )
+            plan->W[ t ] += sig0( plan->W[ t - 15 ] );
+        if ( ! varies[ t - 16 ] )
+            plan->W[ t ] += plan->W[ t - 16 ];
+        plan->W[ t ] = SHA_T32( plan->W[ t ] );
+    }
+
+    for ( t = 0; t < 64; t++ )
+        plan->KW[ t ] = SHA_T32( K[ t ] + plan->W[ t ] );
+
+    /* From where on all words are calculated from varying ones only
+       (the last one is always dealt with on its own) */
+
+    for ( plan->full = 63; plan->full > 16; plan->full-- )
+        if (    plan->vary[ plan->full - 1 ]
+             != (   SHA256_PLAN_SIG1 | SHA256_PLAN_W7
+                  | SHA256_PLAN_SIG0 | SHA256_PLAN_W16 ) )
+            break;
+
+    /* The first round without its message word, starting from the
+       initial hash value (the local variables needed by the macros
+       for the round functions shadow the array with that value) */
+
+    {
+        const sha_u32 *iv = H;
+        sha_u32        A = iv[ 0 ], B = iv[ 1 ], C = iv[ 2 ], D = iv[ 3 ],
+                       E = iv[ 4 ], F = iv[ 5 ], G = iv[ 6 ], H = iv[ 7 ];
+
+        plan->T1 = SHA_T32( H + Sig1 + Ch + K[ 0 ] );
+
+        D = C;
+        C = B;
+        B = A;
+        plan->T2 = SHA_T32( Sig0 + Maj );
+    }
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Hashes a message of the length the plan was set up for. With
+ * the portable backend the precomputed parts of the block and the
+ * message schedule get used and only the 32-bit words of the digest
+ * holding the requested output bits are written. The other backends
+ * compute the whole block anyway and it's handed to them as by
+ * sha256_oneblock(), so they store the complete digest.
+ *----------------------------------------------------------------*/
+
+int
+sha256_plan_hash( const SHA256_Plan * plan,
+                  const void        * data,
+                  unsigned char       digest[ SHA256_HASH_SIZE ] )
+{
+    const sha_u32       *iv = H;
+    const unsigned char *d = data;
+    size_t               t,
+                         words;
+    sha_u32              W[ 64 ];
+    sha_u32              A, B, C, D, E, F, G, H, tmp;
+
+
+    if ( ! plan || ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( sha256_backend != SHA256_BACKEND_PORTABLE )
+        return sha256_oneblock( data, plan->num_bits, digest );
+
+    /* The varying words, of the last one only the bytes holding bits
+       of the message may be read. The constant words aren't needed,
+       they only enter the schedule via the precomputed sums. */
+
+    words = plan->words;
+
+    for ( t = 0; t + 1 < words; t++, d += 4 )
+        W[ t ] =   ( SHA_T8L( d[ 0 ] ) << 24 ) | ( SHA_T8L( d[ 1 ] ) << 16 )
+                 | ( SHA_T8L( d[ 2 ] ) <<  8 ) |   SHA_T8L( d[ 3 ] );
+
+    if ( words > 0 )
+    {
+        size_t n = ( plan->num_bits + 7 ) / 8 - 4 * t,
+               i;
+
+        for ( W[ t ] = 0, i = 0; i < n; i++ )
+            W[ t ] |= SHA_T8L( d[ i ] ) << ( 24 - 8 * i );
+        W[ t ] = ( W[ t ] & plan->mask ) | plan->W[ t ];
+    }
+
+#define PLAN_ROUND( kw )                                    \
+    do {                                                    \
+        tmp = SHA_T32( H + Sig1 + Ch + ( kw ) );            \
+        H = G;                                              \
+        G = F;                                              \
+        F = E;                                              \
+        E = SHA_T32( D + tmp );                             \
+        D = C;                                              \
+        C = B;                                              \
+        B = A;                                              \
+        A = SHA_T32( tmp + Sig0 + Maj );                    \
+    } while ( 0 )
+
+    /* Only the message word needs to be added in for the first round
+       (which is constant, too, for an empty message) */
+
+    tmp = SHA_T32( plan->T1 + ( words ? W[ 0 ] : plan->W[ 0 ] ) );
+    H = iv[ 6 ];
+    G = iv[ 5 ];
+    F = iv[ 4 ];
+    E = SHA_T32( iv[ 3 ] + tmp );
+    D = iv[ 2 ];
+    C = iv[ 1 ];
+    B = iv[ 0 ];
+    A = SHA_T32( tmp + plan->T2 );
+
+    for ( t = 1; t < words; t++ )
+        PLAN_ROUND( K[ t ] + W[ t ] );
+
+    for ( ; t < 16; t++ )
+        PLAN_ROUND( plan->KW[ t ] );
+
+    /* Of the following words only the varying terms get added to the
+       precomputed sum of the constant ones, until all of them vary */
+
+#define PLAN_WORD( t )                                      \
+    do {                                                    \
+        W[ t ] = plan->W[ t ];                              \
+        if ( plan->vary[ t ] & SHA256_PLAN_SIG1 )           \
+            W[ t ] += sig1( W[ t - 2 ] );                   \
+        if ( plan->vary[ t ] & SHA256_PLAN_W7 )             \
+            W[ t ] += W[ t - 7 ];                           \
+        if ( plan->vary[ t ] & SHA256_PLAN_SIG0 )           \
+            W[ t ] += sig0( W[ t - 15 ] );                  \
+        if ( plan->vary[ t ] & SHA256_PLAN_W16 )            \
+            W[ t ] += W[ t - 16 ];                          \
+        W[ t ] = SHA_T32( W[ t ] );                         \
+    } while ( 0 )
+
+    for ( ; t < plan->full; t++ )
+    {
+        if ( ! plan->vary[ t ] )
+        {
+            PLAN_ROUND( plan->KW[ t ] );
+            continue;
+        }
+
+        PLAN_WORD( t );
+        PLAN_ROUND( K[ t ] + W[ t ] );
+    }
+
+    for ( ; t < 63; t++ )
+    {
+        W[ t ] = SHA_T32(   sig1( W[ t -  2 ] ) + W[ t -  7 ]
+                          + sig0( W[ t - 15 ] ) + W[ t - 16 ] );
+        PLAN_ROUND( K[ t ] + W[ t ] );
+    }
+
+    /* The new value of E from the last round only ends up in the
+       second half of the digest, skip it when that's not needed */
+
+    PLAN_WORD( 63 );
+
+    if ( plan->out_words > 4 )
+        PLAN_ROUND( K[ 63 ] + W[ 63 ] );
+    else
+    {
+        tmp = SHA_T32( H + Sig1 + Ch + K[ 63 ] + W[ 63 ] );
+        D = C;
+        C = B;
+        B = A;
+        A = SHA_T32( tmp + Sig0 + Maj );
+    }
+
+#undef PLAN_WORD
+#undef PLAN_ROUND
+
+    /* Just the words of the digest that were asked for */
+
+    W[ 0 ] = A;
+    W[ 1 ] = B;
+    W[ 2 ] = C;
+    W[ 3 ] = D;
+    W[ 4 ] = E;
+    W[ 5 ] = F;
+    W[ 6 ] = G;
+    W[ 7 ] = H;
+
+    for ( t = 0; t < plan->out_words; t++, digest += 4 )
+    {
+        W[ t ] = SHA_T32( iv[ t ] + W[ t ] );
+        digest[ 0 ] = W[ t ] >> 24;
+        digest[ 1 ] = W[ t ] >> 16;
+        digest[ 2 ] = W[ t ] >>  8;
+        digest[ 3 ] = W[ t ];
+    }
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Like sha256_plan_hash(), but for 'count' messages at once, for
+ * backends other than the portable one this is the same as using
+ * sha256_oneblock_multi().
+ *----------------------------------------------------------------*/
+
+int
+sha256_plan_hash_multi( const SHA256_Plan   * plan,
+                        const void * const  * data,
+                        unsigned char * const * digest,
+                        size_t                count )
+{
+    size_t i;
+    int    ret;
+
+
+    if ( ! plan || ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( sha256_backend != SHA256_BACKEND_PORTABLE )
+        return sha256_oneblock_multi( data, plan->num_bits, digest, count );
+
+    for ( i = 0; i < count; i++ )
+        if ( ( ret = sha256_plan_hash( plan, data[ i ], digest[ i ] ) )
+                                                            != SHA_DIGEST_OK )
+            return ret;
+
+    return SHA_DIGEST_OK;
+}
+
+
+/*----------------------------------------------------------------*
+ * Processes the 512 bit block in the context's buffer
+ *----------------------------------------------------------------*/
 
+static void
+sha256_process_block( SHA256_Context * context )
+{
+    compress_block( context->H, context->buf );
     context->index = 0;
 }
 
@@ -55,6 +55,22 @@ extern "C" {
 
 #define SHA256_HASH_SIZE        32
 
+/* Longest message (in bits) that still fits together with its padding
+   into a single block and thus can be hashed by sha256_oneblock() */
+
+#define SHA256_ONEBLOCK_MAX_BITS    447
+
+
+/* Implementations of the block compression sha256_set_backend() can
+   select from (not all of them are available on every machine) */
+
+#define SHA256_BACKEND_AUTO         0
+#define SHA256_BACKEND_PORTABLE     1
+#define SHA256_BACKEND_SHANI        2
+#define SHA256_BACKEND_AVX2         3
+#define SHA256_BACKEND_AVX512       4
+#define SHA256_BACKEND_COUNT        5
+
 
 #if ! defined SHA_DIGEST_OK
 #define SHA_DIGEST_OK               0
@@ -81,6 +97,28 @@ typedef struct {
 } SHA256_Context;
 
 
+/* Precomputed data for hashing single-block messages of a fixed
+   length, see sha256_plan_init() */
+
+#define SHA256_PLAN_SIG1    0x01    /* flags for the terms of message  */
+#define SHA256_PLAN_W7      0x02    /* schedule words that depend on   */
+#define SHA256_PLAN_SIG0    0x04    /* the message: sig1(W[t-2]),      */
+#define SHA256_PLAN_W16     0x08    /* W[t-7], sig0(W[t-15]), W[t-16]  */
+
+typedef struct {
+    size_t        num_bits;
+    size_t        out_words;
+    size_t        words;
+    sha_u32       mask;
+    sha_u32       W[ 64 ];
+    sha_u32       KW[ 64 ];
+    unsigned char vary[ 64 ];
+    size_t        full;
+    sha_u32       T1;
+    sha_u32       T2;
+} SHA256_Plan;
+
+
 #define sha256_add_data sha256_add_bytes
 
 int sha256_initialize( SHA256_Context * context );
@@ -92,6 +130,36 @@ int sha256_add_bits( SHA256_Context * context,
                      size_t           num_bits );
 int sha256_calculate( SHA256_Context * context,
                       unsigned char    digest[ SHA256_HASH_SIZE ] );
+int sha256_oneblock( const void    * data,
+                     size_t          num_bits,
+                     unsigned char   digest[ SHA256_HASH_SIZE ] );
+int sha256_oneblock_multi( const void * const  * data,
+                           size_t                num_bits,
+                           unsigned char * const * digest,
+                           size_t                count );
+int sha256_x8( const void * const  * data,
+               size_t                num_bits,
+               unsigned char * const * digest );
+int sha256_x16( const void * const  * data,
+                size_t                num_bits,
+                unsigned char * const * digest );
+
+int sha256_plan_init( SHA256_Plan * plan,
+                      size_t        num_bits,
+                      size_t        out_bits );
+int sha256_plan_hash( const SHA256_Plan * plan,
+                      const void        * data,
+                      unsigned char       digest[ SHA256_HASH_SIZE ] );
+int sha256_plan_hash_multi( const SHA256_Plan   * plan,
+                            const void * const  * data,
+                            unsigned char * const * digest,
+                            size_t                count );
+
+int sha256_set_backend( int backend );
+int sha256_get_backend( void );
+int sha256_backend_available( int backend );
+const char * sha256_backend_name( int backend );
+size_t sha256_lanes( void );
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,223 @@
+/*
+ *  Multi-buffer SHA-256 block compression with AVX2 (8 lanes) and
+ *  AVX-512 (16 lanes): the rounds are the ones from FIPS 180-3, but
+ *  every operation works on one 32-bit word of each of the messages
+ *  at once. Words of the blocks and the hash states are gathered
+ *  into the lanes with a stride of the block resp. state size.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "sha256_mb.h"
+
+#if defined SHA_CPU_X86
+
+#include <immintrin.h>
+
+
+/* Constants required for hash calculation (see p. 11 of FIPS 180-3) */
+
+static const sha_u32 K[ ] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+
+/* The compression itself, written in terms of the vector operations
+   defined below separately for AVX2 and AVX-512 */
+
+#define Sig0( x )  XOR3( ROTR( x,  2 ), ROTR( x, 13 ), ROTR( x, 22 ) )
+#define Sig1( x )  XOR3( ROTR( x,  6 ), ROTR( x, 11 ), ROTR( x, 25 ) )
+#define sig0( x )  XOR3( ROTR( x,  7 ), ROTR( x, 18 ), SHR( x,  3 ) )
+#define sig1( x )  XOR3( ROTR( x, 17 ), ROTR( x, 19 ), SHR( x, 10 ) )
+
+#define ROUND( a, b, c, d, e, f, g, h, i )                                 \
+    do {                                                                   \
+        if ( t >= 16 )                                                     \
+            W[ i ] = ADD( ADD( sig1( W[ ( i + 14 ) & 15 ] ),               \
+                               W[ ( i + 9 ) & 15 ] ),                      \
+                          ADD( sig0( W[ ( i + 1 ) & 15 ] ), W[ i ] ) );    \
+        tmp = ADD( ADD( ADD( h, Sig1( e ) ), CH( e, f, g ) ),              \
+                   ADD( SET1( K[ t + i ] ), W[ i ] ) );                    \
+        d   = ADD( d, tmp );                                               \
+        h   = ADD( ADD( tmp, Sig0( a ) ), MAJ( a, b, c ) );                \
+    } while ( 0 )
+
+#define COMPRESS( state, block )                                           \
+    do {                                                                   \
+        for ( i = 0; i < 8; i++ )                                          \
+            S[ i ] = GATHER( state[ 0 ] + i, 8 );                          \
+                                                                           \
+        A = S[ 0 ]; B = S[ 1 ]; C = S[ 2 ]; D = S[ 3 ];                    \
+        E = S[ 4 ]; F = S[ 5 ]; G = S[ 6 ]; H = S[ 7 ];                    \
+                                                                           \
+        for ( i = 0; i < 16; i++ )                                         \
+            W[ i ] = BSWAP( GATHER( ( const sha_u32 * ) block[ 0 ] + i,    \
+                                    16 ) );                                \
+                                                                           \
+        /* W[ i ] holds message word t + i, mod 16 (t is a multiple of     \
+           16) and the state variables rotate by one each round */         \
+                                                                           \
+        for ( t = 0; t < 64; t += 16 )                                     \
+        {                                                                  \
+            ROUND( A, B, C, D, E, F, G, H,  0 );                           \
+            ROUND( H, A, B, C, D, E, F, G,  1 );                           \
+            ROUND( G, H, A, B, C, D, E, F,  2 );                           \
+            ROUND( F, G, H, A, B, C, D, E,  3 );                           \
+            ROUND( E, F, G, H, A, B, C, D,  4 );                           \
+            ROUND( D, E, F, G, H, A, B, C,  5 );                           \
+            ROUND( C, D, E, F, G, H, A, B,  6 );                           \
+            ROUND( B, C, D, E, F, G, H, A,  7 );                           \
+            ROUND( A, B, C, D, E, F, G, H,  8 );                           \
+            ROUND( H, A, B, C, D, E, F, G,  9 );                           \
+            ROUND( G, H, A, B, C, D, E, F, 10 );                           \
+            ROUND( F, G, H, A, B, C, D, E, 11 );                           \
+            ROUND( E, F, G, H, A, B, C, D, 12 );                           \
+            ROUND( D, E, F, G, H, A, B, C, 13 );                           \
+            ROUND( C, D, E, F, G, H, A, B, 14 );                           \
+            ROUND( B, C, D, E, F, G, H, A, 15 );                           \
+        }                                                                  \
+                                                                           \
+        S[ 0 ] = ADD( S[ 0 ], A ); S[ 1 ] = ADD( S[ 1 ], B );              \
+        S[ 2 ] = ADD( S[ 2 ], C ); S[ 3 ] = ADD( S[ 3 ], D );              \
+        S[ 4 ] = ADD( S[ 4 ], E ); S[ 5 ] = ADD( S[ 5 ], F );              \
+        S[ 6 ] = ADD( S[ 6 ], G ); S[ 7 ] = ADD( S[ 7 ], H );              \
+                                                                           \
+        for ( i = 0; i < 8; i++ )                                          \
+            SCATTER( state[ 0 ] + i, 8, S[ i ] );                          \
+    } while ( 0 )
+
+
+/*----------------------------------------------------------------*
+ * AVX2: 8 lanes, without rotate, ternary logic or scatter
+ * instructions
+ *----------------------------------------------------------------*/
+
+#define AVX2_TARGET  __attribute__( ( target( "avx2" ) ) )
+
+#define ADD( x, y )       _mm256_add_epi32( x, y )
+#define XOR3( x, y, z )   _mm256_xor_si256( _mm256_xor_si256( x, y ), z )
+#define ROTR( x, n )      _mm256_or_si256( _mm256_srli_epi32( x, n ),       \
+                                           _mm256_slli_epi32( x, 32 - n ) )
+#define SHR( x, n )       _mm256_srli_epi32( x, n )
+#define CH( e, f, g )     _mm256_xor_si256( _mm256_and_si256( e, f ),       \
+                                            _mm256_andnot_si256( e, g ) )
+#define MAJ( a, b, c )    _mm256_or_si256( _mm256_and_si256( a, b ),        \
+                              _mm256_and_si256( c, _mm256_or_si256( a, b ) ) )
+#define SET1( k )         _mm256_set1_epi32( ( int ) ( k ) )
+#define BSWAP( x )        _mm256_shuffle_epi8( x, bswap )
+#define GATHER( p, s )    _mm256_i32gather_epi32( ( const int * ) ( p ),   \
+                              _mm256_mullo_epi32( lane, _mm256_set1_epi32( s ) ), 4 )
+#define SCATTER( p, s, x )                                                 \
+    do {                                                                   \
+        sha_u32 v_[ 8 ];                                                   \
+        int     l_;                                                        \
+        _mm256_storeu_si256( ( __m256i * ) v_, x );                        \
+        for ( l_ = 0; l_ < 8; l_++ )                                       \
+            ( p )[ ( s ) * l_ ] = v_[ l_ ];                                \
+    } while ( 0 )
+
+AVX2_TARGET void
+sha256_avx2_compress_x8( sha_u32             state[ ][ 8 ],
+                         const unsigned char block[ ][ 64 ] )
+{
+    const __m256i lane  = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+    const __m256i bswap = _mm256_setr_epi8(
+                             3,  2,  1,  0,  7,  6,  5,  4,
+                            11, 10,  9,  8, 15, 14, 13, 12,
+                             3,  2,  1,  0,  7,  6,  5,  4,
+                            11, 10,  9,  8, 15, 14, 13, 12 );
+    __m256i S[ 8 ], W[ 16 ];
+    __m256i A, B, C, D, E, F, G, H, tmp;
+    int     i, t;
+
+
+    COMPRESS( state, block );
+}
+
+#undef ADD
+#undef XOR3
+#undef ROTR
+#undef SHR
+#undef CH
+#undef MAJ
+#undef SET1
+#undef BSWAP
+#undef GATHER
+#undef SCATTER
+
+
+/*----------------------------------------------------------------*
+ * AVX-512: 16 lanes, the logic functions can be done with single
+ * ternary logic instructions (the immediate values are the truth
+ * tables of the functions), the byte swap selects the bytes from
+ * the value rotated left and right by 8 bits
+ *----------------------------------------------------------------*/
+
+#define AVX512_TARGET  __attribute__( ( target( "avx512f" ) ) )
+
+#define ADD( x, y )       _mm512_add_epi32( x, y )
+#define XOR3( x, y, z )   _mm512_ternarylogic_epi32( x, y, z, 0x96 )
+#define ROTR( x, n )      _mm512_ror_epi32( x, n )
+#define SHR( x, n )       _mm512_srli_epi32( x, n )
+#define CH( e, f, g )     _mm512_ternarylogic_epi32( e, f, g, 0xCA )
+#define MAJ( a, b, c )    _mm512_ternarylogic_epi32( a, b, c, 0xE8 )
+#define SET1( k )         _mm512_set1_epi32( ( int ) ( k ) )
+#define BSWAP( x )        _mm512_ternarylogic_epi32(                        \
+                              _mm512_ror_epi32( x, 8 ),                     \
+                              _mm512_rol_epi32( x, 8 ),                     \
+                              _mm512_set1_epi32( 0x00FF00FF ), 0xD8 )
+#define GATHER( p, s )    _mm512_i32gather_epi32(                           \
+                              _mm512_mullo_epi32( lane,                     \
+                                                  _mm512_set1_epi32( s ) ), \
+                              ( const void * ) ( p ), 4 )
+#define SCATTER( p, s, x )                                                 \
+    _mm512_i32scatter_epi32( ( void * ) ( p ),                             \
+                             _mm512_mullo_epi32( lane,                     \
+                                                 _mm512_set1_epi32( s ) ), \
+                             x, 4 )
+
+AVX512_TARGET void
+sha256_avx512_compress_x16( sha_u32             state[ ][ 8 ],
+                            const unsigned char block[ ][ 64 ] )
+{
+    const __m512i lane = _mm512_setr_epi32( 0, 1, 2,  3,  4,  5,  6,  7,
+                                            8, 9, 10, 11, 12, 13, 14, 15 );
+    __m512i S[ 8 ], W[ 16 ];
+    __m512i A, B, C, D, E, F, G, H, tmp;
+    int     i, t;
+
+
+    COMPRESS( state, block );
+}
+
+#endif /* SHA_CPU_X86 */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
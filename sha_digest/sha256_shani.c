@@ -0,0 +1,189 @@
+/*
+ *  SHA-256 block compression using the x86 SHA extensions
+ *  (sha256rnds2, sha256msg1 and sha256msg2), see
+ *
+ *  https://software.intel.com/en-us/articles/intel-sha-extensions
+ *
+ *  The hash state is kept in two registers in the order the round
+ *  instruction expects (ABEF and CDGH), each call of sha256rnds2
+ *  does two rounds. The message schedule is computed four words at
+ *  a time from the last 16 words with the two message instructions.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "sha256_shani.h"
+
+#if defined SHA_CPU_X86
+
+#include <immintrin.h>
+
+
+#define SHANI_TARGET  __attribute__( ( target( "sha,sse4.1" ) ) )
+#define SHANI_INLINE  __attribute__( ( always_inline ) ) static inline
+
+
+/* Constants required for hash calculation (see p. 11 of FIPS 180-3) */
+
+static const sha_u32 K[ ] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+
+/*----------------------------------------------------------------*
+ * Loads a hash state, rearranging it from ABCD/EFGH to the ABEF/CDGH
+ * order the round instruction works with
+ *----------------------------------------------------------------*/
+
+SHANI_INLINE SHANI_TARGET void
+sha256_shani_load( const sha_u32 * state,
+                   __m128i       * abef,
+                   __m128i       * cdgh )
+{
+    __m128i tmp;
+
+
+    tmp   = _mm_loadu_si128( ( const __m128i * ) state );
+    *cdgh = _mm_loadu_si128( ( const __m128i * ) ( state + 4 ) );
+
+    tmp   = _mm_shuffle_epi32( tmp, 0xB1 );          /* CDAB */
+    *cdgh = _mm_shuffle_epi32( *cdgh, 0x1B );        /* EFGH */
+    *abef = _mm_alignr_epi8( tmp, *cdgh, 8 );        /* ABEF */
+    *cdgh = _mm_blend_epi16( *cdgh, tmp, 0xF0 );     /* CDGH */
+}
+
+
+/*----------------------------------------------------------------*
+ * Compresses 'n' (at most 2) blocks into their hash states. This
+ * is always inlined with a constant 'n', so the lane loops get
+ * unrolled and the rounds of the different lanes interleaved.
+ *----------------------------------------------------------------*/
+
+SHANI_INLINE SHANI_TARGET void
+sha256_shani_lanes( sha_u32             * const * state,
+                    const unsigned char * const * block,
+                    int                           n )
+{
+    const __m128i mask = _mm_set_epi64x( 0x0c0d0e0f08090a0bLL,
+                                         0x0405060700010203LL );
+    __m128i abef[ 2 ], cdgh[ 2 ];
+    __m128i W[ 2 ][ 4 ];
+    __m128i k, msg, tmp;
+    int     l, g;
+
+
+    /* Rearrange the state words from ABCD/EFGH to ABEF/CDGH order */
+
+#pragma GCC unroll 2
+    for ( l = 0; l < n; l++ )
+        sha256_shani_load( state[ l ], abef + l, cdgh + l );
+
+    /* Each iteration does four rounds, from the fifth one on the four
+       message words required are calculated from the last 16 ones */
+
+#pragma GCC unroll 16
+    for ( g = 0; g < 16; g++ )
+    {
+        k = _mm_loadu_si128( ( const __m128i * ) ( K + 4 * g ) );
+
+#pragma GCC unroll 2
+        for ( l = 0; l < n; l++ )
+        {
+            if ( g < 4 )
+                W[ l ][ g ] = _mm_shuffle_epi8(
+                    _mm_loadu_si128( ( const __m128i * ) ( block[ l ] + 16 * g ) ),
+                    mask );
+            else
+            {
+                tmp = _mm_alignr_epi8( W[ l ][ ( g + 3 ) & 3 ],
+                                       W[ l ][ ( g + 2 ) & 3 ], 4 );
+                W[ l ][ g & 3 ] = _mm_sha256msg1_epu32( W[ l ][ g & 3 ],
+                                                    W[ l ][ ( g + 1 ) & 3 ] );
+                W[ l ][ g & 3 ] = _mm_add_epi32( W[ l ][ g & 3 ], tmp );
+                W[ l ][ g & 3 ] = _mm_sha256msg2_epu32( W[ l ][ g & 3 ],
+                                                    W[ l ][ ( g + 3 ) & 3 ] );
+            }
+
+            msg       = _mm_add_epi32( W[ l ][ g & 3 ], k );
+            cdgh[ l ] = _mm_sha256rnds2_epu32( cdgh[ l ], abef[ l ], msg );
+            msg       = _mm_shuffle_epi32( msg, 0x0E );
+            abef[ l ] = _mm_sha256rnds2_epu32( abef[ l ], cdgh[ l ], msg );
+        }
+    }
+
+    /* Add the previous state and store in ABCD/EFGH order again (the
+       previous state gets reloaded instead of being kept around, with
+       several lanes there are too few registers for that) */
+
+#pragma GCC unroll 2
+    for ( l = 0; l < n; l++ )
+    {
+        __m128i abef_prev, cdgh_prev;
+
+        sha256_shani_load( state[ l ], &abef_prev, &cdgh_prev );
+        abef[ l ] = _mm_add_epi32( abef[ l ], abef_prev );
+        cdgh[ l ] = _mm_add_epi32( cdgh[ l ], cdgh_prev );
+
+        tmp       = _mm_shuffle_epi32( abef[ l ], 0x1B );    /* FEBA */
+        cdgh[ l ] = _mm_shuffle_epi32( cdgh[ l ], 0xB1 );    /* DCHG */
+        abef[ l ] = _mm_blend_epi16( tmp, cdgh[ l ], 0xF0 ); /* DCBA */
+        cdgh[ l ] = _mm_alignr_epi8( cdgh[ l ], tmp, 8 );    /* ABEF */
+
+        _mm_storeu_si128( ( __m128i * ) state[ l ], abef[ l ] );
+        _mm_storeu_si128( ( __m128i * ) ( state[ l ] + 4 ), cdgh[ l ] );
+    }
+}
+
+
+/*----------------------------------------------------------------*
+ *----------------------------------------------------------------*/
+
+SHANI_TARGET void
+sha256_shani_compress( sha_u32             * state,
+                       const unsigned char * block )
+{
+    sha256_shani_lanes( &state, &block, 1 );
+}
+
+
+/*----------------------------------------------------------------*
+ *----------------------------------------------------------------*/
+
+SHANI_TARGET void
+sha256_shani_compress_x2( sha_u32             * const * state,
+                          const unsigned char * const * block )
+{
+    sha256_shani_lanes( state, block, 2 );
+}
+
+#endif /* SHA_CPU_X86 */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
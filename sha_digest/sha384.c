@@ -59,6 +59,8 @@
 #define NEED_U128_SHR
 
 #include "sha384.h"
+#include "sha512.h"
+#include "sha512_mb.h"
 
 
 /* Circular right rotation of 64-bit value 'val' left by 'bits' bits */
@@ -174,6 +176,8 @@ static const sha_u32 K2[ 80 ][ 2 ] = { { 0x428a2f98, 0xd728ae22 },
 
 /* Local functions */
 
+static void sha384_compress( sha_u64             * state,
+                             const unsigned char * buf );
 static void sha384_process_block( SHA384_Context * context );
 static void sha384_evaluate( SHA384_Context * context );
 
@@ -246,8 +250,6 @@ sha384_add_bytes( SHA384_Context * context,
         if ( context->index + len > 128 )
             len = 128 - context->index;
 
-        memcpy( context->buf + context->index, data, len );
-
         /* Increment bit count, abort on input of more than 2^64 bits */
 
         context->count = sha_u128_plus( context->count,
@@ -255,11 +257,20 @@ sha384_add_bytes( SHA384_Context * context,
         if ( sha_u128_lt( context->count, sha_u128_set( 0, 0, 0, 8 * len ) ) )
             return context->error = SHA_DIGEST_INPUT_TOO_LONG;
 
+        /* Whole blocks get compressed straight from the input instead
+           of being copied into the buffer first */
+
+        if ( len == 128 )
+            sha384_compress( context->H, data );
+        else
+        {
+            memcpy( context->buf + context->index, data, len );
+            if ( ( context->index += len ) == 128 )
+                sha384_process_block( context );
+        }
+
         data       = ( unsigned char * ) data + len;
         num_bytes -= len;
-
-        if ( ( context->index += len ) == 128 )
-            sha384_process_block( context );
     }
 
     return SHA_DIGEST_OK;
@@ -406,6 +417,112 @@ sha384_calculate( SHA384_Context  * context,
 }
 
 
+/*----------------------------------------------------------------*
+ * Calculates the hash of a message short enough to fit together
+ * with its padding into a single block (i.e. of not more than
+ * SHA384_ONEBLOCK_MAX_BITS bits) in one go, setting up the padded
+ * block directly instead of going through the buffering and bit
+ * counting of the functions for adding data. The bit count then
+ * never needs more than the last two bytes of the block.
+ *----------------------------------------------------------------*/
+
+int
+sha384_oneblock( const void    * data,
+                 size_t          num_bits,
+                 unsigned char   digest[ SHA384_HASH_SIZE ] )
+{
+    SHA384_Context context;
+    const unsigned char *d = data;
+    size_t len = num_bits / 8,
+           rem = num_bits % 8;
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+    if ( num_bits > SHA384_ONEBLOCK_MAX_BITS )
+        return SHA_DIGEST_INPUT_TOO_LONG;
+
+    sha384_initialize( &context );
+
+    memcpy( context.buf, d, len );
+
+    if ( rem == 0 )
+        context.buf[ len ] = 0x80;
+    else
+        context.buf[ len ] =   ( SHA_T8( d[ len ] )
+                               & SHA_T8( 0xFF << ( 8 - rem ) ) )
+                             | ( 0x80 >> rem );
+
+    memset( context.buf + len + 1, 0, 125 - len );
+    context.buf[ 126 ] = SHA_T8( num_bits >> 8 );
+    context.buf[ 127 ] = SHA_T8( num_bits );
+
+    sha384_process_block( &context );
+    context.is_calculated = 1;
+
+    return sha384_calculate( &context, digest );
+}
+
+
+/*----------------------------------------------------------------*
+ * Like sha384_oneblock(), but for 'count' messages of the same
+ * length at once, using the backend selected for SHA-512 with
+ * sha512_set_backend() (SHA-384 only differs in the initial hash
+ * values and the length of the digest). For best throughput
+ * 'count' should be a multiple of what sha512_lanes() returns.
+ *----------------------------------------------------------------*/
+
+int
+sha384_oneblock_multi( const void * const  * data,
+                       size_t                num_bits,
+                       unsigned char * const * digest,
+                       size_t                count )
+{
+    size_t i;
+    int    ret;
+
+
+    if ( ! data || ! digest )
+        return SHA_DIGEST_INVALID_ARG;
+
+#if defined SHA512_MB_X86
+    if ( sha512_get_backend( ) == SHA512_BACKEND_AVX2 )
+    {
+        sha_u64 iv[ 8 ];
+        size_t  n;
+
+        if ( num_bits > SHA384_ONEBLOCK_MAX_BITS )
+            return SHA_DIGEST_INPUT_TOO_LONG;
+
+        for ( i = 0; i < 8; i++ )
+            iv[ i ] = sha_u64_set( H[ i ][ 0 ], H[ i ][ 1 ] );
+
+        /* With only a single message left the kernel isn't worth it */
+
+        for ( ; count > 1; data += n, digest += n, count -= n )
+        {
+            n = count > 4 ? 4 : count;
+
+            for ( i = 0; i < n; i++ )
+                if ( ! data[ i ] || ! digest[ i ] )
+                    return SHA_DIGEST_INVALID_ARG;
+
+            sha512_avx2_oneblock_x4( iv, data, num_bits, digest, n,
+                                     SHA384_HASH_SIZE );
+        }
+    }
+#endif
+
+    for ( i = 0; i < count; i++ )
+        if ( ( ret = sha384_oneblock( data[ i ], num_bits, digest[ i ] ) )
+                                                            != SHA_DIGEST_OK )
+            return ret;
+
+    return SHA_DIGEST_OK;
+}
+
+
 /*----------------------------------------------------------------*
  * Central routine for calculating the hash value. See the FIPS
  * 180-3 standard p. 24 for a detailed explanation.
@@ -433,22 +550,22 @@ sha384_calculate( SHA384_Context  * context,
                                 sha_u64_xor( ROTR( 61, x ), SHR( 6, x ) ) )
 
 static void
-sha384_process_block( SHA384_Context * context )
+sha384_compress( sha_u64             * state,
+                 const unsigned char * buf )
 {
     size_t         t;
     sha_u64        W[ 80 ];
     sha_u64        A, B, C, D, E, F, G, H, tmp;
-    unsigned char *buf = context->buf;
 
 
-    A = context->H[ 0 ];
-    B = context->H[ 1 ];
-    C = context->H[ 2 ];
-    D = context->H[ 3 ];
-    E = context->H[ 4 ];
-    F = context->H[ 5 ];
-    G = context->H[ 6 ];
-    H = context->H[ 7 ];
+    A = state[ 0 ];
+    B = state[ 1 ];
+    C = state[ 2 ];
+    D = state[ 3 ];
+    E = state[ 4 ];
+    F = state[ 5 ];
+    G = state[ 6 ];
+    H = state[ 7 ];
 
     for ( t = 0; t < 16; buf += 8, t++ )
     {
@@ -495,15 +612,25 @@ sha384_process_block( SHA384_Context * context )
         A = sha_u64_plus( tmp, sha_u64_plus( Sig0, Maj ) );
     }
 
-    context->H[ 0 ] = sha_u64_plus( context->H[ 0 ], A );
-    context->H[ 1 ] = sha_u64_plus( context->H[ 1 ], B );
-    context->H[ 2 ] = sha_u64_plus( context->H[ 2 ], C );
-    context->H[ 3 ] = sha_u64_plus( context->H[ 3 ], D );
-    context->H[ 4 ] = sha_u64_plus( context->H[ 4 ], E );
-    context->H[ 5 ] = sha_u64_plus( context->H[ 5 ], F );
-    context->H[ 6 ] = sha_u64_plus( context->H[ 6 ], G );
-    context->H[ 7 ] = sha_u64_plus( context->H[ 7 ], H );
+    state[ 0 ] = sha_u64_plus( state[ 0 ], A );
+    state[ 1 ] = sha_u64_plus( state[ 1 ], B );
+    state[ 2 ] = sha_u64_plus( state[ 2 ], C );
+    state[ 3 ] = sha_u64_plus( state[ 3 ], D );
+    state[ 4 ] = sha_u64_plus( state[ 4 ], E );
+    state[ 5 ] = sha_u64_plus( state[ 5 ], F );
+    state[ 6 ] = sha_u64_plus( state[ 6 ], G );
+    state[ 7 ] = sha_u64_plus( state[ 7 ], H );
+}
+
+
+/*----------------------------------------------------------------*
+ * Processes the block in the context's buffer
+ *----------------------------------------------------------------*/
 
+static void
+sha384_process_block( SHA384_Context * context )
+{
+    sha384_compress( context->H, context->buf );
     context->index = 0;
 }
 
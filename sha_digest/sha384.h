@@ -56,6 +56,12 @@ extern "C" {
 #define SHA384_HASH_SIZE        48
 
 
+/* Longest message (in bits) that still fits together with its padding
+   into a single block and thus can be hashed by sha384_oneblock() */
+
+#define SHA384_ONEBLOCK_MAX_BITS    895
+
+
 #if ! defined SHA_DIGEST_OK
 #define SHA_DIGEST_OK               0
 #endif
@@ -92,6 +98,13 @@ int sha384_add_bits( SHA384_Context * context,
                      size_t           num_bits );
 int sha384_calculate( SHA384_Context * context,
                       unsigned char    digest[ SHA384_HASH_SIZE ] );
+int sha384_oneblock( const void    * data,
+                     size_t          num_bits,
+                     unsigned char   digest[ SHA384_HASH_SIZE ] );
+int sha384_oneblock_multi( const void * const  * data,
+                           size_t                num_bits,
+                           unsigned char * const * digest,
+                           size_t                count );
 
 #ifdef __cplusplus
 }
@@ -56,6 +56,22 @@ extern "C" {
 #define SHA512_HASH_SIZE        64
 
 
+/* Longest message (in bits) that still fits together with its padding
+   into a single block and thus can be hashed by sha512_oneblock() */
+
+#define SHA512_ONEBLOCK_MAX_BITS    895
+
+
+/* Implementations sha512_set_backend() can select from for hashing
+   several messages at once (not all of them are available on every
+   machine), they're also used for SHA-384 */
+
+#define SHA512_BACKEND_AUTO         0
+#define SHA512_BACKEND_PORTABLE     1
+#define SHA512_BACKEND_AVX2         2
+#define SHA512_BACKEND_COUNT        3
+
+
 #if ! defined SHA_DIGEST_OK
 #define SHA_DIGEST_OK               0
 #endif
@@ -92,6 +108,19 @@ int sha512_add_bits( SHA512_Context * context,
                      size_t           num_bits );
 int sha512_calculate( SHA512_Context * context,
                       unsigned char    digest[ SHA512_HASH_SIZE ] );
+int sha512_oneblock( const void    * data,
+                     size_t          num_bits,
+                     unsigned char   digest[ SHA512_HASH_SIZE ] );
+int sha512_oneblock_multi( const void * const  * data,
+                           size_t                num_bits,
+                           unsigned char * const * digest,
+                           size_t                count );
+
+int sha512_set_backend( int backend );
+int sha512_get_backend( void );
+int sha512_backend_available( int backend );
+const char * sha512_backend_name( int backend );
+size_t sha512_lanes( void );
 
 #ifdef __cplusplus
 }
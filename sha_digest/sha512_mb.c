@@ -0,0 +1,227 @@
+/*
+ *  Multi-buffer SHA-512 block compression with AVX2 (4 lanes): the
+ *  rounds are the ones from FIPS 180-3, but every operation works
+ *  on one 64-bit word of each of the messages at once. Words of the
+ *  blocks and the hash states are gathered into the lanes with a
+ *  stride of the block resp. state size. AVX2 has no rotate
+ *  instructions, so rotations are done with two shifts, except the
+ *  one by 8 bits, which is a byte shuffle.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "sha512_mb.h"
+
+#if defined SHA512_MB_X86
+
+#include <immintrin.h>
+#include <string.h>
+
+
+/* Constants required for hash calculation (see p. 11f of FIPS 180-3) */
+
+static const sha_u64 K[ ] = {
+    0x428a2f98d728ae22UL, 0x7137449123ef65cdUL, 0xb5c0fbcfec4d3b2fUL,
+    0xe9b5dba58189dbbcUL, 0x3956c25bf348b538UL, 0x59f111f1b605d019UL,
+    0x923f82a4af194f9bUL, 0xab1c5ed5da6d8118UL, 0xd807aa98a3030242UL,
+    0x12835b0145706fbeUL, 0x243185be4ee4b28cUL, 0x550c7dc3d5ffb4e2UL,
+    0x72be5d74f27b896fUL, 0x80deb1fe3b1696b1UL, 0x9bdc06a725c71235UL,
+    0xc19bf174cf692694UL, 0xe49b69c19ef14ad2UL, 0xefbe4786384f25e3UL,
+    0x0fc19dc68b8cd5b5UL, 0x240ca1cc77ac9c65UL, 0x2de92c6f592b0275UL,
+    0x4a7484aa6ea6e483UL, 0x5cb0a9dcbd41fbd4UL, 0x76f988da831153b5UL,
+    0x983e5152ee66dfabUL, 0xa831c66d2db43210UL, 0xb00327c898fb213fUL,
+    0xbf597fc7beef0ee4UL, 0xc6e00bf33da88fc2UL, 0xd5a79147930aa725UL,
+    0x06ca6351e003826fUL, 0x142929670a0e6e70UL, 0x27b70a8546d22ffcUL,
+    0x2e1b21385c26c926UL, 0x4d2c6dfc5ac42aedUL, 0x53380d139d95b3dfUL,
+    0x650a73548baf63deUL, 0x766a0abb3c77b2a8UL, 0x81c2c92e47edaee6UL,
+    0x92722c851482353bUL, 0xa2bfe8a14cf10364UL, 0xa81a664bbc423001UL,
+    0xc24b8b70d0f89791UL, 0xc76c51a30654be30UL, 0xd192e819d6ef5218UL,
+    0xd69906245565a910UL, 0xf40e35855771202aUL, 0x106aa07032bbd1b8UL,
+    0x19a4c116b8d2d0c8UL, 0x1e376c085141ab53UL, 0x2748774cdf8eeb99UL,
+    0x34b0bcb5e19b48a8UL, 0x391c0cb3c5c95a63UL, 0x4ed8aa4ae3418acbUL,
+    0x5b9cca4f7763e373UL, 0x682e6ff3d6b2b8a3UL, 0x748f82ee5defb2fcUL,
+    0x78a5636f43172f60UL, 0x84c87814a1f0ab72UL, 0x8cc702081a6439ecUL,
+    0x90befffa23631e28UL, 0xa4506cebde82bde9UL, 0xbef9a3f7b2c67915UL,
+    0xc67178f2e372532bUL, 0xca273eceea26619cUL, 0xd186b8c721c0c207UL,
+    0xeada7dd6cde0eb1eUL, 0xf57d4f7fee6ed178UL, 0x06f067aa72176fbaUL,
+    0x0a637dc5a2c898a6UL, 0x113f9804bef90daeUL, 0x1b710b35131c471bUL,
+    0x28db77f523047d84UL, 0x32caab7b40c72493UL, 0x3c9ebe0a15c9bebcUL,
+    0x431d67c49c100d4cUL, 0x4cc5d4becb3e42b6UL, 0x597f299cfc657e2aUL,
+    0x5fcb6fab3ad6faecUL, 0x6c44198c4a475817UL };
+
+
+#define AVX2_TARGET  __attribute__( ( target( "avx2" ) ) )
+
+#define ADD( x, y )       _mm256_add_epi64( x, y )
+#define XOR3( x, y, z )   _mm256_xor_si256( _mm256_xor_si256( x, y ), z )
+#define ROTR( x, n )      _mm256_or_si256( _mm256_srli_epi64( x, n ),       \
+                                           _mm256_slli_epi64( x, 64 - n ) )
+#define ROTR8( x )        _mm256_shuffle_epi8( x, rotr8 )
+#define SHR( x, n )       _mm256_srli_epi64( x, n )
+#define CH( e, f, g )     _mm256_xor_si256( _mm256_and_si256( e, f ),       \
+                                            _mm256_andnot_si256( e, g ) )
+#define MAJ( a, b, c )    _mm256_or_si256( _mm256_and_si256( a, b ),        \
+                              _mm256_and_si256( c, _mm256_or_si256( a, b ) ) )
+#define SET1( k )         _mm256_set1_epi64x( ( long long ) ( k ) )
+#define BSWAP( x )        _mm256_shuffle_epi8( x, bswap )
+#define GATHER( p, s )    _mm256_i64gather_epi64( ( const long long * ) ( p ), \
+                              _mm256_setr_epi64x( 0, s, 2 * s, 3 * s ), 8 )
+#define SCATTER( p, s, x )                                                 \
+    do {                                                                   \
+        sha_u64 v_[ 4 ];                                                   \
+        int     l_;                                                        \
+        _mm256_storeu_si256( ( __m256i * ) v_, x );                        \
+        for ( l_ = 0; l_ < 4; l_++ )                                       \
+            ( p )[ ( s ) * l_ ] = v_[ l_ ];                                \
+    } while ( 0 )
+
+#define Sig0( x )  XOR3( ROTR( x, 28 ), ROTR( x, 34 ), ROTR( x, 39 ) )
+#define Sig1( x )  XOR3( ROTR( x, 14 ), ROTR( x, 18 ), ROTR( x, 41 ) )
+#define sig0( x )  XOR3( ROTR( x,  1 ), ROTR8( x ),    SHR( x,  7 ) )
+#define sig1( x )  XOR3( ROTR( x, 19 ), ROTR( x, 61 ), SHR( x,  6 ) )
+
+#define ROUND( a, b, c, d, e, f, g, h, i )                                 \
+    do {                                                                   \
+        if ( t >= 16 )                                                     \
+            W[ i ] = ADD( ADD( sig1( W[ ( i + 14 ) & 15 ] ),               \
+                               W[ ( i + 9 ) & 15 ] ),                      \
+                          ADD( sig0( W[ ( i + 1 ) & 15 ] ), W[ i ] ) );    \
+        tmp = ADD( ADD( ADD( h, Sig1( e ) ), CH( e, f, g ) ),              \
+                   ADD( SET1( K[ t + i ] ), W[ i ] ) );                    \
+        d   = ADD( d, tmp );                                               \
+        h   = ADD( ADD( tmp, Sig0( a ) ), MAJ( a, b, c ) );                \
+    } while ( 0 )
+
+
+/*----------------------------------------------------------------*
+ *----------------------------------------------------------------*/
+
+AVX2_TARGET void
+sha512_avx2_compress_x4( sha_u64             state[ ][ 8 ],
+                         const unsigned char block[ ][ 128 ] )
+{
+    const __m256i bswap = _mm256_setr_epi8(
+                             7,  6,  5,  4,  3,  2,  1,  0,
+                            15, 14, 13, 12, 11, 10,  9,  8,
+                             7,  6,  5,  4,  3,  2,  1,  0,
+                            15, 14, 13, 12, 11, 10,  9,  8 );
+    const __m256i rotr8 = _mm256_setr_epi8(
+                             1,  2,  3,  4,  5,  6,  7,  0,
+                             9, 10, 11, 12, 13, 14, 15,  8,
+                             1,  2,  3,  4,  5,  6,  7,  0,
+                             9, 10, 11, 12, 13, 14, 15,  8 );
+    __m256i S[ 8 ], W[ 16 ];
+    __m256i A, B, C, D, E, F, G, H, tmp;
+    int     i, t;
+
+
+    for ( i = 0; i < 8; i++ )
+        S[ i ] = GATHER( state[ 0 ] + i, 8 );
+
+    A = S[ 0 ]; B = S[ 1 ]; C = S[ 2 ]; D = S[ 3 ];
+    E = S[ 4 ]; F = S[ 5 ]; G = S[ 6 ]; H = S[ 7 ];
+
+    for ( i = 0; i < 16; i++ )
+        W[ i ] = BSWAP( GATHER( ( const sha_u64 * ) block[ 0 ] + i, 16 ) );
+
+    /* W[ i ] holds message word t + i, mod 16 (t is a multiple of 16)
+       and the state variables rotate by one each round */
+
+    for ( t = 0; t < 80; t += 16 )
+    {
+        ROUND( A, B, C, D, E, F, G, H,  0 );
+        ROUND( H, A, B, C, D, E, F, G,  1 );
+        ROUND( G, H, A, B, C, D, E, F,  2 );
+        ROUND( F, G, H, A, B, C, D, E,  3 );
+        ROUND( E, F, G, H, A, B, C, D,  4 );
+        ROUND( D, E, F, G, H, A, B, C,  5 );
+        ROUND( C, D, E, F, G, H, A, B,  6 );
+        ROUND( B, C, D, E, F, G, H, A,  7 );
+        ROUND( A, B, C, D, E, F, G, H,  8 );
+        ROUND( H, A, B, C, D, E, F, G,  9 );
+        ROUND( G, H, A, B, C, D, E, F, 10 );
+        ROUND( F, G, H, A, B, C, D, E, 11 );
+        ROUND( E, F, G, H, A, B, C, D, 12 );
+        ROUND( D, E, F, G, H, A, B, C, 13 );
+        ROUND( C, D, E, F, G, H, A, B, 14 );
+        ROUND( B, C, D, E, F, G, H, A, 15 );
+    }
+
+    S[ 0 ] = ADD( S[ 0 ], A ); S[ 1 ] = ADD( S[ 1 ], B );
+    S[ 2 ] = ADD( S[ 2 ], C ); S[ 3 ] = ADD( S[ 3 ], D );
+    S[ 4 ] = ADD( S[ 4 ], E ); S[ 5 ] = ADD( S[ 5 ], F );
+    S[ 6 ] = ADD( S[ 6 ], G ); S[ 7 ] = ADD( S[ 7 ], H );
+
+    for ( i = 0; i < 8; i++ )
+        SCATTER( state[ 0 ] + i, 8, S[ i ] );
+}
+
+
+
+/*----------------------------------------------------------------*
+ * Pads the messages into their blocks like sha512_oneblock() does
+ * and compresses them in one go, with the unused lanes of an
+ * incomplete batch getting copies of the first message. The
+ * arguments must already have been checked by the caller.
+ *----------------------------------------------------------------*/
+
+void
+sha512_avx2_oneblock_x4( const sha_u64         iv[ 8 ],
+                         const void * const  * data,
+                         size_t                num_bits,
+                         unsigned char * const * digest,
+                         size_t                count,
+                         size_t                digest_size )
+{
+    unsigned char buf[ 4 ][ 128 ];
+    sha_u64       state[ 4 ][ 8 ];
+    size_t        len = num_bits / 8,
+                  rem = num_bits % 8,
+                  i,
+                  j;
+
+
+    for ( i = 0; i < 4; i++ )
+    {
+        const unsigned char *d = data[ i < count ? i : 0 ];
+
+        memcpy( buf[ i ], d, len );
+
+        if ( rem == 0 )
+            buf[ i ][ len ] = 0x80;
+        else
+            buf[ i ][ len ] = ( d[ len ] & ( 0xFF << ( 8 - rem ) ) )
+                              | ( 0x80 >> rem );
+
+        memset( buf[ i ] + len + 1, 0, 125 - len );
+        buf[ i ][ 126 ] = ( unsigned char ) ( num_bits >> 8 );
+        buf[ i ][ 127 ] = ( unsigned char ) num_bits;
+
+        memcpy( state[ i ], iv, sizeof state[ i ] );
+    }
+
+    sha512_avx2_compress_x4( state, ( const unsigned char ( * )[ 128 ] ) buf );
+
+    for ( i = 0; i < count; i++ )
+        for ( j = 0; j < digest_size; j++ )
+            digest[ i ][ j ] = ( unsigned char )
+                            ( state[ i ][ j / 8 ] >> ( 56 - 8 * ( j % 8 ) ) );
+}
+
+#endif /* SHA512_MB_X86 */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
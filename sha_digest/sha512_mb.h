@@ -0,0 +1,66 @@
+/*
+ *  Multi-buffer SHA-512 block compression with AVX2, each 64-bit SIMD
+ *  lane working on a different message.
+ *
+ *  The kernel needs a native 64-bit type for the hash state, so it's
+ *  only available on x86-64. It may only be called when
+ *  sha_cpu_features() reports SHA_CPU_AVX2, normally it's not used
+ *  directly but via sha512_oneblock_multi() and sha384_oneblock_multi().
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#if ! defined SHA512_MB_HEADER_
+#define SHA512_MB_HEADER_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sha_types.h"
+#include "sha_cpu.h"
+
+
+#if defined SHA_CPU_X86 && defined __x86_64__
+#define SHA512_MB_X86
+
+/* Compresses 4 blocks (stored one after another) into as many hash
+   states (also stored one after another) */
+
+void sha512_avx2_compress_x4( sha_u64             state[ ][ 8 ],
+                              const unsigned char block[ ][ 128 ] );
+
+/* Hashes up to 4 single-block messages of the same length, starting
+   from the initial hash values 'iv' (thus SHA-384 can use it as well)
+   and writing the first 'digest_size' bytes of each result */
+
+void sha512_avx2_oneblock_x4( const sha_u64         iv[ 8 ],
+                             const void * const  * data,
+                             size_t                num_bits,
+                             unsigned char * const * digest,
+                             size_t                count,
+                             size_t                digest_size );
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! SHA512_MB_HEADER_ */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
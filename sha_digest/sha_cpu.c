@@ -0,0 +1,85 @@
+/*
+ *  Run-time detection of the CPU features the accelerated SHA
+ *  implementations depend on.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "sha_cpu.h"
+
+#if defined SHA_CPU_X86
+#include <cpuid.h>
+#endif
+
+
+/*----------------------------------------------------------------*
+ * Returns the set of features (SHA_CPU_xxx flags) supported by
+ * the CPU the program is running on. The result doesn't change,
+ * so callers should store it instead of calling this repeatedly.
+ *----------------------------------------------------------------*/
+
+unsigned int
+sha_cpu_features( void )
+{
+    unsigned int features = 0;
+
+#if defined SHA_CPU_X86
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int xcr0 = 0;
+
+
+    if ( ! __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+        return 0;
+
+    /* SSSE3 is bit 9 and SSE4.1 bit 19 of ECX */
+
+    if ( ( ecx & ( 1U << 9 ) ) && ( ecx & ( 1U << 19 ) ) )
+        features |= SHA_CPU_SSE41;
+
+    /* The wider registers are only usable if the OS saves them on
+       context switches (OSXSAVE, bit 27 of ECX, tells if XCR0 can be
+       read to find out), xgetbv is encoded directly to not require
+       the compiler to support it */
+
+    if ( ecx & ( 1U << 27 ) )
+        __asm__ ( ".byte 0x0f, 0x01, 0xd0" : "=a" ( xcr0 ), "=d" ( edx )
+                                           : "c" ( 0 ) );
+
+    if ( __get_cpuid_max( 0, 0 ) < 7 )
+        return features;
+
+    __cpuid_count( 7, 0, eax, ebx, ecx, edx );
+
+    /* SHA extensions are bit 29, AVX2 bit 5 and AVX-512F bit 16 of EBX
+       for leaf 7, the OS has to handle the SSE and AVX state (bits 1
+       and 2 of XCR0) for AVX2 and additionally the opmask and upper ZMM
+       state (bits 5 to 7) for AVX-512 */
+
+    if ( ( features & SHA_CPU_SSE41 ) && ( ebx & ( 1U << 29 ) ) )
+        features |= SHA_CPU_SHANI;
+
+    if ( ( ebx & ( 1U << 5 ) ) && ( xcr0 & 0x06 ) == 0x06 )
+        features |= SHA_CPU_AVX2;
+
+    if ( ( ebx & ( 1U << 16 ) ) && ( xcr0 & 0xE6 ) == 0xE6 )
+        features |= SHA_CPU_AVX512;
+#endif
+
+    return features;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
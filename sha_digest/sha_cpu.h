@@ -0,0 +1,56 @@
+/*
+ *  Run-time detection of the CPU features the accelerated SHA
+ *  implementations depend on.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#if ! defined SHA_CPU_HEADER_
+#define SHA_CPU_HEADER_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* The accelerated implementations need x86 intrinsics and the compiler
+   to support per-function target attributes (gcc and clang do), on all
+   other systems only the portable code gets used */
+
+#if    ( defined __x86_64__ || defined __i386__ ) \
+    && ( defined __GNUC__ || defined __clang__ )
+#define SHA_CPU_X86
+#endif
+
+
+/* Feature flags as returned by sha_cpu_features() */
+
+#define SHA_CPU_SSE41       0x01U    /* SSSE3 and SSE4.1 */
+#define SHA_CPU_SHANI       0x02U    /* SHA extensions (with SSE4.1) */
+#define SHA_CPU_AVX2        0x04U    /* AVX2, enabled by the OS */
+#define SHA_CPU_AVX512      0x08U    /* AVX-512F, enabled by the OS */
+
+
+unsigned int sha_cpu_features( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ! SHA_CPU_HEADER_ */
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -1,11 +1,16 @@
 /*
  *  This is an example of how a program that uses the SHA algorithms could
  *  be written. What algorithm gets used depends on the name the program
- *  is invoked as (via symbolic links). It reads data either from a file
- *  if one is given as a command line argument, or otherwise from stdin.
+ *  is invoked as (via symbolic links). It reads data from the files given
+ *  as command line arguments, or otherwise from stdin.
  *
- *  This program hasn't been optimized for speed, instead it is supposed
- *  to be platform independent and C89 compliant.
+ *  The program is supposed to be platform independent and C89 compliant.
+ *  Where POSIX memory mapped files are available regular files can be
+ *  mapped instead of read (option '-m'), so the library compresses their
+ *  blocks right from the mapping without any copying, and with POSIX
+ *  threads several files get hashed at once by a pool of threads (option
+ *  '-j'), with the results still printed in the order the files were
+ *  given in.
  *
  *  Copyright (C) 2009 Jens Thoms Toerring <jt@toerring.de>
  *
@@ -24,10 +29,30 @@
  */
 
 
+
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sha_digest.h>
 
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <unistd.h>
+#endif
+
+#if defined( _POSIX_MAPPED_FILES ) && _POSIX_MAPPED_FILES > 0
+#define USE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#if defined( _POSIX_THREADS ) && _POSIX_THREADS > 0
+#define USE_THREADS
+#include <pthread.h>
+#endif
+
 
 #define BUF_SIZE  16384
 
@@ -47,6 +72,43 @@ typedef struct {
 } sha_t;
 
 
+/* What can go wrong while hashing a single input */
+
+enum {
+    JOB_OK,
+    JOB_NO_OPEN,
+    JOB_NO_READ,
+    JOB_NO_INIT,
+    JOB_NO_ADD,
+    JOB_NO_CALC
+};
+
+
+/* One input to be hashed, a name of NULL stands for stdin */
+
+typedef struct {
+    const char    * name;
+    unsigned char   digest[ SHA512_HASH_SIZE ];  /* longest digest */
+    int             result;
+    int             done;
+} job_t;
+
+
+/* Everything the threads hashing the inputs share */
+
+typedef struct {
+    const sha_t     * sha;
+    job_t           * jobs;
+    size_t            num_jobs;
+    size_t            next_job;
+    int               use_mmap;
+#ifdef USE_THREADS
+    pthread_mutex_t   mutex;
+    pthread_cond_t    done_cond;
+#endif
+} pool_t;
+
+
 /*---------------------------------------------------------------*
  *---------------------------------------------------------------*/
 
@@ -54,22 +116,22 @@ static void
 usage( const char *pn )
 {
     if ( ! strcmp( pn, "sha1_digest" ) )
-        fprintf( stderr, "Usage: sha1_digest [FILE]\n"
+        fprintf( stderr, "Usage: sha1_digest [OPTION]... [FILE]...\n"
                  "Print SHA-1 (160-bit) digest of byte-oriented input.\n" );
     else if ( ! strcmp( pn, "sha224_digest" ) )
-        fprintf( stderr, "Usage: sha224_digest [FILE]\n"
+        fprintf( stderr, "Usage: sha224_digest [OPTION]... [FILE]...\n"
                  "Print SHA-224 (224-bit) digest of byte-oriented input.\n" );
     else if ( ! strcmp( pn, "sha256_digest" ) )
-        fprintf( stderr, "Usage: sha256_digest [FILE]\n"
+        fprintf( stderr, "Usage: sha256_digest [OPTION]... [FILE]...\n"
                  "Print SHA-256 (256-bit) digest of byte-oriented input.\n" );
     else if ( ! strcmp( pn, "sha384_digest" ) )
-        fprintf( stderr, "Usage: sha384_digest [FILE]\n"
+        fprintf( stderr, "Usage: sha384_digest [OPTION]... [FILE]...\n"
                  "Print SHA-384 (384-bit) digest of byte-oriented input.\n"  );
     else if ( ! strcmp( pn, "sha512_digest" ) )
-        fprintf( stderr, "Usage: sha512_digest [FILE]\n"
+        fprintf( stderr, "Usage: sha512_digest [OPTION]... [FILE]...\n"
                  "Print SHA-512 (512-bit) digest of byte-oriented input.\n"  );
     else
-        fprintf( stderr, "Usage: sha_digest SHA-TYPE [FILE]\n"
+        fprintf( stderr, "Usage: sha_digest SHA-TYPE [OPTION]... [FILE]...\n"
                  "Print SHA digest of byte-oriented input.\n"
                  "For SHA-TYPE use\n"
                  "  -sha1      print SHA-1 (160-bit) digest\n"
@@ -78,13 +140,19 @@ usage( const char *pn )
                  "  -sha384    print SHA-384 (384-bit) digest\n"
                  "  -sha512    print SHA-512 (512-bit) digest\n" );
     fprintf( stderr,
-             "With no FILE (or when FILE is -) read standard input.\n" );
+             "Options:\n"
+             "  -m         memory map regular files instead of reading them\n"
+             "  -j N       hash up to N files at once (0: one per CPU)\n"
+             "With no FILE (or when FILE is -) read standard input. With\n"
+             "more than one FILE each digest is followed by the file name.\n" );
 
     exit( EXIT_FAILURE );
 }
 
 
 /*---------------------------------------------------------------*
+ * Sets up the functions for the algorithm and picks the fastest
+ * code the CPU supports for it
  *---------------------------------------------------------------*/
 
 static void
@@ -99,6 +167,7 @@ set_funcs( sha_t      * sha,
             sha->add     = sha1_add_bytes;
             sha->calc    = sha1_calculate;
             sha->hashlen = SHA1_HASH_SIZE;
+            sha1_set_backend( SHA1_BACKEND_AUTO );
             break;
 
         case 224 :
@@ -113,6 +182,7 @@ set_funcs( sha_t      * sha,
             sha->add     = sha256_add_bytes;
             sha->calc    = sha256_calculate;
             sha->hashlen = SHA256_HASH_SIZE;
+            sha256_set_backend( SHA256_BACKEND_AUTO );
             break;
 
         case 384 :
@@ -120,6 +190,7 @@ set_funcs( sha_t      * sha,
             sha->add     = sha384_add_bytes;
             sha->calc    = sha384_calculate;
             sha->hashlen = SHA384_HASH_SIZE;
+            sha512_set_backend( SHA512_BACKEND_AUTO );
             break;
 
         case 512 :
@@ -127,6 +198,7 @@ set_funcs( sha_t      * sha,
             sha->add     = sha512_add_bytes;
             sha->calc    = sha512_calculate;
             sha->hashlen = SHA512_HASH_SIZE;
+            sha512_set_backend( SHA512_BACKEND_AUTO );
             break;
 
         default :
@@ -136,14 +208,37 @@ set_funcs( sha_t      * sha,
 
 
 /*---------------------------------------------------------------*
+ * Number of threads for '-j 0'
  *---------------------------------------------------------------*/
 
-static FILE *
-get_opts( sha_t *  sha,
-          char  ** argv )
+static size_t
+num_cpus( void )
+{
+#if defined( USE_THREADS ) && defined( _SC_NPROCESSORS_ONLN )
+    long n = sysconf( _SC_NPROCESSORS_ONLN );
+
+    if ( n > 0 )
+        return n;
+#endif
+    return 1;
+}
+
+
+/*---------------------------------------------------------------*
+ * Sets up the functions for the algorithm, the options and the
+ * list of inputs, returns the index of the first file name in
+ * argv (or argc if there's none)
+ *---------------------------------------------------------------*/
+
+static int
+get_opts( sha_t   * sha,
+          int       argc,
+          char   ** argv,
+          int     * use_mmap,
+          size_t  * num_threads )
 {
-    FILE *fp;
     char *arg = strrchr( argv[ 0 ], '/' );
+    int i = 1;
 
 
     if ( ! arg )
@@ -177,73 +272,330 @@ get_opts( sha_t *  sha,
             set_funcs( sha, 512, arg );
         else
             usage( arg );
-        argv++;
+        i++;
     }
     else
         usage( arg );
 
-    if ( ! argv[ 1 ] || ! strcmp( argv[ 1 ], "-" ) ) 
-        return stdin;
+    *use_mmap    = 0;
+    *num_threads = 1;
 
-    if ( ( fp = fopen( argv[ 1 ], "rb" ) ) == NULL )
+    for ( ; i < argc && argv[ i ][ 0 ] == '-' && argv[ i ][ 1 ]; i++ )
     {
-        fprintf( stderr, "Can't open file %s for reading.\n", argv[ 1 ] );
-        exit( EXIT_FAILURE );
+        const char *num;
+        char *end;
+        unsigned long n;
+
+        if ( ! strcmp( argv[ i ], "--" ) )
+            return i + 1;
+
+        if ( ! strcmp( argv[ i ], "-m" ) )
+        {
+            *use_mmap = 1;
+            continue;
+        }
+
+        if ( strncmp( argv[ i ], "-j", 2 ) )
+            usage( arg );
+
+        if ( ! ( num = argv[ i ][ 2 ] ? argv[ i ] + 2 : argv[ ++i ] ) )
+            usage( arg );
+
+        n = strtoul( num, &end, 10 );
+        if ( end == num || *end || *num == '-' )
+            usage( arg );
+
+        *num_threads = n ? ( size_t ) n : num_cpus( );
     }
 
-    return fp;
+    return i;
 }
 
 
+#ifdef USE_MMAP
 /*---------------------------------------------------------------*
+ * Passes a regular file to the library as a whole by mapping it
+ * into memory, so complete blocks get compressed right where
+ * they are. Returns 0 if the file can't be mapped (e.g. because
+ * it's empty or not a regular file), in which case it has to be
+ * read in the normal way.
  *---------------------------------------------------------------*/
 
-int
-main( int     argc,
-      char ** argv )
+static int
+add_mapped( sha_t      * sha,
+            const char * name,
+            int        * result )
+{
+    int fd;
+    struct stat st;
+    size_t len;
+    void *map;
+
+
+    if ( ( fd = open( name, O_RDONLY ) ) == -1 )
+        return 0;
+
+    if (    fstat( fd, &st ) == -1
+         || ! S_ISREG( st.st_mode )
+         || st.st_size <= 0
+         || ( off_t ) ( len = st.st_size ) != st.st_size )
+    {
+        close( fd );
+        return 0;
+    }
+
+    map = mmap( NULL, len, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    if ( map == MAP_FAILED )
+        return 0;
+
+    posix_madvise( map, len, POSIX_MADV_SEQUENTIAL );
+
+    if ( sha->add( &sha->context, map, len ) != SHA_DIGEST_OK )
+        *result = JOB_NO_ADD;
+
+    munmap( map, len );
+    return 1;
+}
+#endif
+
+
+/*---------------------------------------------------------------*
+ * Hashes a single input, using a context of its own
+ *---------------------------------------------------------------*/
+
+static int
+hash_job( const sha_t * proto,
+          job_t       * job,
+          int           use_mmap )
 {
+    sha_t sha = *proto;
     FILE *fp;
     unsigned char buf[ BUF_SIZE ];
     size_t count;
+    int result = JOB_OK;
+
+
+    if ( sha.init( &sha.context ) != SHA_DIGEST_OK )
+        return JOB_NO_INIT;
+
+#ifdef USE_MMAP
+    if ( ! ( use_mmap && job->name && add_mapped( &sha, job->name, &result ) ) )
+#else
+    ( void ) use_mmap;
+#endif
+    {
+        if ( ! job->name )
+            fp = stdin;
+        else if ( ( fp = fopen( job->name, "rb" ) ) == NULL )
+            return JOB_NO_OPEN;
+
+        while ( ( count = fread( buf, 1, BUF_SIZE, fp ) ) > 0 )
+            if ( sha.add( &sha.context, buf, count ) != SHA_DIGEST_OK )
+            {
+                result = JOB_NO_ADD;
+                break;
+            }
+
+        if ( result == JOB_OK && ferror( fp ) )
+            result = JOB_NO_READ;
+
+        if ( fp != stdin )
+            fclose( fp );
+    }
+
+    if ( result != JOB_OK )
+        return result;
+
+    if ( sha.calc( &sha.context, job->digest ) != SHA_DIGEST_OK )
+        return JOB_NO_CALC;
+
+    return JOB_OK;
+}
+
+
+/*---------------------------------------------------------------*
+ * Takes inputs not yet hashed by any other thread until none
+ * are left
+ *---------------------------------------------------------------*/
+
+static void *
+worker( void * arg )
+{
+    pool_t *pool = arg;
+    size_t i;
+
+
+    for ( ; ; )
+    {
+#ifdef USE_THREADS
+        pthread_mutex_lock( &pool->mutex );
+#endif
+        i = pool->next_job < pool->num_jobs ? pool->next_job++ : pool->num_jobs;
+#ifdef USE_THREADS
+        pthread_mutex_unlock( &pool->mutex );
+#endif
+
+        if ( i == pool->num_jobs )
+            return NULL;
+
+        pool->jobs[ i ].result = hash_job( pool->sha, pool->jobs + i,
+                                           pool->use_mmap );
+
+#ifdef USE_THREADS
+        pthread_mutex_lock( &pool->mutex );
+        pool->jobs[ i ].done = 1;
+        pthread_cond_signal( &pool->done_cond );
+        pthread_mutex_unlock( &pool->mutex );
+#else
+        pool->jobs[ i ].done = 1;
+#endif
+    }
+}
+
+
+/*---------------------------------------------------------------*
+ * Prints the digest of an input or what went wrong, returns 0
+ * on failure
+ *---------------------------------------------------------------*/
+
+static int
+print_job( const job_t * job,
+           size_t        hashlen,
+           int           with_name )
+{
+    const char *name = job->name ? job->name : "-";
+    size_t i;
+
+
+    switch ( job->result )
+    {
+        case JOB_OK :
+            for ( i = 0; i < hashlen; i++ )
+                printf( "%02x", job->digest[ i ] );
+            if ( with_name )
+                printf( "  %s", name );
+            puts( "" );
+            return 1;
+
+        case JOB_NO_OPEN :
+            fprintf( stderr, "Can't open file %s for reading.\n", name );
+            break;
+
+        case JOB_NO_READ :
+            fprintf( stderr, "Failed to read from %s.\n", name );
+            break;
+
+        case JOB_NO_INIT :
+            fprintf( stderr, "Failed to initialize SHA library.\n" );
+            break;
+
+        case JOB_NO_ADD :
+            fprintf( stderr, "Failed to pass data for SHA digest.\n" );
+            break;
+
+        default :
+            fprintf( stderr, "Failed to calculate digest.\n" );
+            break;
+    }
+
+    return 0;
+}
+
+
+/*---------------------------------------------------------------*
+ *---------------------------------------------------------------*/
+
+int
+main( int     argc,
+      char ** argv )
+{
     sha_t sha;
-    unsigned char digest[ SHA512_HASH_SIZE ];  /* SHA512 has longest digest */
+    pool_t pool;
+    int use_mmap;
+    size_t num_threads;
+    int first;
+    int ok = 1;
     size_t i;
+#ifdef USE_THREADS
+    pthread_t *threads = NULL;
+    size_t started = 0;
+#endif
     char * arg = strrchr( argv[ 0 ], '/' );
 
     if (    argc > 1
          && ( ! strcmp( argv[ 1 ], "-h" ) || ! strcmp( argv[ 1 ], "--help" ) ) )
         usage( arg ? arg + 1 : argv[ 0 ] );
 
-    fp = get_opts( &sha, argv );
+    first = get_opts( &sha, argc, argv, &use_mmap, &num_threads );
 
-    if ( sha.init( &sha.context ) != SHA_DIGEST_OK )
+    pool.sha      = &sha;
+    pool.num_jobs = first < argc ? ( size_t ) ( argc - first ) : 1;
+    pool.next_job = 0;
+    pool.use_mmap = use_mmap;
+
+    if ( ( pool.jobs = calloc( pool.num_jobs, sizeof *pool.jobs ) ) == NULL )
     {
-        fclose( fp );
-        fprintf( stderr, "Failed to initialize SHA library.\n" );
+        fprintf( stderr, "Running out of memory.\n" );
         return EXIT_FAILURE;
     }
 
-    while ( ( count = fread( buf, 1, BUF_SIZE, fp ) ) > 0 )
-        if ( sha.add( &sha.context, buf, count ) != SHA_DIGEST_OK )
-        {
-            fclose( fp );
-            fprintf( stderr, "Failed to pass data for SHA digest.\n" );
-            return EXIT_FAILURE;
-        }
+    for ( i = 0; first < argc && i < pool.num_jobs; i++ )
+        if ( strcmp( argv[ first + i ], "-" ) )
+            pool.jobs[ i ].name = argv[ first + i ];
+
+    /* Start the threads (if there's more than one thing to be done at
+       once) and print the results in order as they become available.
+       Without threads everything gets done before printing. */
+
+#ifdef USE_THREADS
+    if ( num_threads > pool.num_jobs )
+        num_threads = pool.num_jobs;
+
+    pthread_mutex_init( &pool.mutex, NULL );
+    pthread_cond_init( &pool.done_cond, NULL );
+
+    if (    num_threads > 1
+         && ( threads = malloc( num_threads * sizeof *threads ) ) != NULL )
+        while (    started < num_threads
+                && ! pthread_create( threads + started, NULL, worker, &pool ) )
+            started++;
 
-    fclose( fp );
+    if ( ! started )
+        worker( &pool );
 
-    if ( sha.calc( &sha.context, digest ) != SHA_DIGEST_OK )
+    for ( i = 0; i < pool.num_jobs; i++ )
     {
-        fprintf( stderr, "Failed to calculate digest.\n" );
-        return EXIT_FAILURE;
+        pthread_mutex_lock( &pool.mutex );
+        while ( ! pool.jobs[ i ].done )
+            pthread_cond_wait( &pool.done_cond, &pool.mutex );
+        pthread_mutex_unlock( &pool.mutex );
+
+        ok &= print_job( pool.jobs + i, sha.hashlen, pool.num_jobs > 1 );
+    }
+
+    if ( started )
+    {
+        while ( started-- )
+            pthread_join( threads[ started ], NULL );
+        free( threads );
     }
 
-    for ( i = 0; i < sha.hashlen; i++ )
-        printf( "%02x", digest[ i ] );
-    puts( "" );
+    pthread_cond_destroy( &pool.done_cond );
+    pthread_mutex_destroy( &pool.mutex );
+#else
+    ( void ) num_threads;
+
+    worker( &pool );
+
+    for ( i = 0; i < pool.num_jobs; i++ )
+        ok &= print_job( pool.jobs + i, sha.hashlen, pool.num_jobs > 1 );
+#endif
+
+    free( pool.jobs );
 
-    return EXIT_SUCCESS;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 
@@ -0,0 +1,612 @@
+/*
+ *  Checks the specialized SHA-256 kernels and precomputed plans, the
+ *  SHA-1 and SHA-512 backends and the one-block functions of all hash
+ *  families, used for hashing short, fixed-length messages, against
+ *  the general, context based implementation for every message length
+ *  they accept.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <sha_digest.h>
+
+#define ROUNDS 16
+
+
+/*---------------------------------------------------------------*
+ * Calculates the reference digest via the context based functions
+ *---------------------------------------------------------------*/
+
+static void
+reference( const unsigned char * msg,
+           size_t                num_bits,
+           unsigned char         digest[ SHA256_HASH_SIZE ] )
+{
+    SHA256_Context ctx;
+
+    sha256_initialize( &ctx );
+    sha256_add_bits( &ctx, msg, num_bits );
+    sha256_calculate( &ctx, digest );
+}
+
+
+/*---------------------------------------------------------------*
+ *---------------------------------------------------------------*/
+
+static int
+report( const char          * what,
+        size_t                num_bits,
+        const unsigned char * expected,
+        const unsigned char * got )
+{
+    size_t i;
+
+    fprintf( stderr, "%s mismatch for %lu bits\n  expected ", what,
+             ( unsigned long ) num_bits );
+    for ( i = 0; i < SHA256_HASH_SIZE; i++ )
+        fprintf( stderr, "%02x", expected[ i ] );
+    fprintf( stderr, "\n  got      " );
+    for ( i = 0; i < SHA256_HASH_SIZE; i++ )
+        fprintf( stderr, "%02x", got[ i ] );
+    fprintf( stderr, "\n" );
+
+    return 1;
+}
+
+
+/*---------------------------------------------------------------*
+ *---------------------------------------------------------------*/
+
+static int
+test_oneblock( int backend )
+{
+    unsigned char msg[ 64 ];
+    unsigned char expected[ SHA256_HASH_SIZE ],
+                  got[ SHA256_HASH_SIZE ];
+    size_t num_bits, i;
+    int r,
+        failed = 0;
+
+
+    for ( r = 0; r < ROUNDS; r++ )
+        for ( num_bits = 0; num_bits <= SHA256_ONEBLOCK_MAX_BITS; num_bits++ )
+        {
+            /* Garbage behind the last bit must not make a difference */
+
+            for ( i = 0; i < sizeof msg; i++ )
+                msg[ i ] = rand( ) & 0xFF;
+
+            /* The reference is always calculated by the portable code */
+
+            sha256_set_backend( SHA256_BACKEND_PORTABLE );
+            reference( msg, num_bits, expected );
+            sha256_set_backend( backend );
+
+            if ( sha256_oneblock( msg, num_bits, got ) != SHA_DIGEST_OK )
+            {
+                fprintf( stderr, "sha256_oneblock() failed for %lu bits\n",
+                         ( unsigned long ) num_bits );
+                return 1;
+            }
+
+            if ( memcmp( expected, got, SHA256_HASH_SIZE ) )
+                failed |= report( "sha256_oneblock()", num_bits,
+                                  expected, got );
+        }
+
+    if ( sha256_oneblock( msg, SHA256_ONEBLOCK_MAX_BITS + 1, got )
+                                                != SHA_DIGEST_INPUT_TOO_LONG )
+    {
+        fprintf( stderr, "sha256_oneblock() accepted too long input\n" );
+        failed = 1;
+    }
+
+    return failed;
+}
+
+
+/*---------------------------------------------------------------*
+ * Hashes batches of all sizes up to a few times the number of lanes
+ * of the backend, so every way of splitting them up gets exercised
+ *---------------------------------------------------------------*/
+
+static int
+test_multi( int backend )
+{
+    unsigned char msg[ 3 * 16 ][ 64 ];
+    const void   *data[ 3 * 16 ];
+    unsigned char expected[ 3 * 16 ][ SHA256_HASH_SIZE ],
+                  got[ 3 * 16 ][ SHA256_HASH_SIZE ],
+                 *digest[ 3 * 16 ];
+    size_t num_bits, count, i, j;
+    int failed = 0;
+
+
+    for ( i = 0; i < 3 * 16; i++ )
+    {
+        data[ i ]   = msg[ i ];
+        digest[ i ] = got[ i ];
+    }
+
+
+    for ( num_bits = 0; num_bits <= SHA256_ONEBLOCK_MAX_BITS; num_bits += 7 )
+        for ( count = 1; count <= 3 * 16; count++ )
+        {
+            for ( i = 0; i < count; i++ )
+                for ( j = 0; j < sizeof msg[ i ]; j++ )
+                    msg[ i ][ j ] = rand( ) & 0xFF;
+
+            sha256_set_backend( SHA256_BACKEND_PORTABLE );
+            for ( i = 0; i < count; i++ )
+                reference( msg[ i ], num_bits, expected[ i ] );
+
+            sha256_set_backend( backend );
+            if ( sha256_oneblock_multi( data, num_bits, digest, count )
+                                                            != SHA_DIGEST_OK )
+            {
+                fprintf( stderr, "sha256_oneblock_multi() failed for %lu "
+                         "bits\n", ( unsigned long ) num_bits );
+                return 1;
+            }
+
+            for ( i = 0; i < count; i++ )
+                if ( memcmp( expected[ i ], got[ i ], SHA256_HASH_SIZE ) )
+                    failed |= report( "sha256_oneblock_multi()", num_bits,
+                                      expected[ i ], got[ i ] );
+
+            /* The fixed-width functions use their kernel independent
+               of the selected backend, if the CPU supports it */
+
+            if ( count == 8 || count == 16 )
+            {
+                memset( got, 0, sizeof got );
+                if ( count == 8 )
+                    sha256_x8( data, num_bits, digest );
+                else
+                    sha256_x16( data, num_bits, digest );
+
+                for ( i = 0; i < count; i++ )
+                    if ( memcmp( expected[ i ], got[ i ], SHA256_HASH_SIZE ) )
+                        failed |= report( count == 8 ? "sha256_x8()"
+                                                     : "sha256_x16()",
+                                          num_bits, expected[ i ], got[ i ] );
+            }
+        }
+
+    return failed;
+}
+
+
+/*---------------------------------------------------------------*
+ * Compares only the first 'out_bits' bits of two digests
+ *---------------------------------------------------------------*/
+
+static int
+prefix_differs( const unsigned char * a,
+                const unsigned char * b,
+                size_t                out_bits )
+{
+    if ( memcmp( a, b, out_bits / 8 ) )
+        return 1;
+
+    return    out_bits % 8
+           && ( ( a[ out_bits / 8 ] ^ b[ out_bits / 8 ] )
+                & ( 0xFF << ( 8 - out_bits % 8 ) ) & 0xFF );
+}
+
+
+/*---------------------------------------------------------------*
+ * Hashes messages of every length via a plan set up for it, one
+ * by one and in batches. The plans are for random output widths,
+ * only that many bits of the digest have to be correct.
+ *---------------------------------------------------------------*/
+
+static int
+test_plan( int backend )
+{
+    SHA256_Plan   plan;
+    unsigned char msg[ 3 * 16 ][ 64 ];
+    const void   *data[ 3 * 16 ];
+    unsigned char expected[ 3 * 16 ][ SHA256_HASH_SIZE ],
+                  got[ 3 * 16 ][ SHA256_HASH_SIZE ],
+                 *digest[ 3 * 16 ];
+    size_t num_bits, out_bits, count, i, j;
+    int failed = 0;
+
+
+    for ( i = 0; i < 3 * 16; i++ )
+    {
+        data[ i ]   = msg[ i ];
+        digest[ i ] = got[ i ];
+    }
+
+    for ( num_bits = 0; num_bits <= SHA256_ONEBLOCK_MAX_BITS; num_bits++ )
+    {
+        out_bits = num_bits % 4 ? 1 + rand( ) % ( 8 * SHA256_HASH_SIZE )
+                                : 8 * SHA256_HASH_SIZE;
+
+        if ( sha256_plan_init( &plan, num_bits, out_bits ) != SHA_DIGEST_OK )
+        {
+            fprintf( stderr, "sha256_plan_init() failed for %lu bits\n",
+                     ( unsigned long ) num_bits );
+            return 1;
+        }
+
+        count = 1 + rand( ) % ( 3 * 16 );
+
+        for ( i = 0; i < count; i++ )
+            for ( j = 0; j < sizeof msg[ i ]; j++ )
+                msg[ i ][ j ] = rand( ) & 0xFF;
+
+        sha256_set_backend( SHA256_BACKEND_PORTABLE );
+        for ( i = 0; i < count; i++ )
+            reference( msg[ i ], num_bits, expected[ i ] );
+        sha256_set_backend( backend );
+
+        if ( sha256_plan_hash( &plan, msg[ 0 ], got[ 0 ] ) != SHA_DIGEST_OK )
+        {
+            fprintf( stderr, "sha256_plan_hash() failed for %lu bits\n",
+                     ( unsigned long ) num_bits );
+            return 1;
+        }
+
+        if ( prefix_differs( expected[ 0 ], got[ 0 ], out_bits ) )
+            failed |= report( "sha256_plan_hash()", num_bits,
+                              expected[ 0 ], got[ 0 ] );
+
+        if ( sha256_plan_hash_multi( &plan, data, digest, count )
+                                                            != SHA_DIGEST_OK )
+        {
+            fprintf( stderr, "sha256_plan_hash_multi() failed for %lu "
+                     "bits\n", ( unsigned long ) num_bits );
+            return 1;
+        }
+
+        for ( i = 0; i < count; i++ )
+            if ( prefix_differs( expected[ i ], got[ i ], out_bits ) )
+                failed |= report( "sha256_plan_hash_multi()", num_bits,
+                                  expected[ i ], got[ i ] );
+    }
+
+    if ( sha256_plan_init( &plan, SHA256_ONEBLOCK_MAX_BITS + 1,
+                           8 * SHA256_HASH_SIZE )
+                                                != SHA_DIGEST_INPUT_TOO_LONG )
+    {
+        fprintf( stderr, "sha256_plan_init() accepted too long input\n" );
+        failed = 1;
+    }
+
+    if ( sha256_plan_init( &plan, 0, 8 * SHA256_HASH_SIZE + 1 )
+                                                    != SHA_DIGEST_INVALID_ARG )
+    {
+        fprintf( stderr, "sha256_plan_init() accepted too long output\n" );
+        failed = 1;
+    }
+
+    return failed;
+}
+
+
+/*---------------------------------------------------------------*
+ * The context based functions use the selected backend as well,
+ * check them with messages spanning several blocks
+ *---------------------------------------------------------------*/
+
+static int
+test_stream( int backend )
+{
+    static unsigned char msg[ 4096 ];
+    unsigned char expected[ SHA256_HASH_SIZE ],
+                  got[ SHA256_HASH_SIZE ];
+    size_t num_bits, i;
+    int failed = 0;
+
+
+    for ( i = 0; i < sizeof msg; i++ )
+        msg[ i ] = rand( ) & 0xFF;
+
+    for ( num_bits = 0; num_bits <= 8 * sizeof msg;
+          num_bits += 1 + rand( ) % 997 )
+    {
+        sha256_set_backend( SHA256_BACKEND_PORTABLE );
+        reference( msg, num_bits, expected );
+        sha256_set_backend( backend );
+        reference( msg, num_bits, got );
+
+        if ( memcmp( expected, got, SHA256_HASH_SIZE ) )
+            failed |= report( "sha256_calculate()", num_bits, expected, got );
+    }
+
+    return failed;
+}
+
+
+/*---------------------------------------------------------------*
+ * The one-block functions of the other hash families only come in
+ * a portable version, check them for every message length, too
+ *---------------------------------------------------------------*/
+
+#define FAMILY_TEST( alg, ALG )                                             \
+static int                                                                  \
+test_##alg( void )                                                          \
+{                                                                           \
+    unsigned char msg[ 128 ];                                               \
+    unsigned char expected[ ALG##_HASH_SIZE ],                              \
+                  got[ ALG##_HASH_SIZE ];                                   \
+    ALG##_Context ctx;                                                      \
+    size_t num_bits, i;                                                     \
+    int failed = 0;                                                         \
+                                                                            \
+                                                                            \
+    for ( num_bits = 0; num_bits <= ALG##_ONEBLOCK_MAX_BITS; num_bits++ )   \
+    {                                                                       \
+        for ( i = 0; i < sizeof msg; i++ )                                  \
+            msg[ i ] = rand( ) & 0xFF;                                      \
+                                                                            \
+        alg##_initialize( &ctx );                                           \
+        alg##_add_bits( &ctx, msg, num_bits );                              \
+        alg##_calculate( &ctx, expected );                                  \
+                                                                            \
+        if (    alg##_oneblock( msg, num_bits, got ) != SHA_DIGEST_OK       \
+             || memcmp( expected, got, ALG##_HASH_SIZE ) )                  \
+        {                                                                   \
+            fprintf( stderr, #alg "_oneblock() failed for %lu bits\n",      \
+                     ( unsigned long ) num_bits );                          \
+            failed = 1;                                                     \
+        }                                                                   \
+    }                                                                       \
+                                                                            \
+    if ( alg##_oneblock( msg, ALG##_ONEBLOCK_MAX_BITS + 1, got )            \
+                                                != SHA_DIGEST_INPUT_TOO_LONG ) \
+    {                                                                       \
+        fprintf( stderr, #alg "_oneblock() accepted too long input\n" );    \
+        failed = 1;                                                         \
+    }                                                                       \
+                                                                            \
+    return failed;                                                          \
+}
+
+FAMILY_TEST( sha1,   SHA1   )
+FAMILY_TEST( sha224, SHA224 )
+FAMILY_TEST( sha384, SHA384 )
+FAMILY_TEST( sha512, SHA512 )
+
+
+/*---------------------------------------------------------------*
+ * Compares a digest with the hex string of the expected one
+ *---------------------------------------------------------------*/
+
+static int
+matches_hex( const unsigned char * digest,
+             const char          * hex,
+             size_t                size )
+{
+    char   buf[ 3 ];
+    size_t i;
+
+    for ( i = 0; i < size; i++ )
+    {
+        sprintf( buf, "%02x", digest[ i ] );
+        if ( memcmp( buf, hex + 2 * i, 2 ) )
+            return 0;
+    }
+
+    return 1;
+}
+
+
+/*---------------------------------------------------------------*
+ * SHA-1 and SHA-384/512 have backends of their own (the latter two
+ * sharing the ones of SHA-512). Check that with each of them the
+ * one-block functions give the digest of "abc" from FIPS 180-3 for
+ * a full batch, then compare them for batches of all sizes up to
+ * three times the largest number of lanes, as well as the context
+ * based functions (with the messages of a batch hashed as a single
+ * long one), with the portable code
+ *---------------------------------------------------------------*/
+
+#define BACKEND_TEST( alg, ALG, bk, BK, abc )                               \
+static int                                                                  \
+test_##alg##_backend( int backend )                                         \
+{                                                                           \
+    unsigned char msg[ 3 * 8 ][ 128 ];                                      \
+    const void   *data[ 3 * 8 ];                                            \
+    unsigned char expected[ 3 * 8 ][ ALG##_HASH_SIZE ],                     \
+                  expected_long[ ALG##_HASH_SIZE ],                         \
+                  got[ 3 * 8 ][ ALG##_HASH_SIZE ],                          \
+                 *digest[ 3 * 8 ];                                          \
+    ALG##_Context ctx;                                                      \
+    size_t num_bits, count, i, j;                                           \
+    int failed = 0;                                                         \
+                                                                            \
+                                                                            \
+    for ( i = 0; i < 8; i++ )                                               \
+    {                                                                       \
+        data[ i ]   = "abc";                                                \
+        digest[ i ] = got[ i ];                                             \
+    }                                                                       \
+                                                                            \
+    bk##_set_backend( backend );                                            \
+    alg##_oneblock_multi( data, 24, digest, 8 );                            \
+    for ( i = 0; i < 8; i++ )                                               \
+        if ( ! matches_hex( got[ i ], abc, ALG##_HASH_SIZE ) )              \
+        {                                                                   \
+            fprintf( stderr, #alg "_oneblock_multi() gives wrong digest "   \
+                     "for \"abc\"\n" );                                     \
+            return 1;                                                       \
+        }                                                                   \
+                                                                            \
+    for ( i = 0; i < 3 * 8; i++ )                                           \
+    {                                                                       \
+        data[ i ]   = msg[ i ];                                             \
+        digest[ i ] = got[ i ];                                             \
+    }                                                                       \
+                                                                            \
+    for ( num_bits = 0; num_bits <= ALG##_ONEBLOCK_MAX_BITS; num_bits += 5 ) \
+        for ( count = 1; count <= 3 * 8; count++ )                          \
+        {                                                                   \
+            for ( i = 0; i < count; i++ )                                   \
+                for ( j = 0; j < sizeof msg[ i ]; j++ )                     \
+                    msg[ i ][ j ] = rand( ) & 0xFF;                         \
+                                                                            \
+            bk##_set_backend( BK##_BACKEND_PORTABLE );                      \
+            for ( i = 0; i < count; i++ )                                   \
+            {                                                               \
+                alg##_initialize( &ctx );                                   \
+                alg##_add_bits( &ctx, msg[ i ], num_bits );                 \
+                alg##_calculate( &ctx, expected[ i ] );                     \
+            }                                                               \
+            alg##_initialize( &ctx );                                       \
+            alg##_add_bits( &ctx, msg, count * num_bits );                  \
+            alg##_calculate( &ctx, expected_long );                         \
+            bk##_set_backend( backend );                                    \
+                                                                            \
+            alg##_initialize( &ctx );                                       \
+            alg##_add_bits( &ctx, msg, count * num_bits );                  \
+            alg##_calculate( &ctx, got[ 0 ] );                              \
+            if ( memcmp( expected_long, got[ 0 ], ALG##_HASH_SIZE ) )       \
+            {                                                               \
+                fprintf( stderr, #alg "_calculate() failed for %lu bits\n", \
+                         ( unsigned long ) ( count * num_bits ) );          \
+                failed = 1;                                                 \
+            }                                                               \
+                                                                            \
+            memset( got, 0, sizeof got );                                   \
+            if ( alg##_oneblock_multi( data, num_bits, digest, count )      \
+                                                        != SHA_DIGEST_OK )  \
+            {                                                               \
+                fprintf( stderr, #alg "_oneblock_multi() failed for %lu "   \
+                         "bits\n", ( unsigned long ) num_bits );            \
+                return 1;                                                   \
+            }                                                               \
+                                                                            \
+            for ( i = 0; i < count; i++ )                                   \
+                if ( memcmp( expected[ i ], got[ i ], ALG##_HASH_SIZE ) )   \
+                {                                                           \
+                    fprintf( stderr, #alg "_oneblock_multi() mismatch for " \
+                             "%lu bits\n", ( unsigned long ) num_bits );    \
+                    failed = 1;                                             \
+                }                                                           \
+        }                                                                   \
+                                                                            \
+    return failed;                                                          \
+}
+
+BACKEND_TEST( sha1,   SHA1,   sha1,   SHA1,
+              "a9993e364706816aba3e25717850c26c9cd0d89d" )
+BACKEND_TEST( sha384, SHA384, sha512, SHA512,
+              "cb00753f45a35e8bb5a03d699ac65007272c32ab0eded163"
+              "1a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7" )
+BACKEND_TEST( sha512, SHA512, sha512, SHA512,
+              "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea2"
+              "0a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd"
+              "454d4423643ce80e2a9ac94fa54ca49f" )
+
+
+/*---------------------------------------------------------------*
+ *---------------------------------------------------------------*/
+
+int
+main( void )
+{
+    int backend,
+        failed = 0;
+
+
+    srand( ( unsigned int ) time( NULL ) );
+
+    for ( backend = SHA256_BACKEND_PORTABLE; backend < SHA256_BACKEND_COUNT;
+          backend++ )
+    {
+        if ( ! sha256_backend_available( backend ) )
+        {
+            printf( "%-10s not supported, skipped\n",
+                    sha256_backend_name( backend ) );
+            continue;
+        }
+
+        printf( "%-10s ", sha256_backend_name( backend ) );
+        fflush( stdout );
+
+        if (    test_oneblock( backend )
+             || test_multi( backend )
+             || test_plan( backend )
+             || test_stream( backend ) )
+        {
+            puts( "FAILED" );
+            failed = 1;
+        }
+        else
+            puts( "OK" );
+    }
+
+    for ( backend = SHA1_BACKEND_PORTABLE; backend < SHA1_BACKEND_COUNT;
+          backend++ )
+    {
+        if ( ! sha1_backend_available( backend ) )
+            continue;
+
+        printf( "%-6s %-9s ", "sha1", sha1_backend_name( backend ) );
+        fflush( stdout );
+
+        if ( test_sha1_backend( backend ) )
+        {
+            puts( "FAILED" );
+            failed = 1;
+        }
+        else
+            puts( "OK" );
+    }
+    sha1_set_backend( SHA1_BACKEND_PORTABLE );
+
+    for ( backend = SHA512_BACKEND_PORTABLE; backend < SHA512_BACKEND_COUNT;
+          backend++ )
+    {
+        if ( ! sha512_backend_available( backend ) )
+            continue;
+
+        printf( "%-6s %-9s ", "sha512", sha512_backend_name( backend ) );
+        fflush( stdout );
+
+        if ( test_sha384_backend( backend ) || test_sha512_backend( backend ) )
+        {
+            puts( "FAILED" );
+            failed = 1;
+        }
+        else
+            puts( "OK" );
+    }
+    sha512_set_backend( SHA512_BACKEND_PORTABLE );
+
+    printf( "%-10s ", "families" );
+    if (    test_sha1( )
+         || test_sha224( )
+         || test_sha384( )
+         || test_sha512( ) )
+    {
+        puts( "FAILED" );
+        failed = 1;
+    }
+    else
+        puts( "OK" );
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
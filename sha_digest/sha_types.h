@@ -31,7 +31,7 @@ extern "C" {
 #include <stdlib.h>
 
 
-#if defined __STRICT_ANSI__
+#if defined __STRICT_ANSI__ && ! defined __cplusplus
 #define inline
 #endif
 
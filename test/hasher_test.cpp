@@ -0,0 +1,173 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../chain_index.hpp"
+#include "../datatypes.hpp"
+#include "../hash_algo.hpp"
+#include "../memory_store.hpp"
+#include "../thread_hasher.hpp"
+
+
+/*
+ * Runs the hasher loop on a memory store: that a collision it reports is
+ * one, and that a store too small for the walk ends it with a result of 0
+ * queries rather than an exception. Checks the chain positions stored
+ * instead of preimages too: that they fit into the width main gives them,
+ * and that the preimages replayed from checkpoints are the ones the chains
+ * went through. Prints the checks that fail and exits with 1 if there are
+ * any.
+ */
+
+static size_t failures = 0;
+
+
+static void check(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cout << "failed: " << what << std::endl;
+        failures++;
+    }
+}
+
+
+// seeds of chains chains, as main sets them up
+static std::vector<Hash<Sha256Algo>> chainSeeds(size_t chains, size_t bitlen) {
+    std::vector<Hash<Sha256Algo>> seeds(chains);
+    for (size_t i = 0; i < chains; i++) {
+        Sha256Algo::hash_string("hasher test " + std::to_string(i), &seeds[i][0]);
+        trimHash(&seeds[i], bitlen);
+    }
+    return seeds;
+}
+
+
+/*
+ * Walks chains chains of bitlen bit hashes into a new store (returned in
+ * store) for elements hashes, returns the result and sets the hash count.
+ */
+static DbRes<Sha256Algo> walk(size_t chains, size_t bitlen, ull elements, size_t checkpoint_interval, ull *hashes, MemoryStore **store) {
+    std::vector<Hash<Sha256Algo>> seeds = chainSeeds(chains, bitlen);
+    size_t len = (bitlen + 7) / 8;
+    *store = new MemoryStore(elements, len, checkpoint_interval ? sizeof(ull) : len);
+    DbReqQueue<Sha256Algo> dbq(1);
+    HasherResQueue resq(1);
+    DbResQueue<Sha256Algo> storeq(1);
+    SearchStats stats;
+    DbRes<Sha256Algo> result;
+
+    thread_hasher<Sha256Algo>(&seeds, bitlen, nullptr, &dbq, &resq, &stats, *store, checkpoint_interval, &storeq);
+
+    check(storeq.pop(result) && resq.pop(*hashes), "hasher results");
+    return result;
+}
+
+
+static void collision(size_t chains, size_t bitlen, size_t checkpoint_interval) {
+    std::string what = "collision of " + std::to_string(chains) + " chains at " + std::to_string(bitlen)
+                       + " bits, checkpoint interval " + std::to_string(checkpoint_interval);
+    ull hashes = 0;
+    MemoryStore *store;
+    DbRes<Sha256Algo> result = walk(chains, bitlen, 1ULL << (bitlen / 2 + 3), checkpoint_interval, &hashes, &store);
+    delete store;
+
+    // both preimages hash to the same prefix
+    Hash<Sha256Algo> first = Hash<Sha256Algo>(), second = Hash<Sha256Algo>();
+    Sha256Algo::hash_oneblock(&std::get<0>(result)[0], bitlen, &first[0]);
+    Sha256Algo::hash_oneblock(&std::get<1>(result)[0], bitlen, &second[0]);
+    trimHash(&first, bitlen);
+    trimHash(&second, bitlen);
+    check(std::get<3>(result) == 1, what + ": found");
+    check(first == std::get<2>(result) && second == std::get<2>(result), what + ": preimages hash to it");
+    check(std::get<0>(result) != std::get<1>(result), what + ": two preimages");
+}
+
+
+static void full(size_t checkpoint_interval) {
+    std::string what = "full store, checkpoint interval " + std::to_string(checkpoint_interval);
+    ull hashes = 0;
+    MemoryStore *store;
+    DbRes<Sha256Algo> result = walk(1, 64, 100, checkpoint_interval, &hashes, &store);
+
+    // every hash but the one refused got in
+    check(std::get<3>(result) == 0, what + ": no collision");
+    check(hashes == store->capacity() + 1 && store->size() == store->capacity(), what + ": hash count");
+    delete store;
+}
+
+
+/*
+ * Steps chains chains for steps steps, recording the preimage at every
+ * position and the checkpoints every interval steps, then replays the
+ * positions around every checkpoint (on it, just before and just after).
+ */
+static void replay(size_t chains, size_t interval, ull steps) {
+    const size_t bitlen = 40;
+    std::string what = "replay of " + std::to_string(chains) + " chains, checkpoint interval " + std::to_string(interval);
+    std::vector<Hash<Sha256Algo>> vals = chainSeeds(chains, bitlen);
+    std::vector<Hash<Sha256Algo>> preimages, checkpoints;
+    Sha256Algo::Plan plan;
+    Sha256Algo::plan_init(&plan, bitlen);
+
+    for (ull step = 0; step < steps; step++) {
+        if (step % interval == 0)
+            checkpoints.insert(checkpoints.end(), vals.begin(), vals.end());
+        for (auto & val : vals) {
+            Hash<Sha256Algo> hash = Hash<Sha256Algo>();
+            preimages.push_back(val);
+            Sha256Algo::hash_oneblock(&val[0], bitlen, &hash[0]);
+            trimHash(&hash, bitlen);
+            val = hash;
+        }
+    }
+
+    bool ok = true;
+    for (ull step = 0; step < steps; step += interval)
+        for (ull at : {step - 1, step, step + 1})
+            if (at < steps)
+                for (size_t chain = 0; chain < chains; chain++) {
+                    ull pos = at * chains + chain;
+                    ok = ok && replayChain<Sha256Algo>(checkpoints, chains, interval, pos, &plan, bitlen) == preimages[pos];
+                }
+    check(ok, what);
+}
+
+
+/*
+ * The largest position a store sized for elements hashes can hold, in the
+ * width main gives the positions.
+ */
+static void indexWidth(ull elements) {
+    std::string what = "positions of a store for " + std::to_string(elements) + " hashes";
+    ull positions = MemoryStore::capacity_for(elements) - 1;
+    std::vector<uch> index(indexBytes(positions));
+
+    encodeIndex(positions, &index);
+    check(decodeIndex(index) == positions, what + ": round-trip");
+    // and not a byte more than needed
+    check(index.size() == 1 || positions >> (8 * (index.size() - 1)), what + ": width");
+}
+
+
+int main() {
+    collision(1, 24, 0);
+    collision(4, 24, 0);
+    collision(3, 32, 0);
+
+    full(0);
+    full(7);
+
+    replay(1, 1, 20);
+    replay(3, 1, 20);
+    replay(3, 7, 50);
+    replay(4, 4096, 3 * 4096 + 2);
+
+    for (ull elements : {1ULL, 100ULL, 239ULL, 240ULL, 60000ULL, 1000000ULL, 1ULL << 32, 1000000000000000ULL})
+        indexWidth(elements);
+
+    if (failures) {
+        std::cout << failures << " hasher checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "Hasher checks passed." << std::endl;
+    return 0;
+}
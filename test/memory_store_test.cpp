@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "../datatypes.hpp"
+#include "../memory_store.hpp"
+
+
+/*
+ * Checks the memory store: that it finds exactly the keys inserted (also
+ * when all of them share a hash and tag, and probe past the last group),
+ * that it refuses more than its capacity, and that of several threads
+ * inserting the same keys at once exactly one gets each key in, while
+ * the others find its value. Prints the checks that fail and exits with
+ * 1 if there are any.
+ */
+
+const size_t LEN = 5;
+
+static size_t failures = 0;
+
+
+static void check(bool ok, const char *what) {
+    if (!ok) {
+        std::cout << "failed: " << what << std::endl;
+        failures++;
+    }
+}
+
+
+// big endian bytes of n, as keys and values
+static void encode(ull n, uch *out) {
+    for (size_t i = LEN; i--; n >>= 8)
+        out[i] = static_cast<uch>(n);
+}
+
+
+static ull decode(const uch *in) {
+    ull n = 0;
+    for (size_t i = 0; i < LEN; i++)
+        n = (n << 8) | in[i];
+    return n;
+}
+
+
+/*
+ * Inserts keys 0 to count - 1 with value 3 * key + 1 and hash hash(key),
+ * then checks that each one is found with its value.
+ */
+template <class Hash>
+static void insertFind(MemoryStore *store, ull count, Hash hash, const char *what) {
+    uch key[LEN], value[LEN], found[LEN];
+    bool ok = true;
+
+    for (ull k = 0; k < count; k++) {
+        encode(k, key);
+        encode(3 * k + 1, value);
+        ok = ok && !store->find_or_insert(key, value, hash(k), found);
+    }
+    for (ull k = 0; k < count; k++) {
+        encode(k, key);
+        encode(0, value);
+        ok = ok && store->find_or_insert(key, value, hash(k), found) && decode(found) == 3 * k + 1;
+    }
+
+    check(ok && store->size() == count, what);
+}
+
+
+static void sequential() {
+    MemoryStore spread(10000, LEN, LEN);
+    insertFind(&spread, 10000, [](ull k) { return bloomMix(k); }, "keys with spread hashes");
+
+    // the same tag everywhere, only the keys tell them apart
+    MemoryStore same(1000, LEN, LEN);
+    insertFind(&same, 500, [](ull) { return 0x1234ULL; }, "keys with the same hash");
+
+    // starting in the last group, probing wraps around to the first
+    MemoryStore last(1000, LEN, LEN);
+    insertFind(&last, 500, [](ull) { return ~0ULL; }, "keys probing past the last group");
+}
+
+
+static void full() {
+    MemoryStore store(100, LEN, LEN);
+    insertFind(&store, store.capacity(), [](ull k) { return bloomMix(k); }, "filling up to the capacity");
+
+    uch key[LEN], found[LEN];
+    encode(store.capacity(), key);
+    bool thrown = false;
+    try {
+        store.find_or_insert(key, key, bloomMix(store.capacity()), found);
+    } catch (MemoryStoreFull &) {
+        thrown = true;
+    }
+    check(thrown, "MemoryStoreFull beyond the capacity");
+    check(store.size() == store.capacity(), "size unchanged by a refused insert");
+
+    // what was in there still is
+    encode(0, key);
+    check(store.find_or_insert(key, key, bloomMix(0), found) && decode(found) == 1,
+          "keys found after a refused insert");
+}
+
+
+/*
+ * Every thread inserts all keys, in an order of its own, with its number
+ * as the value, and notes for each key the value it ended up with: its
+ * own if it got the key in, otherwise the one found.
+ */
+static void insertAll(MemoryStore *store, ull keys, ull (*hash)(ull), size_t thread, std::vector<ull> *seen, size_t *inserted) {
+    uch key[LEN], value[LEN], found[LEN];
+    std::vector<ull> order(keys);
+    std::mt19937 rng(static_cast<unsigned>(thread));
+
+    for (ull k = 0; k < keys; k++)
+        order[k] = k;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    encode(thread, value);
+    for (auto k : order) {
+        encode(k, key);
+        if (store->find_or_insert(key, value, hash(k), found)) {
+            (*seen)[k] = decode(found);
+        } else {
+            (*seen)[k] = thread;
+            (*inserted)++;
+        }
+    }
+}
+
+
+static ull spreadHash(ull k) {
+    return bloomMix(k);
+}
+
+
+// few starting groups, so threads often wait for each other's slots
+static ull clusteredHash(ull k) {
+    return bloomMix(k % 64);
+}
+
+
+static void concurrent(ull keys, size_t threads, ull (*hash)(ull), const char *what) {
+    MemoryStore store(keys, LEN, LEN);
+    std::vector<std::vector<ull>> seen(threads, std::vector<ull>(keys));
+    std::vector<size_t> inserted(threads);
+    boost::thread_group group;
+
+    for (size_t t = 0; t < threads; t++)
+        group.create_thread([&, t] { insertAll(&store, keys, hash, t, &seen[t], &inserted[t]); });
+    group.join_all();
+
+    size_t total = 0;
+    for (auto n : inserted)
+        total += n;
+
+    bool agree = true;
+    for (ull k = 0; k < keys; k++)
+        for (size_t t = 1; t < threads; t++)
+            agree = agree && seen[t][k] == seen[0][k];
+
+    // a key got in twice if the threads disagree on its value
+    check(total == keys && store.size() == keys && agree, what);
+}
+
+
+int main() {
+    sequential();
+    full();
+    concurrent(200000, 8, spreadHash, "concurrent inserts with spread hashes");
+    // races show up only now and then, the threads preempting each other
+    // at just the wrong moment
+    for (int round = 0; round < 10; round++)
+        concurrent(20000, 8, clusteredHash, "concurrent inserts with clustered hashes");
+
+    if (failures) {
+        std::cout << failures << " memory store checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "Memory store checks passed." << std::endl;
+    return 0;
+}
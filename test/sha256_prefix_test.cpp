@@ -0,0 +1,98 @@
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "../sha_digest/sha256.h"
+#include "../sha256_prefix.hpp"
+
+
+/*
+ * Checks the header-only SHA-256 prefix core against sha_digest's
+ * sha256_oneblock() for every message length that fits into a single
+ * block, and for the digest truncations the hasher instantiates it with.
+ * Prints the cases that differ and exits with 1 if there are any.
+ */
+
+typedef unsigned char uch;
+
+
+// messages hashed per length: all zero, all one and random bits
+const size_t MESSAGES = 8;
+
+static std::mt19937 rng(42);
+static size_t failures = 0;
+
+
+template <size_t Bits, size_t OutBits>
+static void checkPrefix() {
+    // whole words of the digest get written, the rest has to stay as it is
+    const size_t written = 4 * ((OutBits + 31) / 32);
+
+    for (size_t m = 0; m < MESSAGES; m++) {
+        uch in[64], ref[SHA256_HASH_SIZE], out[SHA256_HASH_SIZE];
+
+        for (auto & byte : in)
+            byte = m == 0 ? 0x00 : m == 1 ? 0xFF : static_cast<uch>(rng());
+
+        sha256_oneblock(in, Bits, ref);
+        memset(out, 0xA5, sizeof out);
+        sha256Prefix<Bits, OutBits>(in, out);
+
+        bool ok = !memcmp(out, ref, written);
+        for (size_t i = written; i < sizeof out; i++)
+            ok = ok && out[i] == 0xA5;
+
+        if (!ok) {
+            std::cout << "sha256Prefix<" << Bits << ", " << OutBits << "> differs for message " << m << std::endl;
+            failures++;
+        }
+    }
+}
+
+
+/*
+ * All message lengths from Bits to Bits + Count - 1 with the whole
+ * digest, split in halves to keep the template recursion shallow.
+ */
+template <size_t Bits, size_t Count>
+struct CheckLengths {
+    static void run() {
+        CheckLengths<Bits, Count / 2>::run();
+        CheckLengths<Bits + Count / 2, Count - Count / 2>::run();
+    }
+};
+
+template <size_t Bits>
+struct CheckLengths<Bits, 1> {
+    static void run() {
+        checkPrefix<Bits, 256>();
+    }
+};
+
+
+int main() {
+    sha256_set_backend(SHA256_BACKEND_PORTABLE);
+
+    CheckLengths<0, SHA256_ONEBLOCK_MAX_BITS + 1>::run();
+
+    // the hasher's specialized loops hash Bitlen bits to Bitlen bits
+    checkPrefix<24, 24>();
+    checkPrefix<32, 32>();
+    checkPrefix<40, 40>();
+    checkPrefix<48, 48>();
+    checkPrefix<56, 56>();
+    checkPrefix<64, 64>();
+
+    // and words cut off in their middle
+    checkPrefix<1, 1>();
+    checkPrefix<33, 33>();
+    checkPrefix<255, 255>();
+    checkPrefix<447, 100>();
+
+    if (failures) {
+        std::cout << failures << " sha256Prefix checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "sha256Prefix matches sha256_oneblock." << std::endl;
+    return 0;
+}
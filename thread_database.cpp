@@ -8,11 +8,12 @@
 #include "thread_database.hpp"
 
 
-void thread_database(leveldb::DB *db, DbReqQueue *dbq, DbResQueue *resq) {
+template <class Algo>
+void thread_database(leveldb::DB *db, size_t len, DbReqQueue<Algo> *dbq, DbResQueue<Algo> *resq, SearchStats *stats) {
     // number of database read requests needed to confirm a collision (>=1)
     ull dbqueries = 0;
     // local storage of read/write requests
-    HashPairDbReqVect pairs;
+    HashPairDbReqVect<Algo> pairs;
     // helper variable
     std::string value;
     bool empty_batch;
@@ -32,10 +33,10 @@ void thread_database(leveldb::DB *db, DbReqQueue *dbq, DbResQueue *resq) {
                     batch.Put(
                             leveldb::Slice(
                                 reinterpret_cast<char*>(&pair.second.second[0]),
-                                pair.second.second.size()),
+                                len),
                             leveldb::Slice(
                                 reinterpret_cast<char*>(&pair.second.first[0]),
-                                pair.second.first.size()));
+                                len));
                 } else if (pair.first == DBREQ_READ) {
                     // read req -- need to flush all preceding writes first!
                     if (!empty_batch) {
@@ -51,16 +52,22 @@ void thread_database(leveldb::DB *db, DbReqQueue *dbq, DbResQueue *resq) {
 
                     // writes done, start the search
                     dbqueries++;
+                    stats->db_reads.store(dbqueries, std::memory_order_relaxed);
                     leveldb::Status s = db->Get(
                             leveldb::ReadOptions(),
                             leveldb::Slice(
                                 reinterpret_cast<char*>(&pair.second.second[0]),
-                                pair.second.second.size()),
+                                len),
                             &value);
 
                     if (s.ok()) {
-                        // found a match! convert the std::string to Hash
-                        Hash preimage;
+                        stats->confirmed++;
+
+                        // found a match! convert the std::string to Hash,
+                        // padding it with the zeros that weren't stored
+                        Hash<Algo> preimage = Hash<Algo>();
+                        if (value.size() > preimage.size())
+                            BOOST_THROW_EXCEPTION(LevelDbReadError());
                         std::copy(value.begin(), value.end(), preimage.begin());
 
                         // if preiamge == it->second.first, then we found a hash cycle without getting a collision
@@ -68,7 +75,7 @@ void thread_database(leveldb::DB *db, DbReqQueue *dbq, DbResQueue *resq) {
 
                         // if we got all the way here, the collision is confirmed, write it to
                         // the thread's result queue (busy wait shouldn't be an issue here)
-                        while (!resq->push(DbRes(preimage, pair.second.first, pair.second.second, dbqueries)));
+                        while (!resq->push(DbRes<Algo>(preimage, pair.second.first, pair.second.second, dbqueries)));
                         // and exit
                         return;
                     } else if (!s.IsNotFound()) {
@@ -101,3 +108,26 @@ void thread_database(leveldb::DB *db, DbReqQueue *dbq, DbResQueue *resq) {
         }
     }
 }
+
+
+// format of the stored hashes, bump when changing it
+static std::string dbMeta(const std::string &algo, size_t bitlen) {
+    return "shabang 2 " + algo + " " + std::to_string(bitlen);
+}
+
+
+leveldb::Status writeDbMeta(leveldb::DB *db, const std::string &algo, size_t bitlen) {
+    return db->Put(leveldb::WriteOptions(), leveldb::Slice(), dbMeta(algo, bitlen));
+}
+
+
+bool checkDbMeta(leveldb::DB *db, const std::string &algo, size_t bitlen) {
+    std::string value;
+    leveldb::Status s = db->Get(leveldb::ReadOptions(), leveldb::Slice(), &value);
+    return s.ok() && value == dbMeta(algo, bitlen);
+}
+
+
+#define INSTANTIATE_THREAD_DATABASE(Algo) \
+    template void thread_database<Algo>(leveldb::DB *, size_t, DbReqQueue<Algo> *, DbResQueue<Algo> *, SearchStats *);
+SHABANG_FOR_EACH_ALGO(INSTANTIATE_THREAD_DATABASE)
@@ -1,11 +1,13 @@
 #ifndef SHABANG_THREAD_DATABASE_HPP_
 #define SHABANG_THREAD_DATABASE_HPP_
 
+#include <string>
 #include <boost/exception_ptr.hpp>
 #include <boost/exception/all.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
 #include <leveldb/db.h>
 #include "datatypes.hpp"
+#include "hash_algo.hpp"
 
 
 /*
@@ -40,8 +42,21 @@ struct InvalidDbOperation : public boost::exception, public std::runtime_error {
 
 /*
  * Consumes and processes write and read requests from hasher thread,
- * exits when a read request is confirmed as a hash collision.
+ * exits when a read request is confirmed as a hash collision. Keys and
+ * values are the first len bytes of the (trimmed) digests of the algorithm
+ * it's instantiated for, the rest of them are always zero.
  */
-void thread_database(leveldb::DB *db, DbReqQueue *dbq, DbResQueue *resq);
+template <class Algo>
+void thread_database(leveldb::DB *db, size_t len, DbReqQueue<Algo> *dbq, DbResQueue<Algo> *resq, SearchStats *stats);
+
+
+/*
+ * The hash algorithm and bit length a store holds hashes of, kept under
+ * the empty key (hashes are at least a byte, bitlen is at least 1).
+ * writeDbMeta() records them in a new store, checkDbMeta() tells whether
+ * an existing one matches them.
+ */
+leveldb::Status writeDbMeta(leveldb::DB *db, const std::string &algo, size_t bitlen);
+bool checkDbMeta(leveldb::DB *db, const std::string &algo, size_t bitlen);
 
 #endif // SHABANG_THREAD_DATABASE_HPP_
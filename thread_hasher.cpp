@@ -1,55 +1,191 @@
 #include <iostream>
+#include <vector>
 #include <boost/thread.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
 #include "libbloom/bloom.h"
 #include "sha_digest/sha256.h"
+#include "chain_index.hpp"
 #include "datatypes.hpp"
+#include "hash_algo.hpp"
+#include "memory_store.hpp"
+#include "sha256_prefix.hpp"
 #include "thread_hasher.hpp"
 
 
-void thread_hasher(const Hash *seed, const size_t bitlen, struct bloom *bloom, DbReqQueue *dbq, HasherResQueue *resq) {
-    // reusable SHA context
-    SHA256_Context ctx;
-    // previous & current hash value
-    HashPair val;
-    // seed becomes the previous "hash"
-    val.first = *seed;
-    // trim the seed
-    trimHash(&val.first, bitlen);
-    // counter of processed hashes
+/*
+ * SHA-256 hashing and trimming for a prefix bit length known at compile
+ * time, everything depending on it gets folded into the hasher loop.
+ */
+template <size_t Bitlen>
+struct PrefixOps {
+    static const bool inlined = true;
+
+    static void hash(const uch *preimage, uch *digest) {
+        sha256Prefix<Bitlen, Bitlen>(preimage, digest);
+    }
+
+    template <size_t N>
+    static size_t trim(std::array<uch, N> *h, size_t) {
+        return trimHash<Bitlen>(h);
+    }
+};
+
+
+/*
+ * Generic fallback for all the other bit lengths and algorithms, these
+ * are hashed by the sha_digest library only.
+ */
+template <>
+struct PrefixOps<0> {
+    static const bool inlined = false;
+
+    static void hash(const uch *, uch *) {}
+
+    template <size_t N>
+    static size_t trim(std::array<uch, N> *h, size_t bitlen) {
+        return trimHash(h, bitlen);
+    }
+};
+
+
+// hashes looked up in the bloom filter at once
+const size_t BLOOM_BATCH = 32;
+
+
+template <class Algo, size_t Bitlen>
+static void hasher_loop(const std::vector<Hash<Algo>> *seeds, const size_t bitlen, struct bloom *bloom, DbReqQueue<Algo> *dbq, HasherResQueue *resq, SearchStats *stats, MemoryStore *store, size_t checkpoint_interval, DbResQueue<Algo> *storeq) {
+    // previous & current hash value of each chain
+    std::vector<HashPair<Algo>> vals(seeds->size());
+    // where the SHA functions read the preimages and write the hashes
+    std::vector<const void *> preimages(vals.size());
+    std::vector<unsigned char *> digests(vals.size());
+    for (size_t i = 0; i < vals.size(); i++) {
+        // seed becomes the previous "hash"
+        vals[i].first = seeds->at(i);
+        // trim the seed
+        trimHash(&vals[i].first, bitlen);
+        preimages[i] = &vals[i].first[0];
+        digests[i] = &vals[i].second[0];
+    }
+    // the constant part of the block (padding and length) is the same
+    // for every hash, so precompute what depends on it only once;
+    // of the result only the first bitlen bits are used
+    typename Algo::Plan plan;
+    Algo::plan_init(&plan, bitlen);
+    // the inlined code is portable, the library's hardware backends
+    // (if selected) are still faster
+    const bool inlined = PrefixOps<Bitlen>::inlined
+                         && sha256_get_backend() == SHA256_BACKEND_PORTABLE;
+    // the chains are stepped a few times before the bloom filter gets
+    // checked for all the new hashes at once, so the cache misses of the
+    // lookups overlap
+    const size_t steps = (BLOOM_BATCH + vals.size() - 1) / vals.size();
+    std::vector<HashPair<Algo>> batch(steps * vals.size());
+    std::vector<uint64_t> h1(batch.size()), h2(batch.size());
+    std::vector<int> seen(batch.size());
+    // preimage of a hash found in the memory store
+    Hash<Algo> preimage = Hash<Algo>();
+    // with positions for values: the position of a hash, as stored and as
+    // found, and the chains' preimages at every checkpoint_interval-th step
+    const bool indexed = store && checkpoint_interval;
+    std::vector<uch> index(indexed ? store->value_size() : 0);
+    std::vector<uch> found(index.size());
+    std::vector<Hash<Algo>> checkpoints;
+    ull step_count = 0;
+    // counters of processed hashes and of those (probably) seen before
     ull hashes = 0;
+    ull hits = 0;
 
     try {
         for (;;) {
-            // compute hash of firsts bitlen bits of previous hash
-            sha256_initialize(&ctx);
-            sha256_add_bits(&ctx, &val.first[0], bitlen);
-            sha256_calculate(&ctx, &val.second[0]);
-            size_t len = trimHash(&val.second, bitlen);
-
-            // if bloom filter (probably) contains the hash,
-            // forward it to the db queue for confirmation
-            if (bloom_check(bloom, &val.second[0], len)) {
-                while (!dbq->push(HashPairDbReq(DBREQ_READ, val))) {
-                    // iterruptible 1ms sleep if dbrq is full
-                    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+            for (size_t step = 0, b = 0; step < steps; step++, step_count++) {
+                if (indexed && step_count % checkpoint_interval == 0)
+                    for (auto & val : vals)
+                        checkpoints.push_back(val.first);
+
+                // compute hashes of firsts bitlen bits of previous hashes
+                // (always fits into a single block, so skip the SHA context),
+                // the chains are independent and get hashed in parallel
+                if (inlined) {
+                    for (auto & val : vals)
+                        PrefixOps<Bitlen>::hash(&val.first[0], &val.second[0]);
+                } else {
+                    Algo::hash_multi(&plan, &preimages[0], &digests[0], vals.size());
+                }
+
+                for (auto & val : vals) {
+                    size_t len = PrefixOps<Bitlen>::trim(&val.second, bitlen);
+
+                    // the probe positions come straight from the prefix bits
+                    bloomSeeds(val.second, len, &h1[b], &h2[b]);
+                    batch[b++] = val;
+
+                    // current hash becomes preimage of the next one
+                    val.first = val.second;
                 }
             }
 
-            // submit to db queue
-            while (!dbq->push(HashPairDbReq(DBREQ_WRITE, val))) {
-                // iterruptible 1ms sleep if dbq is full
-                boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+            if (store) {
+                // start fetching the slots of the whole batch, then look up
+                // and insert the hashes in order
+                for (size_t b = 0; b < batch.size(); b++)
+                    store->prefetch(h1[b]);
+
+                for (size_t b = 0; b < batch.size(); b++) {
+                    const uch *value = &batch[b].first[0];
+                    if (indexed) {
+                        encodeIndex(hashes, &index);
+                        value = &index[0];
+                    }
+                    hashes++;
+                    if (store->find_or_insert(&batch[b].second[0], value, h1[b], indexed ? &found[0] : &preimage[0])) {
+                        if (indexed)
+                            preimage = replayChain<Algo>(checkpoints, vals.size(), checkpoint_interval,
+                                                         decodeIndex(found), &plan, bitlen);
+
+                        // no false positives, the collision is confirmed
+                        stats->db_reads.store(1);
+                        stats->confirmed.store(1);
+                        stats->hashes.store(hashes, std::memory_order_relaxed);
+                        while (!storeq->push(DbRes<Algo>(preimage, batch[b].first, batch[b].second, 1)));
+                        while (!resq->push(hashes));
+                        return;
+                    }
+                }
+
+                stats->hashes.store(hashes, std::memory_order_relaxed);
+                boost::this_thread::interruption_point();
+                continue;
             }
 
-            // add the trimmed hash to the bloom filter
-            bloom_add(bloom, &val.second[0], len);
+            // add the trimmed hashes to the bloom filter, in the order they
+            // were computed
+            bloom_check_add_batch(bloom, &h1[0], &h2[0], batch.size(), &seen[0], 1);
 
-            // current hash becomes preimage of the next one
-            val.first = val.second;
+            for (size_t b = 0; b < batch.size(); b++) {
+                // if it (probably) was in there already forward it to the
+                // db queue for confirmation
+                if (seen[b]) {
+                    hits++;
+                    while (!dbq->push(HashPairDbReq<Algo>(DBREQ_READ, batch[b]))) {
+                        // iterruptible 1ms sleep if dbrq is full
+                        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+                    }
+                }
 
-            // increment the processed hash count
-            hashes++;
+                // submit to db queue
+                while (!dbq->push(HashPairDbReq<Algo>(DBREQ_WRITE, batch[b]))) {
+                    // iterruptible 1ms sleep if dbq is full
+                    boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+                }
+
+                // increment the processed hash count
+                hashes++;
+            }
+
+            // publish the counters once per batch
+            stats->hashes.store(hashes, std::memory_order_relaxed);
+            stats->filter_hits.store(hits, std::memory_order_relaxed);
 
             // give main thread a chance to stop us
             boost::this_thread::interruption_point();
@@ -62,5 +198,65 @@ void thread_hasher(const Hash *seed, const size_t bitlen, struct bloom *bloom, D
 
         // ...and exit
         return;
+    } catch (MemoryStoreFull &) {
+        // the walk took more hashes than the memory store holds, tell main
+        // there's no collision (by a result of 0 queries) and exit
+        stats->hashes.store(hashes, std::memory_order_relaxed);
+        while (!storeq->push(DbRes<Algo>(Hash<Algo>(), Hash<Algo>(), Hash<Algo>(), 0)));
+        while (!resq->push(hashes));
+        return;
+    }
+}
+
+
+/*
+ * Picks the hasher loop, only SHA-256 has any specialized for bit lengths.
+ */
+template <class Algo>
+struct HasherLoops {
+    static void run(const std::vector<Hash<Algo>> *seeds, const size_t bitlen, struct bloom *bloom, DbReqQueue<Algo> *dbq, HasherResQueue *resq, SearchStats *stats, MemoryStore *store, size_t checkpoint_interval, DbResQueue<Algo> *storeq) {
+        hasher_loop<Algo, 0>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
     }
+};
+
+
+template <>
+struct HasherLoops<Sha256Algo> {
+    static void run(const std::vector<Hash<Sha256Algo>> *seeds, const size_t bitlen, struct bloom *bloom, DbReqQueue<Sha256Algo> *dbq, HasherResQueue *resq, SearchStats *stats, MemoryStore *store, size_t checkpoint_interval, DbResQueue<Sha256Algo> *storeq) {
+        // common prefix lengths get a loop of their own
+        switch (bitlen) {
+            case 24:
+                hasher_loop<Sha256Algo, 24>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
+                break;
+            case 32:
+                hasher_loop<Sha256Algo, 32>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
+                break;
+            case 40:
+                hasher_loop<Sha256Algo, 40>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
+                break;
+            case 48:
+                hasher_loop<Sha256Algo, 48>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
+                break;
+            case 56:
+                hasher_loop<Sha256Algo, 56>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
+                break;
+            case 64:
+                hasher_loop<Sha256Algo, 64>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
+                break;
+            default:
+                hasher_loop<Sha256Algo, 0>(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
+                break;
+        }
+    }
+};
+
+
+template <class Algo>
+void thread_hasher(const std::vector<Hash<Algo>> *seeds, const size_t bitlen, struct bloom *bloom, DbReqQueue<Algo> *dbq, HasherResQueue *resq, SearchStats *stats, MemoryStore *store, size_t checkpoint_interval, DbResQueue<Algo> *storeq) {
+    HasherLoops<Algo>::run(seeds, bitlen, bloom, dbq, resq, stats, store, checkpoint_interval, storeq);
 }
+
+
+#define INSTANTIATE_THREAD_HASHER(Algo) \
+    template void thread_hasher<Algo>(const std::vector<Hash<Algo>> *, const size_t, struct bloom *, DbReqQueue<Algo> *, HasherResQueue *, SearchStats *, MemoryStore *, size_t, DbResQueue<Algo> *);
+SHABANG_FOR_EACH_ALGO(INSTANTIATE_THREAD_HASHER)
@@ -1,17 +1,29 @@
 #ifndef SHABANG_THREAD_HASHER_HPP_
 #define SHABANG_THREAD_HASHER_HPP_
 
+#include <vector>
 #include <boost/lockfree/spsc_queue.hpp>
 #include "libbloom/bloom.h"
 #include "sha_digest/sha256.h"
 #include "datatypes.hpp"
+#include "hash_algo.hpp"
+#include "memory_store.hpp"
 
 
 /*
  * Computes (trimmed) hashes, locally checks for possible collisions (via
  * a bloom filter), forwards all computed hashes and possible collisions
- * to DB thread for writing and confirmation, respectively.
+ * to DB thread for writing and confirmation, respectively. Advances one
+ * independent chain of hashes per seed, all of them in lockstep.
+ * With a memory store instead, there's no bloom filter and DB thread: the
+ * hashes get looked up and inserted right away, and the collision goes to
+ * storeq (or, if the store runs full first, a result of 0 queries).
+ * Given a checkpoint_interval, the store's values are where the hashes
+ * are in the chains rather than their preimages, those get recomputed
+ * from chain checkpoints kept every checkpoint_interval steps.
+ * Instantiated for each of the algorithms in hash_algo.hpp.
  */
-void thread_hasher(const Hash *seed, const size_t bitlen, struct bloom *bloom, DbReqQueue *dbq, HasherResQueue *resq);
+template <class Algo>
+void thread_hasher(const std::vector<Hash<Algo>> *seeds, const size_t bitlen, struct bloom *bloom, DbReqQueue<Algo> *dbq, HasherResQueue *resq, SearchStats *stats, MemoryStore *store, size_t checkpoint_interval, DbResQueue<Algo> *storeq);
 
 #endif // SHABANG_THREAD_HASHER_HPP_